@@ -0,0 +1,437 @@
+/////////////////////////////////////////////
+//
+// Cluster LOD hierarchy
+//
+// Builds a DAG of cluster LODs on top of the simplifier of Simplify.h,
+// for virtualized geometry renderers :
+//  - the mesh is partitioned into clusters of about cluster_size triangles,
+//  - neighbouring clusters are merged into groups of about group_size,
+//  - every group is simplified to half of its triangles with its outline
+//    locked, so that groups can be swapped independently,
+//  - the simplified groups are partitioned into new clusters,
+// until a single cluster is left or the mesh cannot be simplified further.
+//
+// Every group is copied into its own engine context (Simplify::Engine) and
+// simplified there, so the groups of a level run in parallel; the
+// collapses inside a group are serial, like those of simplify_mesh.
+//
+// License : MIT
+// http://opensource.org/licenses/MIT
+
+#ifndef CLUSTER_LOD_H
+#define CLUSTER_LOD_H
+
+#include "Simplify.h"
+
+namespace Simplify
+{
+    struct Cluster
+    {
+        int level;           // LOD level, 0 is the input mesh
+        fqmr_index first, count; // triangle range in the faces of the level
+        int group;           // group merged into to build the next level, -1 for roots
+        int parent_group;    // group this cluster was built from, -1 at level 0
+        double error;        // simplification error of parent_group, 0 at level 0
+        double parent_error; // error of group, DBL_MAX for roots
+        vec3f center;        // bounding sphere
+        double radius;
+    };
+
+    struct ClusterLevel
+    {
+        std::vector<vec3f> vertices;
+        std::vector<fqmr_index> faces; // 3 indices per triangle, sorted by cluster
+    };
+
+    std::vector<Cluster> clusters;
+    std::vector<ClusterLevel> cluster_levels;
+
+    // Greedy breadth-first partition of the triangles of one group into
+    // clusters of cluster_size triangles. Each cluster grows from a single
+    // seed, which keeps it compact (short outlines leave the groups enough
+    // unlocked vertices to be halved); the seed is taken on the front of the
+    // previous cluster. Pockets left between clusters, below half of
+    // cluster_size, are merged into a neighbouring cluster.
+    void partition_group(const fqmr_index *tris, fqmr_index num_tris, int group, int cluster_size,
+                         const std::vector<fqmr_index> &adj_start, const std::vector<fqmr_index> &adj,
+                         std::vector<char> &assigned, std::vector<int> &cluster_of,
+                         std::vector<std::vector<fqmr_index> > &out)
+    {
+        std::vector<fqmr_index> queue, current, front;
+        fqmr_index next = 0;
+        while (true)
+        {
+            fqmr_index seed = -1;
+            loopi(0, front.size()) {if (!assigned[front[i]]) {seed = front[i]; break;}}
+            if (seed < 0)
+            {
+                while (next < num_tris && assigned[tris[next]]) {next++;}
+                if (next == num_tris) {break;}
+                seed = tris[next];
+            }
+            queue.clear();
+            queue.push_back(seed);
+            current.clear();
+            size_t head = 0;
+            for (; head < queue.size() && (int)current.size() < cluster_size; head++)
+            {
+                fqmr_index t = queue[head];
+                if (assigned[t]) {continue;}
+                assigned[t] = 1;
+                current.push_back(t);
+                loopj(0, 3)
+                {
+                    fqmr_index v = triangles[t].v[j];
+                    for (fqmr_index k = adj_start[v]; k < adj_start[v + 1]; k++)
+                    {
+                        fqmr_index n = adj[k];
+                        // other groups are partitioned concurrently : only
+                        // read the flags of this one
+                        if (triangles[n].material == group && !assigned[n]) {queue.push_back(n);}
+                    }
+                }
+            }
+            front.assign(queue.begin() + head, queue.end());
+            loopi(0, current.size()) {cluster_of[current[i]] = out.size();}
+            out.push_back(current);
+        }
+
+        // pockets : into the cluster of an adjacent triangle
+        loopi(0, out.size())
+        {
+            if ((int)out[i].size() * 2 >= cluster_size) {continue;}
+            int target = -1;
+            loopj(0, out[i].size()) loopk(0, 3)
+            {
+                fqmr_index v = triangles[out[i][j]].v[k];
+                for (fqmr_index a = adj_start[v]; a < adj_start[v + 1] && target < 0; a++)
+                {
+                    fqmr_index n = adj[a];
+                    if (triangles[n].material == group && cluster_of[n] != (int)i && !out[cluster_of[n]].empty()) {target = cluster_of[n];}
+                }
+            }
+            if (target < 0) {continue;}
+            loopj(0, out[i].size()) {cluster_of[out[i][j]] = target;}
+            out[target].insert(out[target].end(), out[i].begin(), out[i].end());
+            out[i].clear();
+        }
+        size_t kept = 0;
+        loopi(0, out.size()) {if (!out[i].empty()) {out[kept++].swap(out[i]);}}
+        out.resize(kept);
+    }
+
+    // Partition every group of the current mesh (Triangle::material) into
+    // clusters, groups are processed in parallel. Returns the clusters in
+    // group order, as lists of triangle ids.
+    void partition_groups(int num_groups, int cluster_size, std::vector<int> &cluster_group,
+                          std::vector<std::vector<fqmr_index> > &result)
+    {
+        fqmr_index num_v = vertices.size(), num_f = triangles.size();
+
+        // vertex -> triangle adjacency
+        std::vector<fqmr_index> adj_start(num_v + 1, 0), adj(num_f * 3);
+        loopi(0, num_f) loopj(0, 3) {adj_start[triangles[i].v[j] + 1]++;}
+        loopi(0, num_v) {adj_start[i + 1] += adj_start[i];}
+        std::vector<fqmr_index> fill(adj_start.begin(), adj_start.end() - 1);
+        loopi(0, num_f) loopj(0, 3) {adj[fill[triangles[i].v[j]]++] = i;}
+
+        // triangles bucketed by group
+        std::vector<fqmr_index> group_start(num_groups + 1, 0), group_tris(num_f);
+        loopi(0, num_f) {group_start[triangles[i].material + 1]++;}
+        loopi(0, num_groups) {group_start[i + 1] += group_start[i];}
+        fill.assign(group_start.begin(), group_start.end() - 1);
+        loopi(0, num_f) {group_tris[fill[triangles[i].material]++] = i;}
+
+        std::vector<char> assigned(num_f, 0);
+        std::vector<int> cluster_of(num_f, -1); // in the clusters of the group
+        std::vector<std::vector<std::vector<fqmr_index> > > per_group(num_groups);
+        // one group per iteration, the cutoff applies to the triangles
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(loop_threads(PHASE_PREPASS, num_f))
+        loopi(0, num_groups)
+        {
+            partition_group(&group_tris[0] + group_start[i], group_start[i + 1] - group_start[i], i,
+                            cluster_size, adj_start, adj, assigned, cluster_of, per_group[i]);
+        }
+
+        result.clear();
+        cluster_group.clear();
+        loopi(0, num_groups) loopj(0, per_group[i].size())
+        {
+            result.push_back(per_group[i][j]);
+            cluster_group.push_back(i);
+        }
+    }
+
+    // Greedily merge neighbouring clusters (sharing the most vertices) into
+    // groups of group_size clusters. Returns the number of groups.
+    int group_clusters(const std::vector<std::vector<fqmr_index> > &parts, int group_size, std::vector<int> &cluster_group)
+    {
+        fqmr_index num_v = vertices.size();
+        int num_c = parts.size();
+
+        // clusters touching each vertex
+        std::vector<fqmr_index> vstart(num_v + 1, 0);
+        std::vector<int> vclusters;
+        loopi(0, num_c) loopj(0, parts[i].size()) loopk(0, 3) {vstart[triangles[parts[i][j]].v[k] + 1]++;}
+        loopi(0, num_v) {vstart[i + 1] += vstart[i];}
+        vclusters.resize(vstart[num_v]);
+        std::vector<fqmr_index> fill(vstart.begin(), vstart.end() - 1);
+        loopi(0, num_c) loopj(0, parts[i].size()) loopk(0, 3) {vclusters[fill[triangles[parts[i][j]].v[k]]++] = i;}
+
+        // cluster adjacency weighted by the number of shared vertices
+        std::vector<std::map<int, int> > neighbours(num_c);
+        loopi(0, num_v)
+        {
+            std::vector<int> c(vclusters.begin() + vstart[i], vclusters.begin() + vstart[i + 1]);
+            std::sort(c.begin(), c.end());
+            c.erase(std::unique(c.begin(), c.end()), c.end());
+            loopj(0, c.size()) loopk(j + 1, c.size())
+            {
+                neighbours[c[j]][c[k]]++;
+                neighbours[c[k]][c[j]]++;
+            }
+        }
+
+        cluster_group.assign(num_c, -1);
+        int num_groups = 0;
+        loopi(0, num_c)
+        {
+            if (cluster_group[i] >= 0) {continue;}
+            std::vector<int> members(1, i);
+            cluster_group[i] = num_groups;
+            while ((int)members.size() < group_size)
+            {
+                int best = -1, best_shared = 0;
+                loopj(0, members.size())
+                {
+                    std::map<int, int>::const_iterator it = neighbours[members[j]].begin();
+                    for (; it != neighbours[members[j]].end(); ++it)
+                    {
+                        if (cluster_group[it->first] < 0 && it->second > best_shared)
+                        {
+                            best_shared = it->second;
+                            best = it->first;
+                        }
+                    }
+                }
+                if (best < 0) {break;}
+                cluster_group[best] = num_groups;
+                members.push_back(best);
+            }
+            num_groups++;
+        }
+        return num_groups;
+    }
+
+    // Simplify every group of the current mesh (Triangle::material) to half
+    // of its triangles, outline (vertices shared with other groups) locked.
+    // Each group runs in its own engine context, groups in parallel; the
+    // simplified groups replace the mesh, vertices kept in their order.
+    // Returns the error of each group : largest quadric error of its
+    // vertices, in distance units.
+    void simplify_groups(int num_groups, double agressiveness, int max_iterations, std::vector<double> &group_error)
+    {
+        fqmr_index num_v = vertices.size(), num_f = triangles.size();
+
+        // triangles bucketed by group, outline vertices
+        std::vector<fqmr_index> group_start(num_groups + 1, 0), group_tris(num_f);
+        loopi(0, num_f) {group_start[triangles[i].material + 1]++;}
+        loopi(0, num_groups) {group_start[i + 1] += group_start[i];}
+        std::vector<fqmr_index> fill(group_start.begin(), group_start.end() - 1);
+        loopi(0, num_f) {group_tris[fill[triangles[i].material]++] = i;}
+        std::vector<int> owner(num_v, -1);
+        std::vector<char> outline(num_v, 0);
+        loopi(0, num_f) loopj(0, 3)
+        {
+            fqmr_index v = triangles[i].v[j];
+            if (owner[v] < 0) {owner[v] = triangles[i].material;}
+            else if (owner[v] != triangles[i].material) {outline[v] = 1;}
+        }
+
+        // one group per iteration, the cutoff applies to the triangles
+        std::vector<Engine> groups(num_groups);
+        std::vector<std::vector<fqmr_index> > group_vertices(num_groups); // local -> mesh vertex
+        group_error.assign(num_groups, 0.0);
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(loop_threads(PHASE_PREPASS, num_f))
+        loopi(0, num_groups)
+        {
+            Engine &e = groups[i];
+            std::vector<fqmr_index> &gv = group_vertices[i];
+            fqmr_index first = group_start[i], count = group_start[i + 1] - first;
+            loopj(0, count) loopk(0, 3) {gv.push_back(triangles[group_tris[first + j]].v[k]);}
+            std::sort(gv.begin(), gv.end());
+            gv.erase(std::unique(gv.begin(), gv.end()), gv.end());
+
+            resize_array(e.vertices, gv.size());
+            e.vertex_locked.resize(gv.size());
+            if (!vertex_weights.empty()) {e.vertex_weights.resize(gv.size());}
+            loopj(0, gv.size())
+            {
+                e.vertices[j].p = vertices[gv[j]].p;
+                e.vertices[j].id = j;
+                e.vertex_locked[j] = outline[gv[j]];
+                if (!vertex_weights.empty()) {e.vertex_weights[j] = vertex_weights[vertices[gv[j]].id];}
+            }
+            resize_array(e.triangles, count);
+            loopj(0, count)
+            {
+                Triangle &t = e.triangles[j];
+                t = triangles[group_tris[first + j]];
+                loopk(0, 3) {t.v[k] = std::lower_bound(gv.begin(), gv.end(), t.v[k]) - gv.begin();}
+                t.deleted = 0;
+                t.dirty = 0;
+            }
+            e.simplify_mesh(count - count / 2, 5, agressiveness, 1e-9, 3, max_iterations, 0, false, true, false, -1);
+
+            std::vector<double> verror;
+            e.vertex_errors(verror);
+            loopj(0, verror.size()) {group_error[i] = fmax(group_error[i], sqrt(verror[j]));}
+        }
+
+        // merge : surviving vertices keep their order, outline vertices are
+        // shared by their groups and did not move
+        std::vector<fqmr_index> remap(num_v, -1);
+        loopi(0, num_groups) loopj(0, groups[i].vertices.size())
+        {
+            const Vertex &v = groups[i].vertices[j];
+            fqmr_index g = group_vertices[i][v.id];
+            vertices[g].p = v.p;
+            remap[g] = 0;
+        }
+        fqmr_index dst = 0;
+        loopi(0, num_v)
+        {
+            if (remap[i] < 0) {continue;}
+            remap[i] = dst;
+            vertices[dst++] = vertices[i];
+        }
+        vertices.resize(dst);
+        dst = 0;
+        loopi(0, num_groups) {dst += groups[i].triangles.size();}
+        triangles.resize(dst);
+        dst = 0;
+        loopi(0, num_groups) loopj(0, groups[i].triangles.size())
+        {
+            Triangle &t = triangles[dst++];
+            t = groups[i].triangles[j];
+            loopk(0, 3) {t.v[k] = remap[group_vertices[i][groups[i].vertices[t.v[k]].id]];}
+        }
+    }
+
+    // Append a level : snapshot of the current mesh, with faces sorted by
+    // cluster, and its clusters
+    void add_cluster_level(int level, const std::vector<std::vector<fqmr_index> > &parts,
+                           const std::vector<int> &parent_group, const std::vector<double> &error)
+    {
+        cluster_levels.push_back(ClusterLevel());
+        ClusterLevel &out = cluster_levels.back();
+        out.vertices.resize(vertices.size());
+        loopi(0, vertices.size()) {out.vertices[i] = vertices[i].p;}
+
+        int first = clusters.size();
+        clusters.resize(first + parts.size());
+        fqmr_index tri = 0;
+        loopi(0, parts.size())
+        {
+            Cluster &c = clusters[first + i];
+            c.level = level;
+            c.first = tri;
+            c.count = parts[i].size();
+            c.group = -1;
+            c.parent_group = parent_group[i];
+            c.error = error[i];
+            c.parent_error = DBL_MAX;
+            tri += c.count;
+            loopj(0, parts[i].size()) loopk(0, 3) {out.faces.push_back(triangles[parts[i][j]].v[k]);}
+        }
+
+        // bounding spheres, the cutoff applies to the triangles
+        int num_c = parts.size();
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_PREPASS, tri))
+        loopi(0, num_c)
+        {
+            Cluster &c = clusters[first + i];
+            vec3f center(0, 0, 0);
+            loopj(0, c.count * 3) {center = center + out.vertices[out.faces[c.first * 3 + j]];}
+            center = center / double(c.count * 3);
+            double radius = 0;
+            loopj(0, c.count * 3) {radius = fmax(radius, (out.vertices[out.faces[c.first * 3 + j]] - center).length());}
+            c.center = center;
+            c.radius = radius;
+        }
+    }
+
+    //
+    // Build the cluster LOD DAG from the current mesh.
+    //
+    // cluster_size : target number of triangles per cluster
+    // group_size   : number of clusters merged and simplified together
+    // max_levels   : maximum number of levels, including level 0
+    // other parameters are passed to simplify_mesh
+    //
+    // Errors are reported in distance units (square root of the quadric
+    // error) and are monotonic along the DAG. Results are left in
+    // clusters and cluster_levels.
+    //
+    void build_cluster_lod(int cluster_size = 128, int group_size = 4, int max_levels = 16,
+                           double agressiveness = 7, int max_iterations = 100, bool verbose = false)
+    {
+        clusters.clear();
+        cluster_levels.clear();
+        loopi(0, triangles.size()) {triangles[i].material = 0;}
+
+        std::vector<std::vector<fqmr_index> > parts;
+        std::vector<int> part_group;
+        partition_groups(1, cluster_size, part_group, parts);
+        add_cluster_level(0, parts, std::vector<int>(parts.size(), -1), std::vector<double>(parts.size(), 0.0));
+
+        int group_base = 0;
+        for (int level = 1; level < max_levels; level++)
+        {
+            int level_first = clusters.size() - parts.size();
+            if (parts.size() <= 1) {break;}
+
+            // groups of neighbouring clusters
+            std::vector<int> cluster_group;
+            int num_groups = group_clusters(parts, group_size, cluster_group);
+            loopi(0, parts.size()) loopj(0, parts[i].size()) {triangles[parts[i][j]].material = cluster_group[i];}
+
+            // every group loses half of its triangles
+            size_t num_f = triangles.size();
+            std::vector<double> group_error;
+            simplify_groups(num_groups, agressiveness, max_iterations, group_error);
+
+            if (verbose) {
+                std::cout << "cluster lod level " << level << " - groups " << num_groups << " triangles " << num_f << " -> " << triangles.size() << std::endl;
+            }
+            if (triangles.size() > num_f * 0.85) {break;} // stuck, current clusters are the roots
+
+            // group errors : at least the error of its clusters
+            loopi(0, parts.size())
+            {
+                Cluster &c = clusters[level_first + i];
+                group_error[cluster_group[i]] = fmax(group_error[cluster_group[i]], c.error);
+            }
+            loopi(0, parts.size())
+            {
+                Cluster &c = clusters[level_first + i];
+                c.group = group_base + cluster_group[i];
+                c.parent_error = group_error[cluster_group[i]];
+            }
+
+            // new clusters inside each simplified group
+            partition_groups(num_groups, cluster_size, part_group, parts);
+            std::vector<int> parent_group(parts.size());
+            std::vector<double> error(parts.size());
+            loopi(0, parts.size())
+            {
+                parent_group[i] = group_base + part_group[i];
+                error[i] = group_error[part_group[i]];
+            }
+            add_cluster_level(level, parts, parent_group, error);
+            group_base += num_groups;
+        }
+    } // build_cluster_lod()
+};
+
+#endif // CLUSTER_LOD_H
@@ -0,0 +1,553 @@
+/////////////////////////////////////////////
+//
+// Compact binary encoding of meshes, for storage and transfer
+//
+// Indices are coded against the recently used vertices and the next
+// vertex never referenced, which suits the output of
+// optimize_vertex_cache / optimize_vertex_fetch. Positions are quantized
+// to bits per coordinate over the bounding box and predicted, in the
+// order of their first reference, from the triangles already decoded
+// (parallelogram rule). Both streams are zigzag varints, entropy coded
+// with an order-0 rANS coder (12-bit frequencies) or stored as is when
+// that is smaller.
+//
+// Layout : EncodedHeader, then the index and position streams, each
+// u8 mode, u64 byte count, then for rANS the used symbols (32-byte
+// bitmap, varint frequencies), u64 payload size and the payload.
+// Little-endian, decoded without the engine state.
+//
+// License : MIT
+// http://opensource.org/licenses/MIT
+
+#ifndef ENCODE_H
+#define ENCODE_H
+
+#include "Simplify.h"
+
+#include <limits>
+#include <stdint.h> //SIZE_MAX
+
+namespace Simplify
+{
+    struct EncodedHeader
+    {
+        char magic[4];                 // "FQME"
+        unsigned int version;
+        unsigned int bits;             // quantization bits per coordinate
+        unsigned int reserved;
+        unsigned long long num_vertices, num_triangles;
+        double origin[3], step[3];     // p = origin + q * step
+    };
+
+    const unsigned int encoded_version = 1;
+    const int encoded_max_bits = 30;
+
+    const int rans_scale_bits = 12;
+    const unsigned int rans_total = 1u << rans_scale_bits;
+    const unsigned int rans_lower = 1u << 23; // state in [lower, lower << 8)
+
+    unsigned long long zigzag(long long v) {return ((unsigned long long)v << 1) ^ (unsigned long long)(v >> 63);}
+    long long unzigzag(unsigned long long v) {return (long long)(v >> 1) ^ -(long long)(v & 1);}
+
+    void put_varint(std::vector<unsigned char> &out, unsigned long long v)
+    {
+        while (v >= 0x80)
+        {
+            out.push_back((unsigned char)(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back((unsigned char)v);
+    }
+
+    const int varint_max_bytes = 10; // of a 64-bit value
+
+    // false on truncated or overlong input
+    bool get_varint(const unsigned char *&p, const unsigned char *end, unsigned long long &v)
+    {
+        v = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            if (p == end) {return false;}
+            unsigned char b = *p++;
+            v |= (unsigned long long)(b & 0x7F) << shift;
+            if (!(b & 0x80)) {return true;}
+        }
+        return false;
+    }
+
+    void put_u64(std::vector<unsigned char> &out, unsigned long long v)
+    {
+        loopi(0, 8) {out.push_back((unsigned char)(v >> (8 * i)));}
+    }
+
+    bool get_u64(const unsigned char *&p, const unsigned char *end, unsigned long long &v)
+    {
+        if (end - p < 8) {return false;}
+        v = 0;
+        loopi(0, 8) {v |= (unsigned long long)p[i] << (8 * i);}
+        p += 8;
+        return true;
+    }
+
+    // Frequencies summing to rans_total, at least 1 for every used symbol
+    void rans_frequencies(const std::vector<unsigned char> &symbols, unsigned int freq[256])
+    {
+        unsigned long long count[256] = {0};
+        for (size_t i = 0; i < symbols.size(); i++) {count[symbols[i]]++;}
+        unsigned long long n = symbols.size();
+        long long sum = 0;
+        loopi(0, 256)
+        {
+            freq[i] = count[i] ? std::max<unsigned long long>(1, count[i] * rans_total / n) : 0;
+            sum += freq[i];
+        }
+        // fix the rounding on the largest frequencies
+        while (sum != rans_total)
+        {
+            int best = -1;
+            loopi(0, 256)
+            {
+                if (freq[i] > (sum > rans_total ? 1u : 0u) && (best < 0 || freq[i] > freq[best])) {best = i;}
+            }
+            if (sum > rans_total) {freq[best]--; sum--;}
+            else {freq[best]++; sum++;}
+        }
+    }
+
+    // Append a byte stream, rANS coded when that is smaller
+    void put_stream(std::vector<unsigned char> &out, const std::vector<unsigned char> &symbols)
+    {
+        std::vector<unsigned char> coded;
+        if (symbols.size() >= 64)
+        {
+            unsigned int freq[256], cum[257];
+            rans_frequencies(symbols, freq);
+            cum[0] = 0;
+            loopi(0, 256) {cum[i + 1] = cum[i] + freq[i];}
+
+            // table : bitmap of the used symbols, their frequencies
+            unsigned char bitmap[32] = {0};
+            loopi(0, 256) if (freq[i]) {bitmap[i >> 3] |= 1 << (i & 7);}
+            coded.insert(coded.end(), bitmap, bitmap + 32);
+            loopi(0, 256) if (freq[i]) {put_varint(coded, freq[i] - 1);}
+
+            // rANS runs backwards : encode from the last symbol, then
+            // reverse the bytes so that the decoder reads forward
+            std::vector<unsigned char> payload;
+            payload.reserve(symbols.size() / 2 + 16);
+            unsigned int x = rans_lower;
+            for (size_t i = symbols.size(); i-- > 0;)
+            {
+                unsigned int f = freq[symbols[i]];
+                unsigned int x_max = ((rans_lower >> rans_scale_bits) << 8) * f;
+                while (x >= x_max)
+                {
+                    payload.push_back((unsigned char)x);
+                    x >>= 8;
+                }
+                x = ((x / f) << rans_scale_bits) + (x % f) + cum[symbols[i]];
+            }
+            loopi(0, 4) {payload.push_back((unsigned char)(x >> (8 * i)));} // read back big-endian
+            std::reverse(payload.begin(), payload.end());
+            put_u64(coded, payload.size());
+            coded.insert(coded.end(), payload.begin(), payload.end());
+        }
+
+        bool raw = coded.empty() || coded.size() >= symbols.size();
+        out.push_back(raw ? 0 : 1);
+        put_u64(out, symbols.size());
+        if (raw) {out.insert(out.end(), symbols.begin(), symbols.end());}
+        else {out.insert(out.end(), coded.begin(), coded.end());}
+    }
+
+    // Read a stream written by put_stream, false on malformed input or
+    // more than max_symbols symbols
+    bool get_stream(const unsigned char *&p, const unsigned char *end, unsigned long long max_symbols,
+                    std::vector<unsigned char> &symbols)
+    {
+        if (p == end) {return false;}
+        unsigned char mode = *p++;
+        unsigned long long n;
+        if (!get_u64(p, end, n) || mode > 1) {return false;}
+        if (n > max_symbols || n > symbols.max_size()) {return false;}
+        if (mode == 0)
+        {
+            if ((unsigned long long)(end - p) < n) {return false;}
+            symbols.assign(p, p + n);
+            p += n;
+            return true;
+        }
+
+        if (end - p < 32) {return false;}
+        const unsigned char *bitmap = p;
+        p += 32;
+        unsigned int freq[256], cum[257];
+        cum[0] = 0;
+        loopi(0, 256)
+        {
+            unsigned long long f = 0;
+            if (bitmap[i >> 3] & (1 << (i & 7)))
+            {
+                if (!get_varint(p, end, f) || f >= rans_total) {return false;}
+                f++;
+            }
+            freq[i] = f;
+            cum[i + 1] = cum[i] + f;
+        }
+        if (cum[256] != rans_total) {return false;}
+        unsigned char slot_symbol[rans_total];
+        loopi(0, 256) for (unsigned int s = cum[i]; s < cum[i + 1]; s++) {slot_symbol[s] = i;}
+
+        unsigned long long size;
+        if (!get_u64(p, end, size) || size < 4 || (unsigned long long)(end - p) < size) {return false;}
+        const unsigned char *in = p, *in_end = p + size;
+        p = in_end;
+        unsigned int x = 0;
+        loopi(0, 4) {x = (x << 8) | *in++;}
+        symbols.resize(n);
+        for (unsigned long long i = 0; i < n; i++)
+        {
+            unsigned int slot = x & (rans_total - 1);
+            unsigned char s = slot_symbol[slot];
+            symbols[i] = s;
+            x = freq[s] * (x >> rans_scale_bits) + slot - cum[s];
+            while (x < rans_lower)
+            {
+                if (in == in_end) {return false;}
+                x = (x << 8) | *in++;
+            }
+        }
+        return true;
+    }
+
+    // Mesh accessors of encode_mesh : input arrays or the engine mesh
+    template <class Index>
+    struct ArrayMesh
+    {
+        const double *verts;
+        const Index *faces;
+        double position(size_t i, int axis) const {return verts[i * 3 + axis];}
+        unsigned long long corner(size_t i, int j) const {return faces[i * 3 + j];}
+    };
+
+    struct EngineMesh
+    {
+        double position(size_t i, int axis) const {const vec3f &p = vertices[i].p; return axis == 0 ? p.x : axis == 1 ? p.y : p.z;}
+        unsigned long long corner(size_t i, int j) const {return triangles[i].v[j];}
+    };
+
+    //
+    // Index codes : 0 for the next vertex never referenced (high-water
+    // mark), 1 + slot for the recently used vertices (move to front), the
+    // zigzag distance to the high-water mark beyond. Vertex cache ordered
+    // triangles mostly reuse the last few vertices or start a new one.
+    //
+    const int index_cache_size = 16;
+
+    struct IndexCache
+    {
+        unsigned long long next, recent[index_cache_size];
+        int count;
+
+        IndexCache() : next(0), count(0) {}
+
+        int find(unsigned long long v) const
+        {
+            loopi(0, count) if (recent[i] == v) {return i;}
+            return -1;
+        }
+
+        void use(unsigned long long v, int slot)
+        {
+            if (slot < 0)
+            {
+                slot = std::min(count, index_cache_size - 1);
+                count = std::min(count + 1, index_cache_size);
+            }
+            for (int i = slot; i > 0; i--) {recent[i] = recent[i - 1];}
+            recent[0] = v;
+            if (v >= next) {next = v + 1;}
+        }
+
+        unsigned long long encode(unsigned long long v)
+        {
+            int slot = find(v);
+            unsigned long long code;
+            if (v == next) {code = 0;}
+            else if (slot >= 0) {code = 1 + slot;}
+            else {code = index_cache_size + zigzag((long long)(next - v));} // v != next : zigzag > 0
+            use(v, slot);
+            return code;
+        }
+
+        bool decode(unsigned long long code, unsigned long long &v)
+        {
+            if (code == 0) {v = next;}
+            else if (code <= (unsigned long long)index_cache_size)
+            {
+                if ((int)code > count) {return false;}
+                v = recent[code - 1];
+            }
+            else {v = next - (unsigned long long)unzigzag(code - index_cache_size);}
+            use(v, find(v));
+            return true;
+        }
+    };
+
+    // Directed edges of the last edge_window triangles walked, with
+    // their opposite vertex. In cache-optimized order the triangle across
+    // an edge is almost always a recent one : a small window searched
+    // linearly stays in L1, unlike an edge hash of the whole mesh.
+    const int edge_window = 64;
+
+    template <class Mesh>
+    struct EdgeTable
+    {
+        const Mesh &mesh;
+        unsigned long long from[3 * edge_window], to[3 * edge_window], opp[3 * edge_window];
+        int count, head;
+
+        EdgeTable(const Mesh &mesh) : mesh(mesh), count(0), head(0) {}
+
+        void insert(unsigned long long t)
+        {
+            unsigned long long c[3] = {mesh.corner(t, 0), mesh.corner(t, 1), mesh.corner(t, 2)};
+            loopk(0, 3)
+            {
+                from[head] = c[k];
+                to[head] = c[(k + 1) % 3];
+                opp[head] = c[(k + 2) % 3];
+                head = (head + 1) % (3 * edge_window);
+            }
+            count = std::min(count + 3, 3 * edge_window);
+        }
+
+        // vertex opposite to the edge a -> b, most recent triangle first
+        bool opposite(unsigned long long a, unsigned long long b, unsigned long long &o) const
+        {
+            loopi(1, count + 1)
+            {
+                int e = (head - i + 3 * edge_window) % (3 * edge_window);
+                if (from[e] == a && to[e] == b)
+                {
+                    o = opp[e];
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    //
+    // Prediction of vertex c[j], first referenced by this triangle, from
+    // the quantized positions known so far : parallelogram across the
+    // opposite edge when the triangle on the other side was walked, mean
+    // of the known corners otherwise, else the last coded vertex.
+    // Integer arithmetic, the encoder and the decoder agree exactly.
+    //
+    template <class Mesh>
+    void predict_position(const EdgeTable<Mesh> &edges, const unsigned long long c[3], int j, const std::vector<char> &known,
+                          const std::vector<unsigned int> &q, const long long last[3], long long levels, long long pred[3])
+    {
+        unsigned long long a = c[(j + 1) % 3], b = c[(j + 2) % 3], o;
+        if (known[a] && known[b])
+        {
+            bool across = edges.opposite(b, a, o) && known[o];
+            loopk(0, 3)
+            {
+                if (across) {pred[k] = std::min(std::max((long long)q[a * 3 + k] + q[b * 3 + k] - q[o * 3 + k], 0ll), levels);}
+                else {pred[k] = ((long long)q[a * 3 + k] + q[b * 3 + k]) / 2;}
+            }
+        }
+        else if (known[a] || known[b])
+        {
+            unsigned long long v = known[a] ? a : b;
+            loopk(0, 3) {pred[k] = q[v * 3 + k];}
+        }
+        else {loopk(0, 3) {pred[k] = last[k];}}
+    }
+
+    // Quantized position from its prediction and the coded residual,
+    // false on malformed input
+    bool get_residual(const unsigned char *&s, const unsigned char *end, const long long pred[3], long long levels,
+                      unsigned int *q, long long last[3])
+    {
+        long long x[3];
+        loopk(0, 3)
+        {
+            unsigned long long code;
+            if (!get_varint(s, end, code)) {return false;}
+            x[k] = pred[k] + unzigzag(code);
+            if (x[k] < 0 || x[k] > levels) {return false;}
+        }
+        loopk(0, 3)
+        {
+            q[k] = (unsigned int)x[k];
+            last[k] = x[k];
+        }
+        return true;
+    }
+
+    //
+    // Encode a mesh of num_v vertices and num_f triangles, indices must be
+    // in range. bits (1..30) sets the precision : the position error is at
+    // most half the bounding box extent / (2^bits - 1) per axis. Returns
+    // false if bits is out of range.
+    //
+    // Indices come first, the positions follow in the order of their
+    // first reference (unreferenced vertices last) so that the decoder can
+    // predict them from the triangles already decoded.
+    //
+    template <class Mesh>
+    bool encode_mesh(const Mesh &mesh, size_t num_v, size_t num_f, int bits, std::vector<unsigned char> &out)
+    {
+        if (bits < 1 || bits > encoded_max_bits) {return false;}
+        EncodedHeader h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, "FQME", 4);
+        h.version = encoded_version;
+        h.bits = bits;
+        h.num_vertices = num_v;
+        h.num_triangles = num_f;
+
+        long long levels = (1ll << bits) - 1;
+        loopj(0, 3)
+        {
+            double lo = num_v ? mesh.position(0, j) : 0, hi = lo;
+            for (long long i = 1; i < (long long)num_v; i++)
+            {
+                double x = mesh.position(i, j);
+                lo = fmin(lo, x);
+                hi = fmax(hi, x);
+            }
+            h.origin[j] = lo;
+            h.step[j] = (hi - lo) / levels;
+        }
+        out.resize(sizeof(h));
+        memcpy(&out[0], &h, sizeof(h));
+
+        // indices
+        std::vector<unsigned char> stream;
+        stream.reserve(num_f * 3 * 2);
+        IndexCache cache;
+        for (long long i = 0; i < (long long)num_f; i++) loopj(0, 3) {put_varint(stream, cache.encode(mesh.corner(i, j)));}
+        put_stream(out, stream);
+
+        // quantized positions
+        std::vector<unsigned int> q(num_v * 3);
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, num_v))
+        for (long long i = 0; i < (long long)num_v; i++) loopj(0, 3)
+        {
+            double x = h.step[j] > 0 ? (mesh.position(i, j) - h.origin[j]) / h.step[j] : 0;
+            q[i * 3 + j] = (unsigned int)fmin(fmax(x + 0.5, 0.0), double(levels));
+        }
+
+        // prediction residuals
+        stream.clear();
+        stream.reserve(num_v * 3 * 2);
+        EdgeTable<Mesh> edges(mesh);
+        std::vector<char> known(num_v, 0);
+        long long last[3] = {0, 0, 0}, pred[3];
+        for (long long i = 0; i < (long long)num_f; i++)
+        {
+            unsigned long long c[3];
+            loopk(0, 3) {c[k] = mesh.corner(i, k);}
+            loopj(0, 3)
+            {
+                unsigned long long v = c[j];
+                if (known[v]) {continue;}
+                predict_position(edges, c, j, known, q, last, levels, pred);
+                loopk(0, 3)
+                {
+                    put_varint(stream, zigzag((long long)q[v * 3 + k] - pred[k]));
+                    last[k] = q[v * 3 + k];
+                }
+                known[v] = 1;
+            }
+            edges.insert(i);
+        }
+        for (long long i = 0; i < (long long)num_v; i++)
+        {
+            if (known[i]) {continue;}
+            loopk(0, 3)
+            {
+                put_varint(stream, zigzag((long long)q[i * 3 + k] - last[k]));
+                last[k] = q[i * 3 + k];
+            }
+        }
+        put_stream(out, stream);
+        return true;
+    }
+
+    //
+    // Decode a mesh written by encode_mesh into verts (3 per vertex) and
+    // faces (3 per triangle). Returns false on malformed input, another
+    // format version, or more vertices than Index can address.
+    //
+    template <class Index>
+    bool decode_mesh(const unsigned char *data, size_t size, std::vector<double> &verts, std::vector<Index> &faces)
+    {
+        EncodedHeader h;
+        if (size < sizeof(h)) {return false;}
+        memcpy(&h, data, sizeof(h));
+        if (memcmp(h.magic, "FQME", 4) != 0 || h.version != encoded_version) {return false;}
+        if (h.bits < 1 || h.bits > (unsigned int)encoded_max_bits) {return false;}
+        if (h.num_vertices > (unsigned long long)std::numeric_limits<Index>::max()) {return false;}
+        // the streams hold at most one varint per corner or coordinate : the
+        // counts bound their lengths, which must fit size_t
+        const unsigned long long max_count = SIZE_MAX / (3 * varint_max_bytes);
+        if (h.num_triangles > max_count || h.num_vertices > max_count) {return false;}
+
+        const unsigned char *p = data + sizeof(h), *end = data + size;
+        std::vector<unsigned char> stream;
+        if (!get_stream(p, end, h.num_triangles * 3 * varint_max_bytes, stream) ||
+            stream.size() < h.num_triangles * 3) {return false;}
+        const unsigned char *s = stream.empty() ? NULL : &stream[0], *s_end = s + stream.size();
+        faces.resize(h.num_triangles * 3);
+        IndexCache cache;
+        for (unsigned long long i = 0; i < h.num_triangles * 3; i++)
+        {
+            unsigned long long code, v;
+            if (!get_varint(s, s_end, code) || !cache.decode(code, v) || v >= h.num_vertices) {return false;}
+            faces[i] = (Index)v;
+        }
+
+        if (!get_stream(p, end, h.num_vertices * 3 * varint_max_bytes, stream) ||
+            stream.size() < h.num_vertices * 3) {return false;}
+        s = stream.empty() ? NULL : &stream[0];
+        s_end = s + stream.size();
+        size_t num_v = h.num_vertices, num_f = h.num_triangles;
+        long long levels = (1ll << h.bits) - 1;
+        ArrayMesh<Index> mesh = {NULL, faces.empty() ? NULL : &faces[0]};
+        EdgeTable<ArrayMesh<Index> > edges(mesh);
+        std::vector<unsigned int> q(num_v * 3);
+        std::vector<char> known(num_v, 0);
+        long long last[3] = {0, 0, 0}, pred[3];
+        for (long long i = 0; i < (long long)num_f; i++)
+        {
+            unsigned long long c[3];
+            loopk(0, 3) {c[k] = faces[i * 3 + k];}
+            loopj(0, 3)
+            {
+                unsigned long long v = c[j];
+                if (known[v]) {continue;}
+                predict_position(edges, c, j, known, q, last, levels, pred);
+                if (!get_residual(s, s_end, pred, levels, &q[v * 3], last)) {return false;}
+                known[v] = 1;
+            }
+            edges.insert(i);
+        }
+        for (long long i = 0; i < (long long)num_v; i++)
+        {
+            if (known[i]) {continue;}
+            if (!get_residual(s, s_end, last, levels, &q[i * 3], last)) {return false;}
+        }
+
+        verts.resize(num_v * 3);
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, num_v))
+        for (long long i = 0; i < (long long)num_v; i++) loopj(0, 3) {verts[i * 3 + j] = h.origin[j] + q[i * 3 + j] * h.step[j];}
+        return true;
+    }
+}
+
+#endif // ENCODE_H
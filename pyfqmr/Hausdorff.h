@@ -0,0 +1,298 @@
+/////////////////////////////////////////////
+//
+// Surface deviation between two meshes
+//
+// Measures how far a simplified mesh is from its original :
+//  - a BVH over the triangles of the target mesh answers closest point
+//    queries,
+//  - the source surface is sampled (its vertices plus stratified area
+//    samples) and every sample is projected on the target in parallel,
+//  - max / mean / RMS of the distances give the one-sided Hausdorff
+//    distance and the deviation, both directions the symmetric one.
+//
+// Samples and partial sums use a fixed layout, so results do not depend
+// on the number of threads.
+//
+// License : MIT
+// http://opensource.org/licenses/MIT
+
+#ifndef HAUSDORFF_H
+#define HAUSDORFF_H
+
+#include "Simplify.h"
+
+namespace Simplify
+{
+    // Squared distance between p and the triangle abc (Ericson, Real-Time
+    // Collision Detection, 5.1.5)
+    double point_triangle_distance(const vec3f &p, const vec3f &a, const vec3f &b, const vec3f &c)
+    {
+        vec3f ab = b - a, ac = c - a, ap = p - a, q;
+        double d1 = ab.dot(ap), d2 = ac.dot(ap);
+        if (d1 <= 0 && d2 <= 0) {q = a;}
+        else
+        {
+            vec3f bp = p - b;
+            double d3 = ab.dot(bp), d4 = ac.dot(bp);
+            vec3f cp = p - c;
+            double d5 = ab.dot(cp), d6 = ac.dot(cp);
+            double vc = d1 * d4 - d3 * d2, vb = d5 * d2 - d1 * d6, va = d3 * d6 - d5 * d4;
+            if (d3 >= 0 && d4 <= d3) {q = b;}
+            else if (d6 >= 0 && d5 <= d6) {q = c;}
+            else if (vc <= 0 && d1 >= 0 && d3 <= 0) {q = a + ab * (d1 / (d1 - d3));}
+            else if (vb <= 0 && d2 >= 0 && d6 <= 0) {q = a + ac * (d2 / (d2 - d6));}
+            else if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {q = b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));}
+            else
+            {
+                double denom = va + vb + vc;
+                if (denom <= 0) {q = a;} // degenerate triangle
+                else {q = a + ab * (vb / denom) + ac * (vc / denom);}
+            }
+        }
+        vec3f d = p - q;
+        return d.dot(d);
+    }
+
+    struct BVHNode
+    {
+        vec3f bmin, bmax;
+        fqmr_index first; // first triangle (leaf) or right child (inner node)
+        fqmr_index count; // number of triangles, 0 for inner nodes
+    };
+
+    // Bounding volume hierarchy over the triangles of a mesh, median split
+    // along the longest axis
+    struct MeshBVH
+    {
+        const std::vector<vec3f> *pos;
+        const std::vector<fqmr_index> *tris; // 3 indices per triangle
+        std::vector<BVHNode> nodes;
+        std::vector<fqmr_index> order;       // triangles sorted by leaf
+
+        void build(const std::vector<vec3f> &p, const std::vector<fqmr_index> &t)
+        {
+            pos = &p;
+            tris = &t;
+            fqmr_index num_f = t.size() / 3;
+            order.resize(num_f);
+            std::vector<vec3f> centroid(num_f);
+        #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_QUERY, num_f))
+            loopi(0, num_f)
+            {
+                order[i] = i;
+                centroid[i] = (p[t[i * 3]] + p[t[i * 3 + 1]] + p[t[i * 3 + 2]]) / 3;
+            }
+            nodes.clear();
+            nodes.reserve(num_f > 0 ? 2 * num_f : 1);
+            if (num_f) {build_node(0, num_f, centroid);}
+        }
+
+        fqmr_index build_node(fqmr_index first, fqmr_index count, const std::vector<vec3f> &centroid)
+        {
+            fqmr_index id = nodes.size();
+            nodes.push_back(BVHNode());
+            vec3f bmin(DBL_MAX, DBL_MAX, DBL_MAX), bmax(-DBL_MAX, -DBL_MAX, -DBL_MAX);
+            vec3f cmin = bmin, cmax = bmax;
+            loopi(first, first + count)
+            {
+                fqmr_index t = order[i];
+                loopj(0, 3) {grow(bmin, bmax, (*pos)[(*tris)[t * 3 + j]]);}
+                grow(cmin, cmax, centroid[t]);
+            }
+            nodes[id].bmin = bmin;
+            nodes[id].bmax = bmax;
+
+            if (count <= 4)
+            {
+                nodes[id].first = first;
+                nodes[id].count = count;
+                return id;
+            }
+
+            vec3f e = cmax - cmin;
+            int axis = (e.x >= e.y && e.x >= e.z) ? 0 : (e.y >= e.z ? 1 : 2);
+            fqmr_index half = count / 2;
+            std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+                             [&centroid, axis](fqmr_index a, fqmr_index b) { return coord(centroid[a], axis) < coord(centroid[b], axis); });
+
+            build_node(first, half, centroid); // left child is id + 1
+            fqmr_index right = build_node(first + half, count - half, centroid);
+            nodes[id].first = right;
+            nodes[id].count = 0;
+            return id;
+        }
+
+        // Squared distance from p to the closest point of the mesh
+        double closest(const vec3f &p) const
+        {
+            double best = DBL_MAX;
+            if (nodes.empty()) {return best;}
+            fqmr_index stack[128];
+            int top = 0;
+            stack[top++] = 0;
+            while (top > 0)
+            {
+                const BVHNode &n = nodes[stack[--top]];
+                if (box_distance(p, n) >= best) {continue;}
+                if (n.count)
+                {
+                    loopi(n.first, n.first + n.count)
+                    {
+                        fqmr_index t = order[i];
+                        double d = point_triangle_distance(p, (*pos)[(*tris)[t * 3]], (*pos)[(*tris)[t * 3 + 1]], (*pos)[(*tris)[t * 3 + 2]]);
+                        if (d < best) {best = d;}
+                    }
+                    continue;
+                }
+                // nearest child last, so that it is visited first
+                fqmr_index left = &n - &nodes[0] + 1, right = n.first;
+                double dl = box_distance(p, nodes[left]), dr = box_distance(p, nodes[right]);
+                if (dl < dr) {std::swap(left, right);}
+                stack[top++] = left;
+                stack[top++] = right;
+            }
+            return best;
+        }
+
+        static double coord(const vec3f &v, int axis) {return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);}
+
+        static void grow(vec3f &bmin, vec3f &bmax, const vec3f &v)
+        {
+            bmin = vec3f(fmin(bmin.x, v.x), fmin(bmin.y, v.y), fmin(bmin.z, v.z));
+            bmax = vec3f(fmax(bmax.x, v.x), fmax(bmax.y, v.y), fmax(bmax.z, v.z));
+        }
+
+        static double box_distance(const vec3f &p, const BVHNode &n)
+        {
+            double dx = fmax(fmax(n.bmin.x - p.x, p.x - n.bmax.x), 0.0);
+            double dy = fmax(fmax(n.bmin.y - p.y, p.y - n.bmax.y), 0.0);
+            double dz = fmax(fmax(n.bmin.z - p.z, p.z - n.bmax.z), 0.0);
+            return dx * dx + dy * dy + dz * dz;
+        }
+    };
+
+    struct DeviationStats
+    {
+        double max;          // one-sided Hausdorff distance
+        double sum;          // sum of the distances
+        double sum_squared;  // sum of the squared distances
+        fqmr_index samples;
+    };
+
+    //
+    // Distances from the surface of mesh a to mesh b.
+    //
+    // samples : number of area samples on a, taken on top of its vertices.
+    //           Sample k lies in the triangle holding the area fraction
+    //           (k + 0.5) / samples, at a R2 sequence barycentric position.
+    //
+    DeviationStats one_sided_deviation(const std::vector<vec3f> &pos_a, const std::vector<fqmr_index> &tris_a,
+                                       const MeshBVH &bvh_b, fqmr_index samples)
+    {
+        fqmr_index num_v = pos_a.size(), num_f = tris_a.size() / 3;
+        if (num_f == 0) {samples = 0;}
+
+        // area CDF of a
+        std::vector<double> cdf(num_f + 1, 0.0);
+        loopi(0, num_f)
+        {
+            vec3f n;
+            n.cross(pos_a[tris_a[i * 3 + 1]] - pos_a[tris_a[i * 3]], pos_a[tris_a[i * 3 + 2]] - pos_a[tris_a[i * 3]]);
+            cdf[i + 1] = cdf[i] + n.length();
+        }
+        if (num_f && cdf[num_f] <= 0) {samples = 0;}
+
+        // fixed chunks, summed in order : independent of the thread count
+        const fqmr_index chunk = 4096;
+        fqmr_index total = num_v + samples, num_chunks = (total + chunk - 1) / chunk;
+        std::vector<DeviationStats> partial(num_chunks);
+        // the cutoff applies to the points, not to the chunks
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(loop_threads(PHASE_QUERY, total))
+        loopi(0, num_chunks)
+        {
+            DeviationStats &s = partial[i];
+            s.max = s.sum = s.sum_squared = 0;
+            s.samples = 0;
+            for (fqmr_index k = i * chunk; k < total && k < (i + 1) * chunk; k++)
+            {
+                vec3f p;
+                if (k < num_v) {p = pos_a[k];}
+                else
+                {
+                    fqmr_index m = k - num_v;
+                    double target = (m + 0.5) / samples * cdf[num_f];
+                    fqmr_index t = std::upper_bound(cdf.begin() + 1, cdf.end(), target) - cdf.begin() - 1;
+                    if (t >= num_f) {t = num_f - 1;}
+                    // R2 low discrepancy sequence, folded into the triangle
+                    double r1 = fmod(0.5 + m * 0.7548776662466927, 1.0);
+                    double r2 = fmod(0.5 + m * 0.5698402909980532, 1.0);
+                    if (r1 + r2 > 1) {r1 = 1 - r1; r2 = 1 - r2;}
+                    const vec3f &a = pos_a[tris_a[t * 3]];
+                    p = a + (pos_a[tris_a[t * 3 + 1]] - a) * r1 + (pos_a[tris_a[t * 3 + 2]] - a) * r2;
+                }
+                double d2 = bvh_b.closest(p), d = sqrt(d2);
+                s.max = fmax(s.max, d);
+                s.sum += d;
+                s.sum_squared += d2;
+                s.samples++;
+            }
+        }
+
+        DeviationStats result;
+        result.max = result.sum = result.sum_squared = 0;
+        result.samples = 0;
+        loopi(0, num_chunks)
+        {
+            result.max = fmax(result.max, partial[i].max);
+            result.sum += partial[i].sum;
+            result.sum_squared += partial[i].sum_squared;
+            result.samples += partial[i].samples;
+        }
+        return result;
+    }
+
+    // Distances from the surface of mesh a to a mesh without faces
+    DeviationStats unreachable_deviation(const std::vector<vec3f> &pos_a, const std::vector<fqmr_index> &tris_a, fqmr_index samples)
+    {
+        DeviationStats result;
+        result.samples = pos_a.size() + (tris_a.empty() ? 0 : samples);
+        result.max = result.sum = result.sum_squared = result.samples ? INFINITY : 0;
+        return result;
+    }
+
+    //
+    // Deviation between meshes a and b. forward is measured from a to b,
+    // backward from b to a (skipped unless symmetric). Both directions are
+    // merged into hausdorff, mean and rms. A mesh without faces is
+    // infinitely far from any point : the distances of the direction
+    // towards it are infinite, unless the other mesh has no vertex either
+    // (0 over no samples).
+    //
+    void mesh_deviation(const std::vector<vec3f> &pos_a, const std::vector<fqmr_index> &tris_a,
+                        const std::vector<vec3f> &pos_b, const std::vector<fqmr_index> &tris_b,
+                        fqmr_index samples, bool symmetric,
+                        DeviationStats &forward, DeviationStats &backward)
+    {
+        MeshBVH bvh;
+        if (tris_b.empty()) {forward = unreachable_deviation(pos_a, tris_a, samples);}
+        else
+        {
+            bvh.build(pos_b, tris_b);
+            forward = one_sided_deviation(pos_a, tris_a, bvh, samples);
+        }
+
+        backward.max = backward.sum = backward.sum_squared = 0;
+        backward.samples = 0;
+        if (symmetric)
+        {
+            if (tris_a.empty()) {backward = unreachable_deviation(pos_b, tris_b, samples);}
+            else
+            {
+                bvh.build(pos_a, tris_a);
+                backward = one_sided_deviation(pos_b, tris_b, bvh, samples);
+            }
+        }
+    }
+};
+
+#endif // HAUSDORFF_H
@@ -0,0 +1,208 @@
+/////////////////////////////////////////////
+//
+// Output ordering for rendering
+//
+// Post-pass on the compacted mesh of Simplify.h :
+//  - triangle order for the post-transform vertex cache (Tipsify,
+//    Sander et al. 2007, "Fast Triangle Reordering for Vertex Locality
+//    and Reduced Overdraw"),
+//  - cluster order to reduce overdraw (same paper),
+//  - vertex order for fetch locality (first use by the triangles).
+//
+// License : MIT
+// http://opensource.org/licenses/MIT
+
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+
+#include "Simplify.h"
+
+namespace Simplify
+{
+    // Tipsify : next fanning vertex among the candidates, or -1
+    fqmr_index tipsify_next(const std::vector<fqmr_index> &candidates, const std::vector<fqmr_index> &cache_time,
+                            const std::vector<fqmr_index> &live, fqmr_index time, int cache_size)
+    {
+        fqmr_index best = -1, best_priority = -1;
+        loopi(0, candidates.size())
+        {
+            fqmr_index v = candidates[i];
+            if (live[v] <= 0) {continue;}
+            // vertices still in cache after emitting their live triangles first,
+            // the oldest one wins
+            fqmr_index priority = 0;
+            if (time - cache_time[v] + 2 * live[v] <= cache_size) {priority = time - cache_time[v];}
+            if (priority > best_priority)
+            {
+                best_priority = priority;
+                best = v;
+            }
+        }
+        return best;
+    }
+
+    //
+    // Reorder triangles for the post-transform vertex cache.
+    //
+    // cache_size : size of the targeted FIFO cache, 16..32 are typical
+    // overdraw   : also sort the clusters found by Tipsify (runs between
+    //              two dead ends) from the outside in, using the
+    //              centroid / normal heuristic of the paper
+    //
+    // Must be called after compact_mesh().
+    //
+    void optimize_vertex_cache(int cache_size = 16, bool overdraw = true)
+    {
+        fqmr_index num_v = vertices.size(), num_f = triangles.size();
+        if (num_f == 0) {return;}
+
+        // vertex -> triangle adjacency
+        std::vector<fqmr_index> live(num_v, 0), adj_start(num_v + 1, 0), adj(num_f * 3);
+        loopi(0, num_f) loopj(0, 3) {live[triangles[i].v[j]]++;}
+        loopi(0, num_v) {adj_start[i + 1] = adj_start[i] + live[i];}
+        std::vector<fqmr_index> fill(adj_start.begin(), adj_start.end() - 1);
+        loopi(0, num_f) loopj(0, 3) {adj[fill[triangles[i].v[j]]++] = i;}
+
+        std::vector<fqmr_index> cache_time(num_v, 0), dead_end, candidates, order;
+        std::vector<fqmr_index> cluster_start;
+        std::vector<char> emitted(num_f, 0);
+        order.reserve(num_f);
+
+        fqmr_index fan = 0, time = cache_size + 1, cursor = 0;
+        cluster_start.push_back(0);
+        while (fan >= 0)
+        {
+            candidates.clear();
+            for (fqmr_index k = adj_start[fan]; k < adj_start[fan + 1]; k++)
+            {
+                fqmr_index t = adj[k];
+                if (emitted[t]) {continue;}
+                emitted[t] = 1;
+                order.push_back(t);
+                loopj(0, 3)
+                {
+                    fqmr_index v = triangles[t].v[j];
+                    dead_end.push_back(v);
+                    candidates.push_back(v);
+                    live[v]--;
+                    if (time - cache_time[v] > cache_size) {cache_time[v] = time++;}
+                }
+            }
+
+            fan = tipsify_next(candidates, cache_time, live, time, cache_size);
+            if (fan >= 0) {continue;}
+
+            // dead end : most recent vertex with live triangles, else the next
+            // one in input order. This starts a new cluster.
+            while (!dead_end.empty() && fan < 0)
+            {
+                fqmr_index d = dead_end.back();
+                dead_end.pop_back();
+                if (live[d] > 0) {fan = d;}
+            }
+            while (fan < 0 && cursor < num_v)
+            {
+                if (live[cursor] > 0) {fan = cursor;}
+                cursor++;
+            }
+            if (fan >= 0 && (fqmr_index)order.size() != cluster_start.back()) {cluster_start.push_back(order.size());}
+        }
+        cluster_start.push_back(order.size());
+
+        fqmr_index num_c = cluster_start.size() - 1;
+        std::vector<fqmr_index> cluster_order(num_c);
+        loopi(0, num_c) {cluster_order[i] = i;}
+
+        if (overdraw && num_c > 1)
+        {
+            // mesh centroid, area weighted
+            vec3f center(0, 0, 0);
+            double area = 0;
+            loopi(0, num_f)
+            {
+                const Triangle &t = triangles[i];
+                vec3f p0 = vertices[t.v[0]].p, p1 = vertices[t.v[1]].p, p2 = vertices[t.v[2]].p;
+                vec3f n;
+                n.cross(p1 - p0, p2 - p0);
+                double a = n.length();
+                center = center + (p0 + p1 + p2) * (a / 3);
+                area += a;
+            }
+            if (area > 0) {center = center / area;}
+
+            // clusters facing away from the center and far from it are drawn
+            // first, they are likely to occlude the others
+            std::vector<double> key(num_c);
+        #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_PREPASS, num_f))
+            loopi(0, num_c)
+            {
+                vec3f c(0, 0, 0), n(0, 0, 0);
+                double a = 0;
+                for (fqmr_index k = cluster_start[i]; k < cluster_start[i + 1]; k++)
+                {
+                    const Triangle &t = triangles[order[k]];
+                    vec3f p0 = vertices[t.v[0]].p, p1 = vertices[t.v[1]].p, p2 = vertices[t.v[2]].p;
+                    vec3f tn;
+                    tn.cross(p1 - p0, p2 - p0);
+                    double ta = tn.length();
+                    c = c + (p0 + p1 + p2) * (ta / 3);
+                    n = n + tn;
+                    a += ta;
+                }
+                if (a > 0) {c = c / a;}
+                double len = n.length();
+                if (len > 0) {n = n / len;}
+                key[i] = (c - center).dot(n);
+            }
+            std::stable_sort(cluster_order.begin(), cluster_order.end(),
+                             [&key](fqmr_index a, fqmr_index b) { return key[a] > key[b]; });
+        }
+
+        TriangleArray &sorted_triangles = triangle_scratch;
+        resize_array(sorted_triangles, num_f);
+        fqmr_index dst = 0;
+        loopi(0, num_c)
+        {
+            fqmr_index c = cluster_order[i];
+            for (fqmr_index k = cluster_start[c]; k < cluster_start[c + 1]; k++) {sorted_triangles[dst++] = triangles[order[k]];}
+        }
+        triangles.swap(sorted_triangles);
+    }
+
+    // Renumber vertices in the order of their first use by the triangles.
+    // Must be called after compact_mesh().
+    void optimize_vertex_fetch()
+    {
+        fqmr_index num_v = vertices.size(), num_f = triangles.size();
+
+        std::vector<fqmr_index> remap(num_v, -1), order;
+        order.reserve(num_v);
+        loopi(0, num_f) loopj(0, 3)
+        {
+            fqmr_index &v = triangles[i].v[j];
+            if (remap[v] < 0)
+            {
+                remap[v] = order.size();
+                order.push_back(v);
+            }
+            v = remap[v];
+        }
+        // unreferenced vertices keep their relative order at the end
+        loopi(0, num_v)
+        {
+            if (remap[i] < 0)
+            {
+                remap[i] = order.size();
+                order.push_back(i);
+            }
+        }
+
+        VertexArray &sorted_vertices = vertex_scratch;
+        resize_array(sorted_vertices, num_v);
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, num_v))
+        loopi(0, num_v) {sorted_vertices[i] = vertices[order[i]];}
+        vertices.swap(sorted_vertices);
+    }
+};
+
+#endif // OPTIMIZE_H
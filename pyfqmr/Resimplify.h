@@ -0,0 +1,382 @@
+/////////////////////////////////////////////
+//
+// Localized re-simplification of an edited mesh
+//
+// An edit session simplifies a source mesh once and keeps the source map,
+// the output vertex every source vertex was collapsed into. When faces of
+// the source are edited, only the part of the output they had collapsed
+// into is rebuilt :
+//  - the region is the set of output vertices of the changed faces,
+//  - the source vertices mapped into the region (plus the vertices of the
+//    changed faces) are expanded back, and the source faces around them
+//    form a patch, in which the other source vertices are replaced by
+//    their output vertex and locked, so the patch outline is the one of
+//    the output around the region. Where two of them on different sides
+//    of the patch share an output vertex, the patch would fold over it :
+//    that vertex joins the region,
+//  - the patch is simplified to the error level of the session (max_error,
+//    or the error reached by the first simplification) and stitched back,
+//    the rest of the output is not touched.
+// An edit costs a few linear scans of the source and the output plus the
+// simplification of the patch.
+//
+// Source vertices keep their indices across edits, new ones are appended.
+// Changed faces are indices in the edited faces : new faces, modified
+// faces and the faces around moved vertices. The area of removed faces is
+// rebuilt when a remaining face sharing one of their vertices is listed.
+//
+// License : MIT
+// http://opensource.org/licenses/MIT
+
+#ifndef RESIMPLIFY_H
+#define RESIMPLIFY_H
+
+#include "Simplify.h"
+
+namespace Simplify
+{
+    struct EditSession
+    {
+        bool active;
+        std::vector<fqmr_index> source_map; // output vertex of each source vertex, -1 if none
+        std::vector<vec3f> vertices;        // output mesh
+        std::vector<fqmr_index> faces;      // 3 indices per triangle
+        double error_level;                 // max_error of the patches
+        int update_rate, K, max_iterations;
+        double aggressiveness, alpha;
+        bool preserve_border;
+
+        // scratch, reset after every edit : 0 / -1 everywhere
+        std::vector<char> in_region, in_patch; // by output, source vertex
+        std::vector<fqmr_index> output_local, source_local;
+    };
+
+    struct EditStats
+    {
+        fqmr_index region_vertices; // output vertices rebuilt
+        fqmr_index patch_faces;     // source faces simplified again
+        double error;               // largest quadric error of the patch collapses
+    };
+
+    EditSession edit_session;
+
+    fqmr_index collapse_root(fqmr_index v)
+    {
+        fqmr_index r = v;
+        while (collapse_parent[r] >= 0) {r = collapse_parent[r];}
+        while (collapse_parent[v] >= 0)
+        {
+            fqmr_index next = collapse_parent[v];
+            collapse_parent[v] = r;
+            v = next;
+        }
+        return r;
+    }
+
+    // simplify_mesh with the parameters of the session, recording the
+    // collapses : target[id] is the output vertex of the vertex of that id
+    // (the ids are a permutation of the loaded vertices), -1 when its faces
+    // all collapsed
+    double simplify_tracked(fqmr_index target_count, double max_error, bool verbose, std::vector<fqmr_index> &target)
+    {
+        const EditSession &s = edit_session;
+        fqmr_index num_v = vertices.size();
+        std::vector<fqmr_index> ids(num_v);
+        loopi(0, num_v) {ids[i] = vertices[i].id;}
+        collapse_parent.assign(num_v, -1);
+
+        double error = simplify_mesh(target_count, s.update_rate, s.aggressiveness, s.alpha, s.K, s.max_iterations,
+                                     0, false, s.preserve_border, verbose, max_error);
+
+        std::vector<fqmr_index> output(num_v, -1);
+        loopi(0, vertices.size()) {output[vertices[i].id] = i;}
+        target.assign(num_v, -1);
+        loopi(0, num_v) {target[ids[i]] = output[ids[collapse_root(i)]];}
+        collapse_parent.clear();
+        return error;
+    }
+
+    // Replace the engine mesh by the output of the session
+    void load_session_output()
+    {
+        const EditSession &s = edit_session;
+        fqmr_index num_v = s.vertices.size(), num_f = s.faces.size() / 3;
+        resize_array(vertices, num_v);
+        resize_array(triangles, num_f);
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, num_v))
+        loopi(0, num_v)
+        {
+            vertices[i].p = s.vertices[i];
+            vertices[i].q = SymetricMatrix(0.0);
+            vertices[i].id = i;
+        }
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, num_f))
+        loopi(0, num_f)
+        {
+            Triangle &t = triangles[i];
+            loopj(0, 3) {t.v[j] = s.faces[i * 3 + j];}
+            t.attr = 0;
+            t.material = -1;
+            t.id = i;
+            t.deleted = 0;
+            t.dirty = 0;
+        }
+        quadrics_preset = false;
+        mesh_prepared = false;
+    }
+
+    //
+    // Start an edit session : simplify the current mesh (the source, its
+    // vertex ids being the source indices) like simplify_mesh and keep the
+    // source map. The engine mesh is then the output.
+    //
+    double begin_edit_session(fqmr_index target_count, int update_rate = 5, double agressiveness = 7, double alpha = 1e-9,
+                              int K = 3, int max_iterations = 100, bool preserve_border = false, bool verbose = false,
+                              double max_error = -1)
+    {
+        EditSession &s = edit_session;
+        s.active = false;
+        s.update_rate = update_rate;
+        s.aggressiveness = agressiveness;
+        s.alpha = alpha;
+        s.K = K;
+        s.max_iterations = max_iterations;
+        s.preserve_border = preserve_border;
+
+        fqmr_index num_source = vertices.size();
+        double error = simplify_tracked(target_count, max_error, verbose, s.source_map);
+        s.error_level = max_error >= 0 ? max_error : error;
+
+        s.vertices.resize(vertices.size());
+        loopi(0, vertices.size()) {s.vertices[i] = vertices[i].p;}
+        s.faces.resize(triangles.size() * 3);
+        loopi(0, triangles.size()) loopj(0, 3) {s.faces[i * 3 + j] = triangles[i].v[j];}
+
+        s.in_region.assign(s.vertices.size(), 0);
+        s.output_local.assign(s.vertices.size(), -1);
+        s.in_patch.assign(num_source, 0);
+        s.source_local.assign(num_source, -1);
+        s.active = true;
+        load_session_output();
+        return error;
+    }
+
+    //
+    // Re-simplify the session output after an edit of the source (verts :
+    // 3 per vertex, faces : 3 indices per triangle, changed : indices in
+    // faces, see the top of the file). The engine mesh is then the new
+    // output. Returns false, leaving the session as it was, without a
+    // session, if vertices were removed or on out of range indices.
+    //
+    template <class Index>
+    bool resimplify(const double *verts, long long num_v, const Index *faces, long long num_f,
+                    const Index *changed, long long num_changed, EditStats &stats)
+    {
+        EditSession &s = edit_session;
+        if (!s.active || num_v < (long long)s.source_map.size()) {return false;}
+        bool valid = true;
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, num_f)) reduction(&&:valid)
+        for (long long i = 0; i < num_f * 3; i++)
+        {
+            if (faces[i] < 0 || faces[i] >= num_v) {valid = false;}
+        }
+        for (long long i = 0; i < num_changed; i++)
+        {
+            if (changed[i] < 0 || changed[i] >= num_f) {valid = false;}
+        }
+        if (!valid) {return false;}
+
+        fqmr_index num_out = s.vertices.size();
+        s.source_map.resize(num_v, -1);
+        s.in_patch.resize(num_v, 0);
+        s.source_local.resize(num_v, -1);
+
+        // region : output vertices of the changed faces
+        std::vector<fqmr_index> region;
+        for (long long i = 0; i < num_changed; i++) loopj(0, 3)
+        {
+            fqmr_index v = faces[changed[i] * 3 + j], o = s.source_map[v];
+            s.in_patch[v] = 1;
+            if (o >= 0 && !s.in_region[o])
+            {
+                s.in_region[o] = 1;
+                region.push_back(o);
+            }
+        }
+
+        // The patch folds where source vertices next to the expanded ones,
+        // on different sides, collapsed into the same output vertex : it
+        // then has an edge twice in the same direction (two faces over the
+        // same corners, or more than two faces on the edge), which the
+        // collapses inside the patch cannot undo and the stitch would keep.
+        // The locked vertices of such edges join the region and the patch
+        // is gathered again.
+        std::vector<fqmr_index> local_source, local_output, patch;
+        fqmr_index patch_faces = 0;
+        const long long chunk = 1 << 16;
+        long long num_chunks = (num_f + chunk - 1) / chunk;
+        std::vector<std::vector<fqmr_index> > chunk_faces(num_chunks);
+        while (true)
+        {
+            // expanded back : the source vertices collapsed into the region
+        #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, num_v))
+            for (long long i = 0; i < num_v; i++)
+            {
+                fqmr_index o = s.source_map[i];
+                if (o >= 0 && s.in_region[o]) {s.in_patch[i] = 1;}
+            }
+
+            // patch : the source faces around them, gathered by fixed chunks
+            // in chunk order
+        #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, num_f))
+            for (long long c = 0; c < num_chunks; c++)
+            {
+                chunk_faces[c].clear();
+                for (long long i = c * chunk; i < std::min(num_f, (c + 1) * chunk); i++)
+                {
+                    if (s.in_patch[faces[i * 3]] || s.in_patch[faces[i * 3 + 1]] || s.in_patch[faces[i * 3 + 2]]) {chunk_faces[c].push_back(i);}
+                }
+            }
+
+            // local vertices of the patch : expanded source vertices, and the
+            // output vertices of the other ones, locked. Source vertices mapped
+            // nowhere (their faces had collapsed) are expanded as well.
+            patch_faces = 0;
+            loopi(0, num_chunks) loopj(0, chunk_faces[i].size())
+            {
+                long long f = chunk_faces[i][j];
+                fqmr_index l[3];
+                loopk(0, 3)
+                {
+                    fqmr_index v = faces[f * 3 + k], o = s.source_map[v];
+                    fqmr_index &local = s.in_patch[v] || o < 0 ? s.source_local[v] : s.output_local[o];
+                    if (local < 0)
+                    {
+                        local = local_source.size();
+                        s.in_patch[v] = s.in_patch[v] || o < 0;
+                        local_source.push_back(s.in_patch[v] ? v : -1);
+                        local_output.push_back(s.in_patch[v] ? -1 : o);
+                    }
+                    l[k] = local;
+                }
+                patch_faces++;
+                if (l[0] == l[1] || l[1] == l[2] || l[2] == l[0]) {continue;}
+                patch.insert(patch.end(), l, l + 3);
+            }
+
+            // folds
+            std::vector<std::pair<fqmr_index, fqmr_index> > edges(patch.size());
+            loopi(0, patch.size()) {edges[i] = std::make_pair(patch[i], patch[i - i % 3 + (i + 1) % 3]);}
+            std::sort(edges.begin(), edges.end());
+            size_t grown = region.size();
+            for (size_t i = 1; i < edges.size(); i++)
+            {
+                if (edges[i] != edges[i - 1]) {continue;}
+                fqmr_index ends[2] = {edges[i].first, edges[i].second};
+                loopj(0, 2)
+                {
+                    fqmr_index o = local_output[ends[j]];
+                    if (o >= 0 && !s.in_region[o])
+                    {
+                        s.in_region[o] = 1;
+                        region.push_back(o);
+                    }
+                }
+            }
+            if (region.size() == grown) {break;}
+
+            loopi(0, local_source.size())
+            {
+                if (local_source[i] >= 0) {s.source_local[local_source[i]] = -1;}
+                else {s.output_local[local_output[i]] = -1;}
+            }
+            local_source.clear();
+            local_output.clear();
+            patch.clear();
+        }
+        std::vector<std::vector<fqmr_index> >().swap(chunk_faces);
+
+        // load and simplify the patch with its outline locked
+        fqmr_index num_local = local_source.size();
+        resize_array(vertices, num_local);
+        vertex_locked.assign(num_local, 0);
+        loopi(0, num_local)
+        {
+            fqmr_index v = local_source[i];
+            vertices[i].p = v >= 0 ? vec3f(verts[v * 3], verts[v * 3 + 1], verts[v * 3 + 2]) : s.vertices[local_output[i]];
+            vertices[i].id = i;
+            vertex_locked[i] = v < 0;
+        }
+        resize_array(triangles, patch.size() / 3);
+        loopi(0, triangles.size())
+        {
+            Triangle &t = triangles[i];
+            loopj(0, 3) {t.v[j] = patch[i * 3 + j];}
+            t.attr = 0;
+            t.material = -1;
+            t.id = i;
+            t.deleted = 0;
+            t.dirty = 0;
+        }
+        quadrics_preset = false;
+        mesh_prepared = false;
+        vertex_weights.clear();
+        std::vector<fqmr_index> target;
+        stats.error = simplify_tracked(0, s.error_level, false, target);
+        stats.region_vertices = region.size();
+        stats.patch_faces = patch_faces;
+
+        // stitch : the output faces off the region, then the patch, whose
+        // locked vertices are output vertices and the others new ones
+        std::vector<fqmr_index> combined(vertices.size());
+        std::vector<vec3f> added;
+        loopi(0, vertices.size())
+        {
+            fqmr_index o = local_output[vertices[i].id];
+            combined[i] = o >= 0 ? o : num_out + added.size();
+            if (o < 0) {added.push_back(vertices[i].p);}
+        }
+        std::vector<fqmr_index> new_faces;
+        new_faces.reserve(s.faces.size() + triangles.size() * 3);
+        for (size_t i = 0; i < s.faces.size(); i += 3)
+        {
+            const fqmr_index *t = &s.faces[i];
+            if (!s.in_region[t[0]] && !s.in_region[t[1]] && !s.in_region[t[2]]) {new_faces.insert(new_faces.end(), t, t + 3);}
+        }
+        loopi(0, triangles.size()) loopj(0, 3) {new_faces.push_back(combined[triangles[i].v[j]]);}
+
+        // drop the output vertices left without faces
+        std::vector<fqmr_index> remap(num_out + added.size(), -1);
+        loopi(0, new_faces.size()) {remap[new_faces[i]] = 0;}
+        std::vector<vec3f> new_vertices;
+        loopi(0, remap.size())
+        {
+            if (remap[i] < 0) {continue;}
+            remap[i] = new_vertices.size();
+            new_vertices.push_back(i < num_out ? s.vertices[i] : added[i - num_out]);
+        }
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, new_faces.size()))
+        loopi(0, new_faces.size()) {new_faces[i] = remap[new_faces[i]];}
+
+        // source map, resetting the scratch of the source vertices.
+        // Expanded vertices without faces had collapsed into the region.
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, num_v))
+        for (long long i = 0; i < num_v; i++)
+        {
+            fqmr_index o = s.source_map[i], l = s.source_local[i];
+            if (s.in_patch[i]) {s.source_map[i] = l >= 0 && target[l] >= 0 ? remap[combined[target[l]]] : -1;}
+            else if (o >= 0) {s.source_map[i] = remap[o];}
+            s.in_patch[i] = 0;
+            s.source_local[i] = -1;
+        }
+        s.in_region.assign(new_vertices.size(), 0);
+        s.output_local.assign(new_vertices.size(), -1);
+
+        s.vertices.swap(new_vertices);
+        s.faces.swap(new_faces);
+        load_session_output();
+        return true;
+    }
+}
+
+#endif // RESIMPLIFY_H
@@ -10,33 +10,40 @@
 // https://github.com/sp4cerat/Fast-Quadric-Mesh-S;
 // 5/2016: Chris Rorden created minimal version for OSX/Linux/Windows compile
 
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <float.h> //FLT_EPSILON, DBL_EPSILON
+#include <limits.h> //LLONG_MAX
 #include <math.h>
 
 #include <iostream>
 #include <map>
-#include <unordered_set>
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <new>
+#include <utility>
 #include "omp.h"
 
-#define loopi(start_l, end_l) for (int i = start_l; i < end_l; ++i)
-#define loopi(start_l, end_l) for (int i = start_l; i < end_l; ++i)
-#define loopj(start_l, end_l) for (int j = start_l; j < end_l; ++j)
-#define loopk(start_l, end_l) for (int k = start_l; k < end_l; ++k)
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
-struct PairHash {
-    template <typename T1, typename T2>
-    std::size_t operator()(const std::pair<T1, T2>& p) const {
-        auto hash1 = std::hash<T1>{}(p.first);
-        auto hash2 = std::hash<T2>{}(p.second);
-        return hash1 ^ (hash2 << 1);
-    }
-};
+// Index of vertices, triangles and references. Define FQMR_INDEX64 to
+// build the engine for meshes with more than 2^31 corners.
+#ifdef FQMR_INDEX64
+typedef long long fqmr_index;
+#else
+typedef int fqmr_index;
+#endif
+
+#define loopi(start_l, end_l) for (fqmr_index i = start_l; i < (fqmr_index)(end_l); ++i)
+#define loopj(start_l, end_l) for (fqmr_index j = start_l; j < (fqmr_index)(end_l); ++j)
+#define loopk(start_l, end_l) for (fqmr_index k = start_l; k < (fqmr_index)(end_l); ++k)
 
 struct vector3 {double x, y, z;};
 
@@ -45,6 +52,7 @@ struct vec3f
     double x, y, z;
 
     inline vec3f(void) {}
+    vec3f(const vec3f &) = default; // operator= is user-declared
 
     // inline vec3f operator =( vector3 a )
     // { vec3f b ; b.x = a.x; b.y = a.y; b.z = a.z; return b;}
@@ -231,7 +239,7 @@ struct vec3f
         return (double)sqrt(x * x + y * y + z * z);
     }
 
-    inline vec3f normalize(double desired_length = 1)
+    inline vec3f normalize(double /*desired_length*/ = 1)
     {
         double square = sqrt(x * x + y * y + z * z);
         /*
@@ -364,6 +372,12 @@ public:
                               m[9] + n[9]);
     }
 
+    SymetricMatrix &operator*=(double s)
+    {
+        loopi(0, 10) m[i] *= s;
+        return *this;
+    }
+
     SymetricMatrix &operator+=(const SymetricMatrix &n)
     {
         m[0] += n[0];
@@ -385,6 +399,171 @@ public:
 
 namespace Simplify
 {
+    // Version of the output, bumped by every change that alters the result
+    // of a simplification or its format : the result cache of pyfqmr keys
+    // its entries on it, so results of an older engine are not reused
+    const int engine_version = 2;
+
+    //
+    // Threads
+    //
+    // The output is bitwise identical whatever the number of threads :
+    // parallel loops only write the elements of their own iteration (a
+    // loop on a single thread, see loop_threads, runs the same code),
+    // reductions combine fixed chunks in chunk order (radix_sort,
+    // mesh_deviation) and the collapses are serial. New parallel code has to keep to this;
+    // tests/test_determinism.* compare outputs across thread counts.
+    //
+    // num_threads : threads of the engine calls, 0 for the OpenMP default
+    // (OMP_NUM_THREADS or the number of cores). Entry points apply it with
+    // use_threads(), omp_set_num_threads only affects the calling thread.
+    //
+    int num_threads = 0;
+    int default_threads = omp_get_max_threads();
+
+    void use_threads()
+    {
+        static thread_local bool overridden = false;
+        if (num_threads > 0)
+        {
+            omp_set_num_threads(num_threads);
+            overridden = true;
+        }
+        else if (overridden)
+        {
+            omp_set_num_threads(default_threads);
+            overridden = false;
+        }
+    }
+
+    //
+    // Execution policy
+    //
+    // Every parallel loop belongs to a phase and only forks when its number
+    // of iterations exceeds the serial cutoff of that phase, below which
+    // starting the threads costs more than the loop. The grain is the
+    // minimum number of iterations per thread : loops just above the cutoff
+    // run on fewer threads than use_threads() allows. Neither changes the
+    // output. calibrate_policy() measures the cutoffs of this machine.
+    //
+    enum Phase
+    {
+        PHASE_IO,      // input and output copies, reorders
+        PHASE_UPDATE,  // flags and reference lists of the passes
+        PHASE_INIT,    // borders, normals, quadrics and edge errors
+        PHASE_PREPASS, // clustering, pair contraction, Morton keys, clusters
+        PHASE_SORT,    // radix sort
+        PHASE_QUERY,   // vertex errors and normals, deviation
+        NUM_PHASES
+    };
+    const char *phase_names[NUM_PHASES] = {"io", "update", "init", "prepass", "sort", "query"};
+
+    struct ExecutionPolicy
+    {
+        long long grain;
+        long long cutoff[NUM_PHASES];
+    };
+    const long long default_cutoff = 20480;
+    ExecutionPolicy policy = {1, {default_cutoff, default_cutoff, default_cutoff, default_cutoff, default_cutoff, default_cutoff}};
+
+    // threads of a loop of n iterations, for the num_threads() clauses
+    int loop_threads(Phase phase, long long n)
+    {
+        if (n <= policy.cutoff[phase]) {return 1;}
+        long long t = n / std::max(policy.grain, 1LL);
+        return (int)std::max(1LL, std::min<long long>(t, omp_get_max_threads()));
+    }
+
+    // back the large mesh arrays with transparent huge pages (Linux)
+    bool huge_pages = false;
+
+    //
+    // Allocator of the mesh arrays
+    //
+    //  - resize() default-initializes the elements instead of zeroing
+    //    them from the master thread, fresh blocks are left untouched
+    //    (first touched by resize_array, or by whoever writes them first),
+    //  - blocks of 2MB and more are aligned for and advised to use
+    //    transparent huge pages when huge_pages is set.
+    //
+    template <class T>
+    struct ArenaAllocator
+    {
+        typedef T value_type;
+
+        ArenaAllocator() {}
+        template <class U> ArenaAllocator(const ArenaAllocator<U> &) {}
+
+        T *allocate(size_t n)
+        {
+            size_t bytes = n * sizeof(T);
+            void *p = NULL;
+        #if !defined(_WIN32) && defined(MADV_HUGEPAGE)
+            const size_t huge = 2 << 20;
+            if (huge_pages && bytes >= huge)
+            {
+                if (posix_memalign(&p, huge, bytes) != 0) {p = NULL;}
+                else {madvise(p, bytes, MADV_HUGEPAGE);}
+            }
+            else
+        #endif
+            {p = malloc(bytes);}
+            if (!p && bytes) {throw std::bad_alloc();}
+            return (T *)p;
+        }
+
+        void deallocate(T *p, size_t) {free(p);}
+
+        template <class U> void construct(U *p) {::new ((void *)p) U;}
+        template <class U, class... Args> void construct(U *p, Args &&... args) {::new ((void *)p) U(std::forward<Args>(args)...);}
+        template <class U> void destroy(U *p) {p->~U();}
+
+        template <class U> struct rebind {typedef ArenaAllocator<U> other;};
+    };
+    template <class T, class U> bool operator==(const ArenaAllocator<T> &, const ArenaAllocator<U> &) {return true;}
+    template <class T, class U> bool operator!=(const ArenaAllocator<T> &, const ArenaAllocator<U> &) {return false;}
+
+    // blocks below this size are first touched by the calling thread alone.
+    // Independent of the phase cutoffs : a calibrated policy may keep the
+    // loops of a phase serial, their pages still belong on every node.
+    size_t first_touch_bytes = 1 << 20;
+
+    //
+    // Resize a mesh array to n elements
+    //
+    // Growing past the capacity allocates an untouched block, then copies
+    // the kept elements and zeroes the new ones with the static schedule
+    // the mesh loops use over the n elements (the size, not the capacity
+    // that push_back growth leaves larger), so that on NUMA machines each
+    // page is first touched, hence placed, by the thread that processes it.
+    //
+    template <class T>
+    void resize_array(std::vector<T, ArenaAllocator<T> > &a, size_t n)
+    {
+        if (n <= a.capacity())
+        {
+            a.resize(n);
+            return;
+        }
+        std::vector<T, ArenaAllocator<T> > b;
+        b.reserve(n);
+        b.resize(n); // default-initialized, not touched yet
+        long long kept = a.size();
+        int threads = 1;
+        if (n * sizeof(T) >= first_touch_bytes)
+        {
+            long long t = n / std::max(policy.grain, 1LL);
+            threads = (int)std::max(1LL, std::min<long long>(t, omp_get_max_threads()));
+        }
+    #pragma omp parallel for schedule(static) num_threads(threads)
+        for (long long i = 0; i < (long long)n; i++)
+        {
+            if (i < kept) {b[i] = a[i];}
+            else {memset((void *)&b[i], 0, sizeof(T));}
+        }
+        a.swap(b);
+    }
+
     // Global Variables & Strctures
     enum Attributes
     {
@@ -395,39 +574,156 @@ namespace Simplify
     };
     struct Triangle
     {
-        int v[3];
+        fqmr_index v[3];
         double err[4];
         int deleted, dirty, attr;
         vec3f n;
+        vec3f p[3]; // optimal position of the collapse of edge j, set with err[j]
         vec3f uvs[3];
         int material;
+        fqmr_index id; // index in the input mesh
     };
     struct Vertex
     {
         vec3f p;
-        int tstart, tcount;
+        fqmr_index tstart, tcount;
         SymetricMatrix q;
-        int border;
+        int border; // 1 on open borders, | 2 when locked (vertex_locked)
+        fqmr_index id; // index in the input mesh
     };
     struct Ref
     {
-        int tid, tvertex;
+        fqmr_index tid;
+        int tvertex;
     };
-    std::vector<Triangle> triangles;
-    std::vector<Vertex> vertices;
-    std::vector<Ref> refs;
+    typedef std::vector<Triangle, ArenaAllocator<Triangle> > TriangleArray;
+    typedef std::vector<Vertex, ArenaAllocator<Vertex> > VertexArray;
+    typedef std::vector<Ref, ArenaAllocator<Ref> > RefArray;
+    //
+    // Engine context
+    //
+    // The mesh arrays and the simplification state, with the passes of the
+    // QEM simplification that run on them. The engine of the module is the
+    // global context `engine`, whose members are aliased below under their
+    // plain names (vertices, triangles, ...) for the other passes and
+    // headers. Separate contexts simplify independent meshes concurrently
+    // (ClusterLOD.h).
+    //
+    struct Engine
+    {
+        TriangleArray triangles;
+        VertexArray vertices;
+        RefArray refs;
+
+        // temporaries of collapse_edge and of the link condition, kept
+        // across calls, released by release_memory()
+        std::vector<int> deleted0, deleted1;
+        struct LinkScratch
+        {
+            std::vector<fqmr_index> v0, v1, e;
+            std::vector<std::pair<fqmr_index, fqmr_index> > e0, e1;
+        } link_scratch;
+
+        // vertices[].q already hold the quadrics (set by a pre-pass),
+        // update_mesh(0) keeps them instead of rebuilding from the faces
+        bool quadrics_preset = false;
+
+        // optional per-vertex lock, applied as border by update_mesh(0) then
+        // cleared : locked vertices are never collapsed
+        std::vector<char> vertex_locked;
+
+        // optional, sized to the vertices : collapse_edge records the vertex
+        // each removed vertex was merged into, -1 for the others (Resimplify.h)
+        std::vector<fqmr_index> collapse_parent;
+
+        // optional per-vertex importance, indexed by input vertex (Vertex::id) :
+        // init_quadrics scales the quadric of each vertex by its weight, and
+        // collapses sum quadrics, so the weight follows the merged vertices.
+        // Weights > 1 keep detail, < 1 let a region go first. Errors (max_error,
+        // collapse_error) are then weighted errors.
+        std::vector<double> vertex_weights;
+
+        // refs, borders, quadrics and edge errors are already initialized
+        // (prepare_mesh() or a loaded snapshot), update_mesh(0) is skipped
+        bool mesh_prepared = false;
+
+        // largest quadric error of the collapses done by the last
+        // simplify_mesh call
+        double collapse_error = 0;
+
+        double simplify_mesh(fqmr_index target_count, int update_rate, double agressiveness, double alpha, int K, int max_iterations,
+                             double threshold_lossless, bool lossless, bool preserve_border, bool verbose, double max_error);
+        int lossless_collapse(double threshold, int max_rounds, bool preserve_border, bool verbose);
+        double vertex_error(SymetricMatrix q, double x, double y, double z);
+        double calculate_error(fqmr_index id_v1, fqmr_index id_v2, vec3f &p_result);
+        bool linked(fqmr_index i0, fqmr_index i1);
+        bool flipped(vec3f p, fqmr_index i0, fqmr_index i1, Vertex &v0, Vertex &v1, std::vector<int> &deleted);
+        void update_uvs(fqmr_index i0, const Vertex &v, const vec3f &p, std::vector<int> &deleted);
+        void update_triangles(fqmr_index i0, Vertex &v, std::vector<int> &deleted, fqmr_index &deleted_triangles, std::vector<fqmr_index> *worklist = NULL);
+        bool collapse_edge(fqmr_index i0, fqmr_index i1, vec3f p, double error, int attr, bool preserve_border, std::vector<int> &deleted0, std::vector<int> &deleted1, fqmr_index &deleted_triangles, std::vector<fqmr_index> *worklist = NULL);
+        void update_mesh(int iteration);
+        void prepare_mesh();
+        void build_refs();
+        void compute_normals();
+        void init_quadrics();
+        void compact_mesh();
+        void vertex_errors(std::vector<double> &errors);
+    };
+
+    Engine engine;
+    TriangleArray &triangles = engine.triangles;
+    VertexArray &vertices = engine.vertices;
+    RefArray &refs = engine.refs;
+    std::vector<int> &deleted0 = engine.deleted0, &deleted1 = engine.deleted1;
+    Engine::LinkScratch &link_scratch = engine.link_scratch;
+    bool &quadrics_preset = engine.quadrics_preset;
+    std::vector<char> &vertex_locked = engine.vertex_locked;
+    std::vector<fqmr_index> &collapse_parent = engine.collapse_parent;
+    std::vector<double> &vertex_weights = engine.vertex_weights;
+    bool &mesh_prepared = engine.mesh_prepared;
+    double &collapse_error = engine.collapse_error;
+
+    // Scratch memory kept across calls, released by release_memory() :
+    // targets of the reordering passes (swapped with the mesh arrays)
+    TriangleArray triangle_scratch;
+    VertexArray vertex_scratch;
     std::string mtllib;                 //
     std::vector<std::string> materials; //
 
+    // Passes of the engine context on the global one
+    double simplify_mesh(fqmr_index target_count, int update_rate = 5, double agressiveness = 7, double alpha = 1e-9, int K = 3, int max_iterations = 100,
+                         double threshold_lossless = 0.0001, bool lossless = false, bool preserve_border = false, bool verbose = false, double max_error = -1)
+    {
+        return engine.simplify_mesh(target_count, update_rate, agressiveness, alpha, K, max_iterations, threshold_lossless, lossless, preserve_border, verbose, max_error);
+    }
+    int lossless_collapse(double threshold, int max_rounds, bool preserve_border, bool verbose) {return engine.lossless_collapse(threshold, max_rounds, preserve_border, verbose);}
+    double vertex_error(SymetricMatrix q, double x, double y, double z) {return engine.vertex_error(q, x, y, z);}
+    double calculate_error(fqmr_index id_v1, fqmr_index id_v2, vec3f &p_result) {return engine.calculate_error(id_v1, id_v2, p_result);}
+    bool collapse_edge(fqmr_index i0, fqmr_index i1, vec3f p, double error, int attr, bool preserve_border, std::vector<int> &deleted0, std::vector<int> &deleted1, fqmr_index &deleted_triangles, std::vector<fqmr_index> *worklist = NULL)
+    {
+        return engine.collapse_edge(i0, i1, p, error, attr, preserve_border, deleted0, deleted1, deleted_triangles, worklist);
+    }
+    void update_mesh(int iteration) {engine.update_mesh(iteration);}
+    void prepare_mesh() {engine.prepare_mesh();}
+    void build_refs() {engine.build_refs();}
+    void compute_normals() {engine.compute_normals();}
+    void init_quadrics() {engine.init_quadrics();}
+    void compact_mesh() {engine.compact_mesh();}
+    void vertex_errors(std::vector<double> &errors) {engine.vertex_errors(errors);}
+
     // Helper functions
-    double vertex_error(SymetricMatrix q, double x, double y, double z);
-    double calculate_error(int id_v1, int id_v2, vec3f &p_result);
-    bool linked(int i0, int i1);
-    bool flipped(vec3f p, int i0, int i1, Vertex &v0, Vertex &v1, std::vector<int> &deleted);
-    void update_uvs(int i0, const Vertex &v, const vec3f &p, std::vector<int> &deleted);
-    void update_triangles(int i0, Vertex &v, std::vector<int> &deleted, int &deleted_triangles);
-    void update_mesh(int iteration);
-    void compact_mesh();
+    void release_memory();
+    void vertex_normals(std::vector<vec3f> &normals, bool angle_weighted);
+    void bounding_box(vec3f &bmin, vec3f &bmax);
+    void prefix_sum(const std::vector<char> &flags, std::vector<fqmr_index> &offsets);
+    void cluster_vertices(int grid_size);
+    void contract_pairs(double distance, fqmr_index target_count);
+    void remove_degenerate_triangles();
+    void compact_triangles(const std::vector<char> &keep);
+    void radix_sort(std::vector<unsigned long long> &keys, std::vector<fqmr_index> &values);
+    unsigned long long morton_code(unsigned long long x, unsigned long long y, unsigned long long z);
+    void reorder_spatial();
+    void restore_order();
 
     //
     // Main simplification function
@@ -436,37 +732,50 @@ namespace Simplify
     // agressiveness : sharpness to increase the threshold.
     //                 5..8 are good numbers
     //                 more iterations yield higher quality
+    // max_error     : if >= 0, the threshold never exceeds this quadric
+    //                 error and the simplification stops once no edge
+    //                 below it can be collapsed
+    //
+    // Returns the largest quadric error of the collapses (collapse_error).
     //
-    void simplify_mesh(
-        int target_count, 
-        int update_rate = 5, 
-        double agressiveness = 7,
-        double alpha = 1e-9,
-        int K = 3, 
-        int max_iterations = 100, 
-        double threshold_lossless = 0.0001, 
-        bool lossless = false, 
-        bool preserve_border = false, 
-        bool verbose = false
+    double Engine::simplify_mesh(
+        fqmr_index target_count, 
+        int update_rate, 
+        double agressiveness,
+        double alpha,
+        int K, 
+        int max_iterations, 
+        double threshold_lossless, 
+        bool lossless, 
+        bool preserve_border, 
+        bool verbose,
+        double max_error
     ) {
+        // lossless : collapse everything below threshold_lossless, no target
+        if (lossless)
+        {
+            lossless_collapse(threshold_lossless, max_iterations, preserve_border, verbose);
+            return collapse_error;
+        }
+
         // init
-    #pragma omp parallel for schedule(static) if(triangles.size() > 20480)
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_UPDATE, triangles.size()))
         loopi(0, triangles.size()) {triangles[i].deleted = 0;}
 
         // main iteration loop
-        int deleted_triangles = 0;
-        std::vector<int> deleted0, deleted1;
-        int triangle_count = triangles.size();
+        fqmr_index deleted_triangles = 0;
+        fqmr_index triangle_count = triangles.size();
+        collapse_error = 0;
 
         for (int iteration = 0; iteration < max_iterations; iteration++)
         {
             if (triangle_count - deleted_triangles <= target_count) {break;}
 
             // update mesh once in a while
-            if ((iteration % update_rate == 0) || lossless) {update_mesh(iteration);}
+            if (iteration % update_rate == 0) {update_mesh(iteration);}
 
             // clear dirty flag
-        #pragma omp parallel for schedule(static) if(triangles.size() > 20480)
+        #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_UPDATE, triangles.size()))
             loopi(0, triangles.size()) {triangles[i].dirty = 0;}
 
             //
@@ -476,7 +785,9 @@ namespace Simplify
             // If it does not, try to adjust the 3 parameters
             //
             double threshold = alpha * pow(double(iteration + K), agressiveness);
-            if (lossless) {threshold = threshold_lossless;}
+            bool capped = max_error >= 0 && threshold >= max_error;
+            if (capped) {threshold = max_error;}
+            fqmr_index deleted_before = deleted_triangles;
 
             // target number of triangles reached ? Then break
             if ((iteration % 5 == 0) & verbose)  {
@@ -495,185 +806,197 @@ namespace Simplify
                 {
                     if (t.err[j] < threshold)
                     {
-                        int i0 = t.v[j];
-                        Vertex &v0 = vertices[i0];
-                        int i1 = t.v[(j + 1) % 3];
-                        Vertex &v1 = vertices[i1];
-
-                        // Border check 
-                        // Added preserve_border method from issue 14
-                        if (preserve_border) {if (v0.border || v1.border) {continue;}} // should keep border vertices
-                        else if (v0.border != v1.border) {continue;} // base behaviour
-
-                        // Compute vertex to collapse to
-                        vec3f p;
-                        calculate_error(i0, i1, p);
-                        deleted0.resize(v0.tcount); // normals temporarily
-                        deleted1.resize(v1.tcount); // normals temporarily
-                        
-                        // link condition
-                        if (linked(i0, i1)) {continue;}
-
-                        // don't remove if flipped
-                        if (flipped(p, i0, i1, v0, v1, deleted0)) {continue;}
-                        if (flipped(p, i1, i0, v1, v0, deleted1)) {continue;}
-
-                        if ((t.attr & TEXCOORD) == TEXCOORD)
-                        {
-                            update_uvs(i0, v0, p, deleted0);
-                            update_uvs(i0, v1, p, deleted1);
-                        }
-
-                        // not flipped, so remove edge
-                        v0.p = p;
-                        v0.q = v1.q + v0.q;
-                        int tstart = refs.size();
-
-                        update_triangles(i0, v0, deleted0, deleted_triangles);
-                        update_triangles(i0, v1, deleted1, deleted_triangles);
-
-                        int tcount = refs.size() - tstart;
-
-                        if (tcount <= v0.tcount)
-                        {
-                            if (tcount) {memcpy(&refs[v0.tstart], &refs[tstart], tcount * sizeof(Ref));} // save ram
-                        }
-                        else {v0.tstart = tstart;} // append
-
-                        v0.tcount = tcount;
-                        break;
+                        if (collapse_edge(t.v[j], t.v[(j + 1) % 3], t.p[j], t.err[j], t.attr, preserve_border, deleted0, deleted1, deleted_triangles)) {break;}
                     }
                 }
 
                 // done?
-                if (lossless && (deleted_triangles <= 0)) {break;}
-                else if (!lossless && (triangle_count - deleted_triangles <= target_count)) {break;}
-                if (lossless) {deleted_triangles = 0;}
+                if (triangle_count - deleted_triangles <= target_count) {break;}
+            }
+
+            // error bound reached : edge errors are kept up to date by the
+            // collapses, so a pass at max_error without any collapse means
+            // the cheapest remaining one is above the bound
+            if (capped && deleted_triangles == deleted_before)
+            {
+                if (verbose) {
+                    std::cout << "" << "max error reached at iteration " << iteration << " - triangles " << triangle_count - deleted_triangles << std::endl;
+                }
+                break;
             }
         }
         // clean up mesh
         compact_mesh();
+        return collapse_error;
     } // simplify_mesh()
 
     void simplify_mesh_lossless(void (*log)(char *, int) = NULL, double epsilon = 1e-3, int max_iterations = 9999, bool preserve_border = false)
+    {
+        int rounds = lossless_collapse(epsilon, max_iterations, preserve_border, false);
+        if (log)
+        {
+            char message[128];
+            snprintf(message, 127, "lossless rounds %d\n", rounds);
+            log(message, 128);
+        }
+    } // simplify_mesh_lossless()
+
+    //
+    // Lossless engine
+    //
+    // Collapses every edge whose error is below threshold. The mesh is
+    // initialized once; afterwards only a worklist of candidate triangles is
+    // visited instead of rescanning and compacting the whole mesh.
+    //
+    // A round walks the worklist in triangle order. Triangles touched by a
+    // collapse are flagged dirty and queued for the next round since their
+    // errors changed. Candidates that could not be collapsed (flip / link
+    // condition) are set aside and retried once the worklist runs dry, as
+    // long as the previous sweep removed something.
+    // Returns the number of rounds.
+    //
+    int Engine::lossless_collapse(double threshold, int max_rounds, bool preserve_border, bool verbose)
     {
         // init
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_UPDATE, triangles.size()))
         loopi(0, triangles.size())
         {
             triangles[i].deleted = 0;
+            triangles[i].dirty = 0;
         }
-        // main iteration loop
-        int deleted_triangles = 0;
-        std::vector<int> deleted0, deleted1;
-        int triangle_count = triangles.size();
-        // int iteration = 0;
-        // loop(iteration,0,100)
-        for (int iteration = 0; iteration < max_iterations; iteration++)
+        update_mesh(0);
+
+        fqmr_index deleted_triangles = 0, deleted_sweep = 0;
+        fqmr_index triangle_count = triangles.size();
+        std::vector<fqmr_index> work, next, blocked;
+        collapse_error = 0;
+        loopi(0, triangles.size())
         {
-            // update mesh constantly
-            update_mesh(iteration);
-            // clear dirty flag
-            loopi(0, triangles.size()) triangles[i].dirty = 0;
-            //
-            // All triangles with edges below the threshold will be removed
-            //
-            // The following numbers works well for most models.
-            // If it does not, try to adjust the 3 parameters
-            //
-            double threshold = epsilon; // 1.0E-3 EPS;
-            if (log)
+            if (triangles[i].err[3] < threshold) {work.push_back(i);}
+        }
+
+        int round = 0;
+        for (; round < max_rounds; round++)
+        {
+            if (work.empty())
             {
-                char message[128];
-                snprintf(message, 127, "lossless iteration %d\n", iteration);
-                log(message, 128);
+                // worklist drained : retry blocked candidates if anything moved
+                if (blocked.empty() || deleted_triangles == deleted_sweep) {break;}
+                std::sort(blocked.begin(), blocked.end());
+                blocked.erase(std::unique(blocked.begin(), blocked.end()), blocked.end());
+                work.swap(blocked);
+                blocked.clear();
+                deleted_sweep = deleted_triangles;
             }
 
-            // remove vertices & mark deleted triangles
-            loopi(0, triangles.size())
+            if ((round % 5 == 0) & verbose) {
+                std::cout << "" << "lossless round " << round << " - triangles " << triangle_count - deleted_triangles << " worklist " << work.size() << std::endl;
+            }
+
+            next.clear();
+            loopi(0, work.size())
             {
-                Triangle &t = triangles[i];
-                if (t.err[3] > threshold)
-                    continue;
-                if (t.deleted)
-                    continue;
-                if (t.dirty)
-                    continue;
-
-                loopj(0, 3) if (t.err[j] < threshold)
-                {
-                    int i0 = t.v[j];
-                    Vertex &v0 = vertices[i0];
-                    int i1 = t.v[(j + 1) % 3];
-                    Vertex &v1 = vertices[i1];
+                Triangle &t = triangles[work[i]];
+                if (t.deleted) {continue;}
+                if (t.dirty) {continue;} // already queued for the next round
+                if (t.err[3] > threshold) {continue;}
 
-                    // Border check //Added preserve_border method from issue 14 for lossless
-                    if (preserve_border)
+                bool collapsed = false;
+                loopj(0, 3)
+                {
+                    if (t.err[j] < threshold)
                     {
-                        if (v0.border || v1.border)
-                            continue; // should keep border vertices
+                        if (collapse_edge(t.v[j], t.v[(j + 1) % 3], t.p[j], t.err[j], t.attr, preserve_border, deleted0, deleted1, deleted_triangles, &next)) 
+                        {
+                            collapsed = true;
+                            break;
+                        }
                     }
-                    else if (v0.border != v1.border)
-                        continue; // base behaviour
+                }
+                if (!collapsed && !t.dirty) {blocked.push_back(work[i]);}
+            }
 
-                    // Compute vertex to collapse to
-                    vec3f p;
-                    calculate_error(i0, i1, p);
+            // dequeue
+            loopi(0, next.size()) {triangles[next[i]].dirty = 0;}
+            work.swap(next);
+        }
+        // clean up mesh
+        compact_mesh();
+        return round;
+    } // lossless_collapse()
 
-                    deleted0.resize(v0.tcount); // normals temporarily
-                    deleted1.resize(v1.tcount); // normals temporarily
+    // Collapse edge i0-i1 into its optimal position p (error : its quadric
+    // error), as cached in Triangle::p / err, if the border, link and flip
+    // conditions allow it. Returns true if the edge was removed.
+    //
+    // The cache is exact : edge errors and positions only depend on the
+    // quadrics, borders and positions of the two ends, which change in
+    // update_mesh(0) (all recomputed) or in a collapse, and a collapse
+    // recomputes every triangle around the merged vertex.
+    bool Engine::collapse_edge(fqmr_index i0, fqmr_index i1, vec3f p, double error, int attr, bool preserve_border, std::vector<int> &deleted0, std::vector<int> &deleted1, fqmr_index &deleted_triangles, std::vector<fqmr_index> *worklist)
+    {
+        Vertex &v0 = vertices[i0];
+        Vertex &v1 = vertices[i1];
 
-                    // don't remove if flipped
-                    if (flipped(p, i0, i1, v0, v1, deleted0))
-                        continue;
-                    if (flipped(p, i1, i0, v1, v0, deleted1))
-                        continue;
+        // Border check 
+        // Added preserve_border method from issue 14
+        if (preserve_border) {if (v0.border || v1.border) {return false;}} // should keep border vertices
+        else if (v0.border != v1.border) {return false;} // base behaviour
+        if ((v0.border | v1.border) & 2) {return false;} // locked
 
-                    if ((t.attr & TEXCOORD) == TEXCOORD)
-                    {
-                        update_uvs(i0, v0, p, deleted0);
-                        update_uvs(i0, v1, p, deleted1);
-                    }
+        deleted0.resize(v0.tcount); // normals temporarily
+        deleted1.resize(v1.tcount); // normals temporarily
+        
+        // don't remove if flipped
+        if (flipped(p, i0, i1, v0, v1, deleted0)) {return false;}
+        if (flipped(p, i1, i0, v1, v0, deleted1)) {return false;}
 
-                    // not flipped, so remove edge
-                    v0.p = p;
-                    v0.q = v1.q + v0.q;
-                    int tstart = refs.size();
+        // link condition, checked last as it is the most expensive test
+        if (linked(i0, i1)) {return false;}
 
-                    update_triangles(i0, v0, deleted0, deleted_triangles);
-                    update_triangles(i0, v1, deleted1, deleted_triangles);
+        if ((attr & TEXCOORD) == TEXCOORD)
+        {
+            update_uvs(i0, v0, p, deleted0);
+            update_uvs(i0, v1, p, deleted1);
+        }
 
-                    int tcount = refs.size() - tstart;
+        // not flipped, so remove edge
+        v0.p = p;
+        v0.q = v1.q + v0.q;
+        fqmr_index tstart = refs.size();
 
-                    if (tcount <= v0.tcount)
-                    {
-                        // save ram
-                        if (tcount)
-                            memcpy(&refs[v0.tstart], &refs[tstart], tcount * sizeof(Ref));
-                    }
-                    else
-                        // append
-                        v0.tstart = tstart;
+        update_triangles(i0, v0, deleted0, deleted_triangles, worklist);
+        update_triangles(i0, v1, deleted1, deleted_triangles, worklist);
 
-                    v0.tcount = tcount;
-                    break;
-                }
-            }
-            if (deleted_triangles <= 0)
-                break;
-            deleted_triangles = 0;
-        } // for each iteration
-        // clean up mesh
-        compact_mesh();
-    } // simplify_mesh_lossless()
+        fqmr_index tcount = refs.size() - tstart;
+
+        if (tcount <= v0.tcount)
+        {
+            if (tcount) {memcpy(&refs[v0.tstart], &refs[tstart], tcount * sizeof(Ref));} // save ram
+        }
+        else {v0.tstart = tstart;} // append
+
+        v0.tcount = tcount;
+        collapse_error = fmax(collapse_error, error);
+        if (!collapse_parent.empty()) {collapse_parent[i1] = i0;}
+        return true;
+    }
 
     // check if the edge i0-i1 satisfies the link condition
-    bool linked(int i0, int i1)
+    // The links are small : sorted vectors of link_scratch, reused across
+    // calls, instead of hash sets allocated for every candidate edge.
+    bool Engine::linked(fqmr_index i0, fqmr_index i1)
     {
-        typedef std::pair<int, int> edge;
+        typedef std::pair<fqmr_index, fqmr_index> edge;
         Vertex &v0 = vertices[i0];
         Vertex &v1 = vertices[i1];
-        std::unordered_set<int> Lk_v0_v, Lk_v1_v, Lk_e_v;
-        std::unordered_set<edge, PairHash> Lk_v0_e, Lk_v1_e;
+        std::vector<fqmr_index> &Lk_v0_v = link_scratch.v0, &Lk_v1_v = link_scratch.v1, &Lk_e_v = link_scratch.e;
+        std::vector<edge> &Lk_v0_e = link_scratch.e0, &Lk_v1_e = link_scratch.e1;
+        Lk_v0_v.clear();
+        Lk_v1_v.clear();
+        Lk_e_v.clear();
+        Lk_v0_e.clear();
+        Lk_v1_e.clear();
 
         loopk(0, v0.tcount)
         {
@@ -681,15 +1004,15 @@ namespace Simplify
             if (t.deleted) {continue;}
 
             int curr = refs[v0.tstart + k].tvertex;
-            int other_1 = t.v[(curr + 1) % 3];
-            int other_2 = t.v[(curr + 2) % 3];
+            fqmr_index other_1 = t.v[(curr + 1) % 3];
+            fqmr_index other_2 = t.v[(curr + 2) % 3];
 
-            if (other_1 == i1) {Lk_e_v.insert(other_2);}
-            if (other_2 == i1) {Lk_e_v.insert(other_1);} 
+            if (other_1 == i1) {Lk_e_v.push_back(other_2);}
+            if (other_2 == i1) {Lk_e_v.push_back(other_1);} 
 
-            Lk_v0_v.insert(other_1);
-            Lk_v0_v.insert(other_2);
-            Lk_v0_e.insert({other_1, other_2});
+            Lk_v0_v.push_back(other_1);
+            Lk_v0_v.push_back(other_2);
+            Lk_v0_e.push_back(edge(other_1, other_2));
         }
 
         loopk(0, v1.tcount)
@@ -698,40 +1021,50 @@ namespace Simplify
             if (t.deleted) {continue;}
 
             int curr = refs[v1.tstart + k].tvertex;
-            int other_1 = t.v[(curr + 1) % 3];
-            int other_2 = t.v[(curr + 2) % 3];
+            fqmr_index other_1 = t.v[(curr + 1) % 3];
+            fqmr_index other_2 = t.v[(curr + 2) % 3];
 
-            if (other_1 == i0) {Lk_e_v.insert(other_2);}
-            if (other_2 == i0) {Lk_e_v.insert(other_1);}
+            if (other_1 == i0) {Lk_e_v.push_back(other_2);}
+            if (other_2 == i0) {Lk_e_v.push_back(other_1);}
 
-            Lk_v1_v.insert(other_1);
-            Lk_v1_v.insert(other_2);
-            Lk_v1_e.insert({other_1, other_2});
+            Lk_v1_v.push_back(other_1);
+            Lk_v1_v.push_back(other_2);
+            Lk_v1_e.push_back(edge(other_1, other_2));
         }
 
+        std::sort(Lk_v0_v.begin(), Lk_v0_v.end());
+        std::sort(Lk_v1_v.begin(), Lk_v1_v.end());
+        std::sort(Lk_e_v.begin(), Lk_e_v.end());
+        std::sort(Lk_v0_e.begin(), Lk_v0_e.end());
+        std::sort(Lk_v1_e.begin(), Lk_v1_e.end());
+
         // (Lk_v0_v ∩ Lk_v1_v) ⊆　Lk_e_v && (Lk_v0_e ∩ Lk_v1_e) == ∅
-        const auto& smaller_v_set = (Lk_v0_v.size() < Lk_v1_v.size()) ? Lk_v0_v : Lk_v1_v;
-        const auto& larger_v_set = (Lk_v0_v.size() < Lk_v1_v.size()) ? Lk_v1_v : Lk_v0_v;
-        for(const auto& v: smaller_v_set)
+        size_t a = 0, b = 0;
+        while (a < Lk_v0_v.size() && b < Lk_v1_v.size())
         {
-            if (larger_v_set.find(v) != larger_v_set.end()) // v ∈ (Lk_v0_v ∩ Lk_v1_v)
+            if (Lk_v0_v[a] < Lk_v1_v[b]) {a++;}
+            else if (Lk_v1_v[b] < Lk_v0_v[a]) {b++;}
+            else // v ∈ (Lk_v0_v ∩ Lk_v1_v)
             {
-                if (Lk_e_v.find(v) == Lk_e_v.end()) {return true;} // v ∉ Lk_e_v, false
+                if (!std::binary_search(Lk_e_v.begin(), Lk_e_v.end(), Lk_v0_v[a])) {return true;} // v ∉ Lk_e_v, false
+                a++;
+                b++;
             }
         }
 
-        const auto& smaller_e_set = (Lk_v0_e.size() < Lk_v1_e.size()) ? Lk_v0_e : Lk_v1_e;
-        const auto& larger_e_set = (Lk_v0_e.size() < Lk_v1_e.size()) ? Lk_v1_e : Lk_v0_e;
-        for(const auto& e: smaller_e_set)
+        a = b = 0;
+        while (a < Lk_v0_e.size() && b < Lk_v1_e.size())
         {
-            if (larger_e_set.find(e) != larger_e_set.end()) {return true;}// e ∈ (Lk_v0_e ∩ Lk_v1_e)
+            if (Lk_v0_e[a] < Lk_v1_e[b]) {a++;}
+            else if (Lk_v1_e[b] < Lk_v0_e[a]) {b++;}
+            else {return true;} // e ∈ (Lk_v0_e ∩ Lk_v1_e)
         }
 
         return false;
     }
 
     // Check if a triangle flips when this edge is removed
-    bool flipped(vec3f p, int i0, int i1, Vertex &v0, Vertex &v1, std::vector<int> &deleted)
+    bool Engine::flipped(vec3f p, fqmr_index /*i0*/, fqmr_index i1, Vertex &v0, Vertex & /*v1*/, std::vector<int> &deleted)
     {
         loopk(0, v0.tcount)
         {
@@ -739,8 +1072,8 @@ namespace Simplify
             if (t.deleted) {continue;}
 
             int s = refs[v0.tstart + k].tvertex;
-            int id1 = t.v[(s + 1) % 3];
-            int id2 = t.v[(s + 2) % 3];
+            fqmr_index id1 = t.v[(s + 1) % 3];
+            fqmr_index id2 = t.v[(s + 2) % 3];
 
             if (id1 == i1 || id2 == i1) // delete ?
             {
@@ -762,7 +1095,7 @@ namespace Simplify
     }
 
     // update_uvs
-    void update_uvs(int i0, const Vertex &v, const vec3f &p, std::vector<int> &deleted)
+    void Engine::update_uvs(fqmr_index /*i0*/, const Vertex &v, const vec3f &p, std::vector<int> &deleted)
     {
         loopk(0, v.tcount)
         {
@@ -780,9 +1113,9 @@ namespace Simplify
     }
 
     // Update triangle connections and edge error after a edge is collapsed
-    void update_triangles(int i0, Vertex &v, std::vector<int> &deleted, int &deleted_triangles)
+    // Touched triangles are appended to worklist (once) when given
+    void Engine::update_triangles(fqmr_index i0, Vertex &v, std::vector<int> &deleted, fqmr_index &deleted_triangles, std::vector<fqmr_index> *worklist)
     {
-        vec3f p;
         loopk(0, v.tcount)
         {
             Ref &r = refs[v.tstart + k];
@@ -796,23 +1129,30 @@ namespace Simplify
                 continue;
             }
             t.v[r.tvertex] = i0;
+            if (worklist && !t.dirty) {worklist->push_back(r.tid);}
             t.dirty = 1;
-            t.err[0] = calculate_error(t.v[0], t.v[1], p);
-            t.err[1] = calculate_error(t.v[1], t.v[2], p);
-            t.err[2] = calculate_error(t.v[2], t.v[0], p);
+            t.err[0] = calculate_error(t.v[0], t.v[1], t.p[0]);
+            t.err[1] = calculate_error(t.v[1], t.v[2], t.p[1]);
+            t.err[2] = calculate_error(t.v[2], t.v[0], t.p[2]);
             t.err[3] = min(t.err[0], min(t.err[1], t.err[2]));
             refs.push_back(r);
         }
     }
 
     // compact triangles, compute edge error and build reference list
-    void update_mesh(int iteration)
+    void Engine::update_mesh(int iteration)
     {
         size_t num_v = vertices.size(), num_f = triangles.size();
 
+        if (iteration == 0 && mesh_prepared) // init already done
+        {
+            mesh_prepared = false;
+            return;
+        }
+
         if (iteration > 0) // compact triangles
         {
-            int dst = 0;
+            fqmr_index dst = 0;
             loopi(0, num_f) 
             {
                 if (!triangles[i].deleted) {triangles[dst++] = triangles[i];}
@@ -821,8 +1161,106 @@ namespace Simplify
             num_f = dst;
         }
 
+        build_refs();
+
+        // Identify boundary : vertices[].border=0,1
+        if (iteration == 0)
+        {
+        #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_INIT, num_v))
+            loopi(0, num_v) {vertices[i].border = 0;}
+        
+        #pragma omp parallel num_threads(loop_threads(PHASE_INIT, num_v))
+            {
+                // per thread, reused by all its vertices
+                std::vector<int> vcount;
+                std::vector<fqmr_index> vids;
+            #pragma omp for schedule(static)
+                loopi(0, num_v)
+                {
+                    Vertex &v = vertices[i];
+                    vcount.clear();
+                    vids.clear();
+                    loopj(0, v.tcount)
+                    {
+                        fqmr_index k = refs[v.tstart + j].tid;
+                        Triangle &t = triangles[k];
+                        loopk(0, 3)
+                        {
+                            fqmr_index ofs = 0, id = t.v[k];
+                            while (ofs < (fqmr_index)vcount.size())
+                            {
+                                if (vids[ofs] == id) {break;}
+                                ofs++;
+                            }
+                            if (ofs == (fqmr_index)vcount.size())
+                            {
+                                vcount.push_back(1);
+                                vids.push_back(id);
+                            }
+                            else {vcount[ofs]++;}
+                        }
+                    }
+
+                    loopj(0, vcount.size())
+                    {
+                        if (vcount[j] == 1) {vertices[vids[j]].border = 1;}
+                    }
+                }
+            }
+
+            if (vertex_locked.size() == num_v)
+            {
+            #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_INIT, num_v))
+                loopi(0, num_v) {if (vertex_locked[i]) {vertices[i].border |= 2;}}
+            }
+            vertex_locked.clear();
+        }
+
+        //
+        // Init Quadrics by Plane & Edge Errors
+        //
+        // required at the beginning ( iteration == 0 )
+        // recomputing during the simplification is not required,
+        // but mostly improves the result for closed meshes
+        if (iteration == 0)
+        {
+            compute_normals();
+            if (quadrics_preset) {quadrics_preset = false;}
+            else {init_quadrics();}
+
+        #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_INIT, num_f))
+            loopi(0, num_f)
+            {
+                // Calc Edge Error
+                Triangle &t = triangles[i];
+                loopj(0, 3) {t.err[j] = calculate_error(t.v[j], t.v[(j + 1) % 3], t.p[j]);}
+                t.err[3] = min(t.err[0], min(t.err[1], t.err[2]));
+            }
+        }
+    }
+
+    // Run the initialization of update_mesh(0) ahead of time, so that it
+    // can be saved (see Snapshot.h) and reused by several simplifications
+    void Engine::prepare_mesh()
+    {
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_INIT, triangles.size()))
+        loopi(0, triangles.size())
+        {
+            triangles[i].deleted = 0;
+            triangles[i].dirty = 0;
+        }
+        mesh_prepared = false;
+        update_mesh(0);
+        mesh_prepared = true;
+    }
+
+    // Build the vertex -> triangle reference list (tstart, tcount, refs)
+    void Engine::build_refs()
+    {
+        size_t num_v = vertices.size(), num_f = triangles.size();
+
         // Init Reference ID list
-    #pragma omp parallel for schedule(static) if(num_v > 20480)
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_UPDATE, num_v))
         loopi(0, num_v)
         {
             vertices[i].tstart = 0;
@@ -835,7 +1273,7 @@ namespace Simplify
             loopj(0, 3) {vertices[t.v[j]].tcount++;}
         }
 
-        int tstart = 0;
+        fqmr_index tstart = 0;
         loopi(0, num_v)
         {
             Vertex &v = vertices[i];
@@ -845,7 +1283,7 @@ namespace Simplify
         }
 
         // Write References
-        refs.resize(num_f * 3);
+        resize_array(refs, num_f * 3);
         loopi(0, num_f)
         {
             Triangle &t = triangles[i];
@@ -857,102 +1295,549 @@ namespace Simplify
                 v.tcount++;
             }
         }
+    }
 
-        // Identify boundary : vertices[].border=0,1
-        if (iteration == 0)
+    // Face normals from the current vertex positions
+    void Engine::compute_normals()
+    {
+        size_t num_f = triangles.size();
+
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_INIT, num_f))
+        loopi(0, num_f)
         {
-        #pragma omp parallel for schedule(static) if(num_v > 20480)
-            loopi(0, num_v) {vertices[i].border = 0;}
-        
-        #pragma omp parallel for schedule(static) if(num_v > 20480)
-            loopi(0, num_v)
+            Triangle &t = triangles[i];
+            vec3f n, p[3];
+            loopj(0, 3) {p[j] = vertices[t.v[j]].p;}
+            n.cross(p[1] - p[0], p[2] - p[0]);
+            n.normalize();
+            t.n = n;
+        }
+    }
+
+    //
+    // Vertex normals of the current mesh, for the output
+    //
+    // Sum of the normals of the faces around each vertex, weighted by the
+    // face area or by the angle of the face at the vertex, normalized
+    // (zero for vertices without faces). Computed from the positions, so
+    // that the result is fresh after the collapses moved the vertices, by
+    // a gather per vertex over refs in face order : no atomics, the same
+    // result for any number of threads.
+    //
+    void vertex_normals(std::vector<vec3f> &normals, bool angle_weighted)
+    {
+        size_t num_v = vertices.size();
+        build_refs();
+        normals.resize(num_v);
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_QUERY, num_v))
+        loopi(0, num_v)
+        {
+            const Vertex &v = vertices[i];
+            vec3f sum(0, 0, 0);
+            loopj(0, v.tcount)
             {
-                Vertex &v = vertices[i];
-                std::vector<int> vcount, vids;
-                // vcount.clear();
-                // vids.clear();
-                loopj(0, v.tcount)
+                const Ref &r = refs[v.tstart + j];
+                const Triangle &t = triangles[r.tid];
+                const vec3f &p = vertices[t.v[r.tvertex]].p;
+                vec3f e1 = vertices[t.v[(r.tvertex + 1) % 3]].p - p;
+                vec3f e2 = vertices[t.v[(r.tvertex + 2) % 3]].p - p;
+                vec3f n;
+                n.cross(e1, e2); // length : twice the area
+                if (angle_weighted)
                 {
-                    int k = refs[v.tstart + j].tid;
-                    Triangle &t = triangles[k];
-                    loopk(0, 3)
-                    {
-                        int ofs = 0, id = t.v[k];
-                        while (ofs < vcount.size())
-                        {
-                            if (vids[ofs] == id) {break;}
-                            ofs++;
-                        }
-                        if (ofs == vcount.size())
-                        {
-                            vcount.push_back(1);
-                            vids.push_back(id);
-                        }
-                        else {vcount[ofs]++;}
-                    }
+                    double l = n.length();
+                    if (l > 0) {sum = sum + n * (atan2(l, e1.dot(e2)) / l);}
                 }
+                else {sum = sum + n;}
+            }
+            double l = sum.length();
+            normals[i] = l > 0 ? sum / l : sum;
+        }
+    }
 
-                loopj(0, vcount.size())
-                {
-                    if (vcount[j] == 1) {vertices[vids[j]].border = 1;}
-                }
+    // Vertex quadrics as the sum of the planes of the adjacent faces,
+    // requires refs and face normals
+    void Engine::init_quadrics()
+    {
+        size_t num_v = vertices.size();
+
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_INIT, num_v))
+        loopi(0, num_v)
+        {
+            Vertex &v = vertices[i];
+            v.q = SymetricMatrix(0.0);
+            loopj(0, v.tcount)
+            {
+                Triangle &t = triangles[refs[v.tstart + j].tid];
+                Vertex &v0 = vertices[t.v[0]];
+                v.q = v.q + SymetricMatrix(t.n.x, t.n.y, t.n.z, -t.n.dot(v0.p));
             }
+            if (!vertex_weights.empty()) {v.q *= vertex_weights[v.id];}
         }
+    }
 
-        //
-        // Init Quadrics by Plane & Edge Errors
-        //
-        // required at the beginning ( iteration == 0 )
-        // recomputing during the simplification is not required,
-        // but mostly improves the result for closed meshes
-        if (iteration == 0)
+    // Bounding box of the vertices (at least one), by fixed chunks combined
+    // in chunk order
+    void bounding_box(vec3f &bmin, vec3f &bmax)
+    {
+        const fqmr_index chunk = 4096;
+        fqmr_index num_v = vertices.size(), num_chunks = (num_v + chunk - 1) / chunk;
+        std::vector<vec3f> lo(num_chunks), hi(num_chunks);
+        // the cutoff applies to the vertices, not to the chunks
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_PREPASS, num_v))
+        loopi(0, num_chunks)
         {
-        
-        #pragma omp parallel for schedule(static) if(num_v > 20480)
-            loopi(0, num_v) {vertices[i].q = SymetricMatrix(0.0);}
-        
-        #pragma omp parallel for schedule(static) if(num_f > 20480)
-            loopi(0, num_f)
+            fqmr_index end = std::min(num_v, (i + 1) * chunk);
+            vec3f a = vertices[i * chunk].p, b = a;
+            for (fqmr_index k = i * chunk + 1; k < end; k++)
             {
-                Triangle &t = triangles[i];
-                vec3f n, p[3];
-                loopj(0, 3) {p[j] = vertices[t.v[j]].p;}
-                n.cross(p[1] - p[0], p[2] - p[0]);
-                n.normalize();
-                t.n = n;
-                // loopj(0, 3){
-                //     vertices[t.v[j]].q = vertices[t.v[j]].q + SymetricMatrix(n.x, n.y, n.z, -n.dot(p[0]));
-                // }
+                const vec3f &p = vertices[k].p;
+                a = vec3f(fmin(a.x, p.x), fmin(a.y, p.y), fmin(a.z, p.z));
+                b = vec3f(fmax(b.x, p.x), fmax(b.y, p.y), fmax(b.z, p.z));
             }
-        
-        #pragma omp parallel for schedule(static) if(num_v > 20480)
+            lo[i] = a;
+            hi[i] = b;
+        }
+        bmin = lo[0];
+        bmax = hi[0];
+        loopi(1, num_chunks)
+        {
+            bmin = vec3f(fmin(bmin.x, lo[i].x), fmin(bmin.y, lo[i].y), fmin(bmin.z, lo[i].z));
+            bmax = vec3f(fmax(bmax.x, hi[i].x), fmax(bmax.y, hi[i].y), fmax(bmax.z, hi[i].z));
+        }
+    }
+
+    // Exclusive prefix sum of flags : offsets[i] is the number of flags set
+    // before i, offsets[n] their total. Fixed chunks are counted in
+    // parallel, offset in chunk order, then filled in parallel.
+    void prefix_sum(const std::vector<char> &flags, std::vector<fqmr_index> &offsets)
+    {
+        const fqmr_index chunk = 4096;
+        fqmr_index n = flags.size(), num_chunks = (n + chunk - 1) / chunk;
+        std::vector<fqmr_index> base(num_chunks + 1, 0);
+        offsets.resize(n + 1);
+        // the cutoff applies to the flags, not to the chunks
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_PREPASS, n))
+        loopi(0, num_chunks)
+        {
+            fqmr_index end = std::min(n, (i + 1) * chunk), count = 0;
+            for (fqmr_index k = i * chunk; k < end; k++) {count += flags[k] != 0;}
+            base[i + 1] = count;
+        }
+        loopi(0, num_chunks) {base[i + 1] += base[i];}
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_PREPASS, n))
+        loopi(0, num_chunks)
+        {
+            fqmr_index end = std::min(n, (i + 1) * chunk), sum = base[i];
+            for (fqmr_index k = i * chunk; k < end; k++)
+            {
+                offsets[k] = sum;
+                sum += flags[k] != 0;
+            }
+        }
+        offsets[n] = base[num_chunks];
+    }
+
+    //
+    // Vertex clustering pre-pass
+    //
+    // Merges all vertices falling into the same cell of a uniform grid
+    // (grid_size cells along the longest side of the bounding box) into one
+    // vertex carrying the sum of their quadrics, so that the QEM pass run
+    // afterwards still measures errors against the original surface.
+    // The merged vertex is placed at the quadric optimum when it lies in
+    // its cell, at the mean of the cluster otherwise.
+    // Degenerate and duplicated triangles are dropped.
+    //
+    void cluster_vertices(int grid_size)
+    {
+        fqmr_index num_v = vertices.size(), num_f = triangles.size();
+        if (grid_size <= 0 || num_v == 0) {return;}
+        mesh_prepared = false;
+        if (grid_size > (1 << 20)) {grid_size = 1 << 20;} // 3 x 21 bits cell key
+
+        // per-vertex quadrics of the input mesh
+        build_refs();
+        if (!quadrics_preset)
+        {
+            compute_normals();
+            init_quadrics();
+        }
+
+        vec3f bmin, bmax;
+        bounding_box(bmin, bmax);
+        vec3f size = bmax - bmin;
+        double cell = fmax(size.x, fmax(size.y, size.z)) / grid_size;
+        if (cell <= 0) {return;}
+
+        // cell key of each vertex, sorted so that clusters are contiguous
+        // (stable : vertices of a cell stay in index order)
+        std::vector<unsigned long long> keys(num_v);
+        std::vector<fqmr_index> order(num_v);
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_PREPASS, num_v))
+        loopi(0, num_v)
+        {
+            vec3f c = (vertices[i].p - bmin) / cell;
+            unsigned long long x = std::min((long long)c.x, (long long)grid_size - 1);
+            unsigned long long y = std::min((long long)c.y, (long long)grid_size - 1);
+            unsigned long long z = std::min((long long)c.z, (long long)grid_size - 1);
+            keys[i] = (x << 42) | (y << 21) | z;
+            order[i] = i;
+        }
+        radix_sort(keys, order);
+
+        // clusters : runs of equal keys
+        std::vector<char> first(num_v);
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_PREPASS, num_v))
+        loopi(0, num_v) {first[i] = i == 0 || keys[i] != keys[i - 1];}
+        std::vector<fqmr_index> offsets;
+        prefix_sum(first, offsets);
+        fqmr_index num_c = offsets[num_v];
+        std::vector<fqmr_index> cluster(num_v), cstart(num_c + 1);
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_PREPASS, num_v))
+        loopi(0, num_v)
+        {
+            if (first[i]) {cstart[offsets[i]] = i;}
+            cluster[order[i]] = offsets[i + 1] - 1;
+        }
+        cstart[num_c] = num_v;
+
+        // merged vertices
+        VertexArray &merged = vertex_scratch;
+        resize_array(merged, num_c);
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_PREPASS, num_c))
+        loopi(0, num_c)
+        {
+            Vertex &v = merged[i];
+            v.id = vertices[order[cstart[i]]].id;
+            v.q = SymetricMatrix(0.0);
+            vec3f mean(0, 0, 0);
+            for (fqmr_index k = cstart[i]; k < cstart[i + 1]; k++)
+            {
+                const Vertex &src = vertices[order[k]];
+                v.q += src.q;
+                mean = mean + src.p;
+            }
+            mean = mean / double(cstart[i + 1] - cstart[i]);
+
+            unsigned long long key = keys[cstart[i]];
+            vec3f lo = bmin + vec3f(double(key >> 42), double((key >> 21) & 0x1FFFFF), double(key & 0x1FFFFF)) * cell;
+            vec3f hi = lo + vec3f(cell, cell, cell);
+
+            SymetricMatrix &q = v.q;
+            double det = q.det(0, 1, 2, 1, 4, 5, 2, 5, 7);
+            v.p = mean;
+            if (det != 0)
+            {
+                vec3f p;
+                p.x = -1 / det * (q.det(1, 2, 3, 4, 5, 6, 5, 7, 8));
+                p.y = 1 / det * (q.det(0, 2, 3, 1, 5, 6, 2, 7, 8));
+                p.z = -1 / det * (q.det(0, 1, 3, 1, 4, 6, 2, 5, 8));
+                if (p.x >= lo.x && p.y >= lo.y && p.z >= lo.z &&
+                    p.x <= hi.x && p.y <= hi.y && p.z <= hi.z) {v.p = p;}
+            }
+        }
+        vertices.swap(merged);
+
+        // remap triangles
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_PREPASS, num_f))
+        loopi(0, num_f) loopj(0, 3) {triangles[i].v[j] = cluster[triangles[i].v[j]];}
+        remove_degenerate_triangles();
+
+        quadrics_preset = true;
+    } // cluster_vertices()
+
+    // Drops the triangles with a repeated vertex, then the duplicated
+    // triangles (same vertices), keeping the first one
+    void remove_degenerate_triangles()
+    {
+        fqmr_index num_f = triangles.size();
+        std::vector<char> keep(num_f);
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_PREPASS, num_f))
+        loopi(0, num_f)
+        {
+            Triangle &t = triangles[i];
+            t.deleted = (t.v[0] == t.v[1] || t.v[1] == t.v[2] || t.v[2] == t.v[0]);
+            keep[i] = !t.deleted;
+        }
+        compact_triangles(keep);
+        num_f = triangles.size();
+
+        // drop duplicated triangles (same vertices), keep the first one :
+        // sorted vertices of each face, faces sorted by them with stable
+        // radix sorts, last vertex first, so that duplicates follow the
+        // first one
+        std::vector<fqmr_index> corners(num_f * 3), order(num_f);
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_PREPASS, num_f))
+        loopi(0, num_f)
+        {
+            fqmr_index *v = &corners[i * 3];
+            loopj(0, 3) {v[j] = triangles[i].v[j];}
+            std::sort(v, v + 3);
+            order[i] = i;
+        }
+        std::vector<unsigned long long> keys(num_f);
+        for (int c = 2; c >= 0; c--)
+        {
+        #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_PREPASS, num_f))
+            loopi(0, num_f) {keys[i] = corners[order[i] * 3 + c];}
+            radix_sort(keys, order);
+        }
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_PREPASS, num_f))
+        loopi(0, num_f)
+        {
+            const fqmr_index *a = &corners[order[i] * 3], *b = &corners[order[std::max(i, (fqmr_index)1) - 1] * 3];
+            keep[order[i]] = i == 0 || a[0] != b[0] || a[1] != b[1] || a[2] != b[2];
+        }
+        keep.resize(num_f);
+        compact_triangles(keep);
+    }
+
+    // Keep the triangles whose flag is set, in order, through
+    // triangle_scratch
+    void compact_triangles(const std::vector<char> &keep)
+    {
+        fqmr_index num_f = triangles.size();
+        std::vector<fqmr_index> offsets;
+        prefix_sum(keep, offsets);
+        TriangleArray &kept = triangle_scratch;
+        resize_array(kept, offsets[num_f]);
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_PREPASS, num_f))
+        loopi(0, num_f) {if (keep[i]) {kept[offsets[i]] = triangles[i];}}
+        triangles.swap(kept);
+    }
+
+    //
+    // Pair contraction pre-pass (virtual edges)
+    //
+    // Edge collapses never join disconnected parts, so assemblies of many
+    // small components stall above the target : each part keeps its
+    // minimal number of triangles. As in Garland-Heckbert, vertex pairs
+    // closer than distance are contracted as well, edges or not. Pairs
+    // are found with a spatial hash (cells of size distance), rated by
+    // the error of their summed quadric at the merged position and
+    // contracted by rounds of greedy matching, cheapest first, each
+    // vertex at most once per round. Rounds repeat until no pair is left
+    // or the mesh has target_count triangles (checked between rounds) :
+    // parts smaller than distance shrink to a point and vanish, parts
+    // closer than distance are welded, then the QEM pass continues on
+    // the joined surface. Pairs whose contraction would leave the surface
+    // around the merged vertex non-manifold are skipped (see
+    // pair_keeps_manifold), the QEM pass could not simplify it further.
+    // There are no flip checks, keep distance to the size of the gaps.
+    //
+    struct VertexPair
+    {
+        double cost;     // quadric error at p
+        fqmr_index i, j; // i < j
+        vec3f p;         // merged position
+        bool operator<(const VertexPair &b) const
+        {
+            if (cost != b.cost) {return cost < b.cost;}
+            return i != b.i ? i < b.i : j < b.j;
+        }
+    };
+    const int max_vertex_pairs = 8; // nearest candidates per vertex
+
+    // true if merging j into i (remap : the merges of the round so far, to
+    // a lower index) keeps the surface around i manifold : no edge on more
+    // than two triangles, and the triangles around i form a single fan, so
+    // that two parts touching at i only are not welded either, the QEM pass
+    // could not collapse the edges around such a vertex. links : scratch.
+    // The triangles of i and j are those of the current refs.
+    bool pair_keeps_manifold(fqmr_index i, fqmr_index j, const std::vector<fqmr_index> &remap,
+                             std::vector<fqmr_index> links[3])
+    {
+        std::vector<fqmr_index> &edges = links[0], &ends = links[1], &fan = links[2];
+        edges.clear();
+        const Vertex *pair[2] = {&vertices[i], &vertices[j]};
+        loopk(0, 2) for (fqmr_index r = pair[k]->tstart; r < pair[k]->tstart + pair[k]->tcount; r++)
+        {
+            const Triangle &t = triangles[refs[r].tid];
+            fqmr_index w[3];
+            for (int c = 0; c < 3; c++) {w[c] = t.v[c] == j ? i : remap[t.v[c]];}
+            if (w[0] == w[1] || w[1] == w[2] || w[2] == w[0]) {continue;}
+            int s = refs[r].tvertex;
+            edges.push_back(w[(s + 1) % 3]);
+            edges.push_back(w[(s + 2) % 3]);
+        }
+        if (edges.empty()) {return true;}
+
+        // an end listed three times is on three triangles around i
+        ends = edges;
+        std::sort(ends.begin(), ends.end());
+        for (size_t e = 2; e < ends.size(); e++) {if (ends[e] == ends[e - 2]) {return false;}}
+        ends.erase(std::unique(ends.begin(), ends.end()), ends.end());
+
+        // single fan : the link edges connect all the ends (union-find)
+        fan.resize(ends.size());
+        loopk(0, fan.size()) {fan[k] = k;}
+        fqmr_index components = fan.size();
+        for (size_t e = 0; e < edges.size(); e += 2)
+        {
+            fqmr_index a = std::lower_bound(ends.begin(), ends.end(), edges[e]) - ends.begin();
+            fqmr_index b = std::lower_bound(ends.begin(), ends.end(), edges[e + 1]) - ends.begin();
+            while (fan[a] != a) {a = fan[a];}
+            while (fan[b] != b) {b = fan[b];}
+            if (a != b)
+            {
+                fan[std::max(a, b)] = std::min(a, b);
+                components--;
+            }
+        }
+        return components == 1;
+    }
+
+    void contract_pairs(double distance, fqmr_index target_count)
+    {
+        const int max_pairs = max_vertex_pairs;
+        const long long max_cell = (1 << 21) - 1; // 3 x 21 bits cell key
+        typedef VertexPair Pair;
+        if (!(distance > 0) || vertices.empty()) {return;}
+        mesh_prepared = false;
+
+        build_refs();
+        if (!quadrics_preset)
+        {
+            compute_normals();
+            init_quadrics();
+        }
+        quadrics_preset = true;
+
+        std::vector<std::pair<long long, fqmr_index> > keys;
+        std::vector<Pair> candidates, pairs;
+        std::vector<int> counts;
+        std::vector<char> matched;
+        std::vector<fqmr_index> remap, links[3];
+        while ((fqmr_index)triangles.size() > target_count)
+        {
+            fqmr_index num_v = vertices.size(), num_f = triangles.size();
+            build_refs();
+
+            // spatial hash : cell keys sorted so that cells are contiguous
+            vec3f bmin, bmax;
+            bounding_box(bmin, bmax);
+            vec3f size = bmax - bmin;
+            double cell = fmax(distance, fmax(size.x, fmax(size.y, size.z)) / max_cell);
+            keys.resize(num_v);
+        #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_PREPASS, num_v))
+            loopi(0, num_v)
+            {
+                vec3f c = (vertices[i].p - bmin) / cell;
+                long long x = std::min((long long)c.x, max_cell);
+                long long y = std::min((long long)c.y, max_cell);
+                long long z = std::min((long long)c.z, max_cell);
+                keys[i] = std::make_pair((x << 42) | (y << 21) | z, i);
+            }
+            std::sort(keys.begin(), keys.end());
+
+            // nearest max_pairs vertices j > i closer than distance, from
+            // the 27 cells around i, with their merged position and error
+            candidates.resize(num_v * max_pairs);
+            counts.assign(num_v, 0);
+        #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_PREPASS, num_v))
             loopi(0, num_v)
             {
-                Vertex &v = vertices[i];
-                loopj(0, v.tcount)
+                const vec3f &pi = vertices[i].p;
+                vec3f c = (pi - bmin) / cell;
+                long long cx = std::min((long long)c.x, max_cell);
+                long long cy = std::min((long long)c.y, max_cell);
+                long long cz = std::min((long long)c.z, max_cell);
+                double d2[max_pairs];
+                Pair *found = &candidates[i * max_pairs];
+                int n = 0;
+                for (long long x = std::max(cx - 1, 0LL); x <= std::min(cx + 1, max_cell); x++)
+                for (long long y = std::max(cy - 1, 0LL); y <= std::min(cy + 1, max_cell); y++)
+                for (long long z = std::max(cz - 1, 0LL); z <= std::min(cz + 1, max_cell); z++)
+                {
+                    long long key = (x << 42) | (y << 21) | z;
+                    size_t k = std::lower_bound(keys.begin(), keys.end(), std::make_pair(key, (fqmr_index)0)) - keys.begin();
+                    for (; k < keys.size() && keys[k].first == key; k++)
+                    {
+                        fqmr_index j = keys[k].second;
+                        if (j <= i) {continue;}
+                        vec3f d = vertices[j].p - pi;
+                        double l2 = d.dot(d);
+                        if (l2 >= distance * distance) {continue;}
+                        // insertion into the sorted nearest list
+                        if (n == max_pairs && l2 >= d2[max_pairs - 1]) {continue;}
+                        int m = n < max_pairs ? n++ : max_pairs - 1;
+                        while (m > 0 && d2[m - 1] > l2)
+                        {
+                            d2[m] = d2[m - 1];
+                            found[m] = found[m - 1];
+                            m--;
+                        }
+                        d2[m] = l2;
+                        found[m].i = i;
+                        found[m].j = j;
+                    }
+                }
+                loopk(0, n)
                 {
-                    Triangle &t = triangles[refs[v.tstart + j].tid];
-                    Vertex &v0 = vertices[t.v[0]];
-                    v.q = v.q + SymetricMatrix(t.n.x, t.n.y, t.n.z, -t.n.dot(v0.p));
+                    Pair &pair = found[k];
+                    const Vertex &vj = vertices[pair.j];
+                    SymetricMatrix q = vertices[i].q + vj.q;
+                    vec3f mid = (pi + vj.p) / 2.0;
+                    pair.p = mid;
+                    double det = q.det(0, 1, 2, 1, 4, 5, 2, 5, 7);
+                    if (det != 0)
+                    {
+                        vec3f p;
+                        p.x = -1 / det * (q.det(1, 2, 3, 4, 5, 6, 5, 7, 8));
+                        p.y = 1 / det * (q.det(0, 2, 3, 1, 5, 6, 2, 7, 8));
+                        p.z = -1 / det * (q.det(0, 1, 3, 1, 4, 6, 2, 5, 8));
+                        vec3f d = p - mid;
+                        if (d.dot(d) <= distance * distance) {pair.p = p;} // optimum near the pair
+                    }
+                    pair.cost = vertex_error(q, pair.p.x, pair.p.y, pair.p.z);
                 }
+                counts[i] = n;
             }
-        
-        #pragma omp parallel for schedule(static) if(num_f > 20480)
-            loopi(0, num_f)
+            pairs.clear();
+            loopi(0, num_v) loopj(0, counts[i]) {pairs.push_back(candidates[i * max_pairs + j]);}
+            if (pairs.empty()) {break;}
+            std::sort(pairs.begin(), pairs.end());
+
+            // greedy matching, cheapest pairs first : j merges into i
+            remap.resize(num_v);
+            loopi(0, num_v) {remap[i] = i;}
+            matched.assign(num_v, 0);
+            fqmr_index contracted = 0;
+            loopi(0, pairs.size())
             {
-                // Calc Edge Error
-                Triangle &t = triangles[i];
-                vec3f p;
-                loopj(0, 3) {t.err[j] = calculate_error(t.v[j], t.v[(j + 1) % 3], p);}
-                t.err[3] = min(t.err[0], min(t.err[1], t.err[2]));
+                const Pair &pair = pairs[i];
+                if (matched[pair.i] || matched[pair.j]) {continue;}
+                if (!pair_keeps_manifold(pair.i, pair.j, remap, links)) {continue;}
+                contracted++;
+                matched[pair.i] = matched[pair.j] = 1;
+                Vertex &v = vertices[pair.i];
+                v.p = pair.p;
+                v.q += vertices[pair.j].q;
+                remap[pair.j] = pair.i;
             }
+            if (!contracted) {break;}
+
+            // compact the vertices (merged ones point to a lower index,
+            // already renumbered), remap the triangles
+            fqmr_index dst = 0;
+            loopi(0, num_v)
+            {
+                if (remap[i] != i) {remap[i] = remap[remap[i]]; continue;}
+                remap[i] = dst;
+                vertices[dst++] = vertices[i];
+            }
+            vertices.resize(dst);
+        #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_PREPASS, num_f))
+            loopi(0, num_f) loopj(0, 3) {triangles[i].v[j] = remap[triangles[i].v[j]];}
+            remove_degenerate_triangles();
         }
-    }
+    } // contract_pairs()
 
     // Finally compact mesh before exiting
-    void compact_mesh()
+    void Engine::compact_mesh()
     {
-        int dst = 0;
+        fqmr_index dst = 0;
         loopi(0, vertices.size())
         {
             vertices[i].tcount = 0;
@@ -969,6 +1854,8 @@ namespace Simplify
         {
             vertices[i].tstart = dst;
             vertices[dst].p = vertices[i].p;
+            vertices[dst].q = vertices[i].q;
+            vertices[dst].id = vertices[i].id;
             dst++;
         }
         loopi(0, triangles.size())
@@ -979,14 +1866,426 @@ namespace Simplify
         vertices.resize(dst);
     }
 
+    // Stable LSD radix sort of (keys, values) by keys, 8 bits per pass.
+    // Each thread histograms and scatters its own static chunk, so the
+    // result does not depend on the number of threads.
+    void radix_sort(std::vector<unsigned long long> &keys, std::vector<fqmr_index> &values)
+    {
+        fqmr_index n = keys.size();
+        std::vector<unsigned long long> keys_tmp(n);
+        std::vector<fqmr_index> values_tmp(n);
+        std::vector<fqmr_index> hist;
+
+        unsigned long long bits = 0;
+        loopi(0, n) {bits |= keys[i] ^ keys[0];} // bytes that actually differ
+        
+        for (int shift = 0; shift < 64; shift += 8)
+        {
+            if (((bits >> shift) & 0xFF) == 0) {continue;}
+
+        #pragma omp parallel num_threads(loop_threads(PHASE_SORT, n))
+            {
+                int nt = omp_get_num_threads(), tid = omp_get_thread_num();
+                fqmr_index begin = (long long)n * tid / nt, end = (long long)n * (tid + 1) / nt;
+
+            #pragma omp single
+                hist.assign(256 * nt, 0);
+
+                for (fqmr_index i = begin; i < end; i++) {hist[tid * 256 + ((keys[i] >> shift) & 0xFF)]++;}
+
+            #pragma omp barrier
+            #pragma omp single
+                {
+                    // exclusive prefix sum, digit major then thread
+                    fqmr_index sum = 0;
+                    loopj(0, 256) loopk(0, nt)
+                    {
+                        fqmr_index c = hist[k * 256 + j];
+                        hist[k * 256 + j] = sum;
+                        sum += c;
+                    }
+                }
+
+                fqmr_index *offset = &hist[tid * 256];
+                for (fqmr_index i = begin; i < end; i++)
+                {
+                    fqmr_index dst = offset[(keys[i] >> shift) & 0xFF]++;
+                    keys_tmp[dst] = keys[i];
+                    values_tmp[dst] = values[i];
+                }
+            }
+            keys.swap(keys_tmp);
+            values.swap(values_tmp);
+        }
+    }
+
+    // Interleave the lower 21 bits of x, y and z (Morton / Z-order code)
+    unsigned long long morton_code(unsigned long long x, unsigned long long y, unsigned long long z)
+    {
+        unsigned long long c[3] = {x, y, z};
+        loopi(0, 3)
+        {
+            unsigned long long v = c[i] & 0x1FFFFF;
+            v = (v | v << 32) & 0x1F00000000FFFFULL;
+            v = (v | v << 16) & 0x1F0000FF0000FFULL;
+            v = (v | v << 8) & 0x100F00F00F00F00FULL;
+            v = (v | v << 4) & 0x10C30C30C30C30C3ULL;
+            v = (v | v << 2) & 0x1249249249249249ULL;
+            c[i] = v;
+        }
+        return c[0] | (c[1] << 1) | (c[2] << 2);
+    }
+
+    //
+    // Spatial reordering
+    //
+    // Sorts the vertices along a Morton curve of their positions and the
+    // triangles by their first vertex, so that neighbouring elements are
+    // close in memory. Vertex::id and Triangle::id keep the input order,
+    // restore_order() maps the output back to it.
+    //
+    void reorder_spatial()
+    {
+        fqmr_index num_v = vertices.size(), num_f = triangles.size();
+        if (num_v == 0) {return;}
+        mesh_prepared = false;
+
+        vec3f bmin, bmax;
+        bounding_box(bmin, bmax);
+        vec3f size = bmax - bmin;
+        double extent = fmax(size.x, fmax(size.y, size.z));
+        double scale = extent > 0 ? double(0x1FFFFF) / extent : 0;
+
+        // vertices
+        std::vector<unsigned long long> keys(num_v);
+        std::vector<fqmr_index> order(num_v);
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_PREPASS, num_v))
+        loopi(0, num_v)
+        {
+            vec3f c = (vertices[i].p - bmin) * scale;
+            keys[i] = morton_code((unsigned long long)c.x, (unsigned long long)c.y, (unsigned long long)c.z);
+            order[i] = i;
+        }
+        radix_sort(keys, order);
+
+        VertexArray &sorted_vertices = vertex_scratch;
+        resize_array(sorted_vertices, num_v);
+        std::vector<fqmr_index> remap(num_v);
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, num_v))
+        loopi(0, num_v)
+        {
+            sorted_vertices[i] = vertices[order[i]];
+            remap[order[i]] = i;
+        }
+        vertices.swap(sorted_vertices);
+
+        // triangles
+        keys.resize(num_f);
+        order.resize(num_f);
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, num_f))
+        loopi(0, num_f)
+        {
+            Triangle &t = triangles[i];
+            loopj(0, 3) {t.v[j] = remap[t.v[j]];}
+            keys[i] = std::min(t.v[0], std::min(t.v[1], t.v[2]));
+            order[i] = i;
+        }
+        radix_sort(keys, order);
+
+        TriangleArray &sorted_triangles = triangle_scratch;
+        resize_array(sorted_triangles, num_f);
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, num_f))
+        loopi(0, num_f) {sorted_triangles[i] = triangles[order[i]];}
+        triangles.swap(sorted_triangles);
+    }
+
+    // Sort vertices and triangles back by their input index, after
+    // compact_mesh()
+    void restore_order()
+    {
+        fqmr_index num_v = vertices.size(), num_f = triangles.size();
+
+        std::vector<unsigned long long> keys(num_v);
+        std::vector<fqmr_index> order(num_v);
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, num_v))
+        loopi(0, num_v)
+        {
+            keys[i] = vertices[i].id;
+            order[i] = i;
+        }
+        radix_sort(keys, order);
+
+        VertexArray &sorted_vertices = vertex_scratch;
+        resize_array(sorted_vertices, num_v);
+        std::vector<fqmr_index> remap(num_v);
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, num_v))
+        loopi(0, num_v)
+        {
+            sorted_vertices[i] = vertices[order[i]];
+            remap[order[i]] = i;
+        }
+        vertices.swap(sorted_vertices);
+
+        keys.resize(num_f);
+        order.resize(num_f);
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, num_f))
+        loopi(0, num_f)
+        {
+            Triangle &t = triangles[i];
+            loopj(0, 3) {t.v[j] = remap[t.v[j]];}
+            keys[i] = t.id;
+            order[i] = i;
+        }
+        radix_sort(keys, order);
+
+        TriangleArray &sorted_triangles = triangle_scratch;
+        resize_array(sorted_triangles, num_f);
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, num_f))
+        loopi(0, num_f) {sorted_triangles[i] = triangles[order[i]];}
+        triangles.swap(sorted_triangles);
+    }
+
+    // Replace the mesh by a side x side grid of vertices on a wavy surface
+    void grid_mesh(fqmr_index side)
+    {
+        resize_array(vertices, (size_t)side * side);
+        resize_array(triangles, 2 * (size_t)(side - 1) * (side - 1));
+        loopi(0, side) loopj(0, side)
+        {
+            Vertex &v = vertices[i * side + j];
+            v.p = vec3f(j, i, 4 * sin(i * 0.1) * cos(j * 0.1));
+            v.id = i * side + j;
+        }
+        loopi(0, side - 1) loopj(0, side - 1)
+        {
+            fqmr_index v = i * side + j, f = 2 * (i * (side - 1) + j);
+            fqmr_index corners[2][3] = {{v, v + 1, v + side}, {v + 1, v + side + 1, v + side}};
+            loopk(0, 2)
+            {
+                Triangle &t = triangles[f + k];
+                t.v[0] = corners[k][0];
+                t.v[1] = corners[k][1];
+                t.v[2] = corners[k][2];
+                t.attr = 0;
+                t.material = -1;
+                t.id = f + k;
+                t.deleted = 0;
+                t.dirty = 0;
+            }
+        }
+        quadrics_preset = false;
+        mesh_prepared = false;
+        vertex_locked.clear();
+        vertex_weights.clear();
+    }
+
+    // Best time of a function made of the loops of a phase on a grid mesh
+    double phase_time(Phase phase, fqmr_index side)
+    {
+        double best = DBL_MAX;
+        int reps = std::max(3LL, (1LL << 16) / ((long long)side * side));
+        std::vector<unsigned long long> keys;
+        std::vector<fqmr_index> values;
+        std::vector<vec3f> normals;
+        loopi(0, reps)
+        {
+            grid_mesh(side);
+            if (phase == PHASE_SORT)
+            {
+                keys.resize(vertices.size());
+                values.resize(vertices.size());
+                loopj(0, keys.size())
+                {
+                    keys[j] = (j + 1) * 0x9E3779B97F4A7C15ULL;
+                    values[j] = j;
+                }
+            }
+            double start = omp_get_wtime();
+            switch (phase)
+            {
+            case PHASE_IO: reorder_spatial(); break;
+            case PHASE_UPDATE: build_refs(); break;
+            case PHASE_INIT: prepare_mesh(); break;
+            case PHASE_PREPASS: cluster_vertices(side / 2); break;
+            case PHASE_SORT: radix_sort(keys, values); break;
+            default: vertex_normals(normals, true); break;
+            }
+            best = std::min(best, omp_get_wtime() - start);
+        }
+        return best;
+    }
+
+    //
+    // Measure the serial cutoffs of this machine
+    //
+    // Each phase is timed on grid meshes of growing size (1024 vertices up
+    // to max_size), with its loops serial then parallel and the other
+    // phases serial. Once the parallel run is 10% faster twice in a row,
+    // the cutoff is the last size (at least 1024) at which it was not; a
+    // phase that never gets there stays serial. The cutoffs hold for the current
+    // number of threads and grain, and are applied to the policy.
+    //
+    // The current mesh and its per-vertex state are set aside during the
+    // measures and restored afterwards. Takes up to a few seconds.
+    //
+    ExecutionPolicy calibrate_policy(long long max_size = 1 << 18)
+    {
+        VertexArray kept_vertices;
+        TriangleArray kept_triangles;
+        RefArray kept_refs;
+        std::vector<char> kept_locked;
+        std::vector<double> kept_weights;
+        kept_vertices.swap(vertices);
+        kept_triangles.swap(triangles);
+        kept_refs.swap(refs);
+        kept_locked.swap(vertex_locked);
+        kept_weights.swap(vertex_weights);
+        bool kept_preset = quadrics_preset, kept_prepared = mesh_prepared;
+
+        ExecutionPolicy measured = policy;
+        loopi(0, NUM_PHASES) {measured.cutoff[i] = LLONG_MAX;}
+        if (omp_get_max_threads() > 1)
+        {
+            loopi(0, NUM_PHASES)
+            {
+                long long cutoff = 1024;
+                int wins = 0;
+                for (fqmr_index side = 32; (long long)side * side <= max_size && wins < 2; side = side * 3 / 2)
+                {
+                    policy = measured;
+                    loopj(0, NUM_PHASES) {policy.cutoff[j] = LLONG_MAX;}
+                    double serial = phase_time((Phase)i, side);
+                    policy.cutoff[i] = 0;
+                    double parallel = phase_time((Phase)i, side);
+                    if (parallel < 0.9 * serial) {wins++;}
+                    else
+                    {
+                        wins = 0;
+                        cutoff = (long long)side * side;
+                    }
+                }
+                if (wins > 0) {measured.cutoff[i] = cutoff;}
+            }
+        }
+        policy = measured;
+        vertices.swap(kept_vertices);
+        triangles.swap(kept_triangles);
+        refs.swap(kept_refs);
+        vertex_locked.swap(kept_locked);
+        vertex_weights.swap(kept_weights);
+        quadrics_preset = kept_preset;
+        mesh_prepared = kept_prepared;
+        return policy;
+    }
+
+    // Free the mesh arrays and the scratch memory kept across calls
+    void release_memory()
+    {
+        TriangleArray().swap(triangles);
+        VertexArray().swap(vertices);
+        RefArray().swap(refs);
+        TriangleArray().swap(triangle_scratch);
+        VertexArray().swap(vertex_scratch);
+        std::vector<int>().swap(deleted0);
+        std::vector<int>().swap(deleted1);
+        link_scratch = Engine::LinkScratch();
+    }
+
+    //
+    // Memory estimate of a simplification, in bytes, before loading the mesh
+    //
+    // Upper bounds of the engine arrays on a fresh call (release_memory()
+    // before, no capacity kept from a previous mesh), not counting the
+    // input and output buffers of the caller.
+    //
+    //  - refs grows by push_back during the collapses (a collapse appends
+    //    the references of both its vertices, 2 * valence, 3F/V if not
+    //    given) and its capacity doubles : a reallocation briefly holds the
+    //    new and the previous capacity,
+    //  - scratch is the largest temporary set of the passes : reordering
+    //    (kept mesh copies plus sort buffers), clustering, lossless
+    //    worklists.
+    //
+    struct MemoryEstimate
+    {
+        size_t vertices, triangles, refs, scratch, peak;
+    };
+
+    MemoryEstimate estimate_memory(size_t num_v, size_t num_f, size_t target_count, bool lossless, bool spatial_reorder, int cluster_grid, double valence = 0, bool pair_contraction = false)
+    {
+        MemoryEstimate m;
+        const size_t idx = sizeof(fqmr_index);
+        m.vertices = num_v * sizeof(Vertex);
+        m.triangles = num_f * sizeof(Triangle);
+
+        size_t base = num_f * 3, capacity = base, previous = 0;
+        if (lossless) {target_count = 0;} // bound, stops at the threshold
+        if (target_count < num_f && num_v > 0)
+        {
+            double collapses = (num_f - target_count) / 2.0;
+            if (valence <= 0) {valence = 3.0 * num_f / num_v;}
+            double appended = collapses * 2.0 * valence;
+            while (capacity < base + appended)
+            {
+                previous = capacity;
+                capacity *= 2;
+            }
+        }
+        m.refs = (capacity + previous) * sizeof(Ref);
+
+        // copies kept in vertex_scratch / triangle_scratch, plus the largest
+        // temporaries of a pass
+        size_t kept = 0, transient = 0;
+        if (spatial_reorder)
+        {
+            size_t n = std::max(num_v, num_f);
+            kept = m.vertices + m.triangles;
+            transient = 2 * n * (sizeof(unsigned long long) + idx) + num_v * idx;
+        }
+        // remove_degenerate_triangles : sorted corners, order, radix sort
+        // keys and buffers, flags and offsets, kept faces in triangle_scratch
+        size_t degenerate = num_f * (6 * idx + 2 * sizeof(unsigned long long) + 1);
+        if (cluster_grid > 0)
+        {
+            // keys, order and their radix sort buffers, flags, offsets, cluster, cstart
+            kept = std::max(kept, m.vertices + m.triangles);
+            transient = std::max(transient, std::max(degenerate, num_v * (2 * sizeof(unsigned long long) + 5 * idx + 1)));
+        }
+        if (pair_contraction)
+        {
+            // candidates and the sorted pairs, plus the hash keys
+            size_t pairs = 2 * num_v * max_vertex_pairs * sizeof(VertexPair);
+            kept = std::max(kept, m.triangles);
+            transient = std::max(transient, std::max(degenerate, pairs + num_v * (sizeof(std::pair<long long, fqmr_index>) + sizeof(int) + 1 + idx)));
+        }
+        if (lossless) {transient = std::max(transient, 3 * num_f * idx);}
+        m.scratch = kept + transient;
+
+        m.peak = m.vertices + m.triangles + m.refs + m.scratch;
+        return m;
+    }
+
+    // Quadric error of every vertex at its current position, 0 for the
+    // vertices untouched by the simplification
+    void Engine::vertex_errors(std::vector<double> &errors)
+    {
+        errors.resize(vertices.size());
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_QUERY, vertices.size()))
+        loopi(0, vertices.size())
+        {
+            const Vertex &v = vertices[i];
+            errors[i] = fmax(vertex_error(v.q, v.p.x, v.p.y, v.p.z), 0.0);
+        }
+    }
+
     // Error between vertex and Quadric
-    double vertex_error(SymetricMatrix q, double x, double y, double z)
+    double Engine::vertex_error(SymetricMatrix q, double x, double y, double z)
     {
         return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x + q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y + q[7] * z * z + 2 * q[8] * z + q[9];
     }
 
     // Error for one edge
-    double calculate_error(int id_v1, int id_v2, vec3f &p_result)
+    double Engine::calculate_error(fqmr_index id_v1, fqmr_index id_v2, vec3f &p_result)
     {
         // compute interpolated vertex
 
@@ -1022,4 +2321,6 @@ namespace Simplify
         return error;
     }
 };
-///////////////////////////////////////////
\ No newline at end of file
+///////////////////////////////////////////
+
+#endif // SIMPLIFY_H
@@ -1,112 +1,614 @@
 #include "Simplify.h"
+#include "Optimize.h"
+#include "ClusterLOD.h"
+#include "Hausdorff.h"
+#include "Snapshot.h"
+#include "Encode.h"
+#include "Resimplify.h"
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 #include <pybind11/numpy.h>
 #include <pybind11/functional.h>
+#include <mutex>
 
 namespace py = pybind11;
 
 namespace Simplify {
+    //
+    // The engine state is global : every binding reading or writing it holds
+    // engine_mutex for its whole call, whether or not the caller went through
+    // the _engine_lock of the package, like fqmr.cpp does for the C library.
+    // The mutex is waited for with the GIL released, so the thread holding it
+    // can always take the GIL back.
+    //
+    std::mutex engine_mutex;
+
+    struct EngineLock
+    {
+        std::unique_lock<std::mutex> lock;
+
+        EngineLock() : lock(engine_mutex, std::try_to_lock)
+        {
+            if (lock.owns_lock()) {return;}
+            if (PyGILState_Check())
+            {
+                py::gil_scoped_release release;
+                lock.lock();
+            }
+            else {lock.lock();}
+        }
+    };
+
     void load_verts(py::array_t<double> verts_np)
     {
-        int n_verts = verts_np.shape(0);
+        fqmr_index n_verts = verts_np.shape(0);
 
-        vertices.resize(n_verts);
+        resize_array(vertices, n_verts);
         auto r0 = verts_np.unchecked<2>();
-    #pragma omp parallel for schedule(static) if(n_verts > 20480)
-        for (int i = 0; i < n_verts; i++)
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, n_verts))
+        for (fqmr_index i = 0; i < n_verts; i++)
         {
             vertices[i].p.x = r0(i, 0);
             vertices[i].p.y = r0(i, 1);
             vertices[i].p.z = r0(i, 2);
+            vertices[i].id = i;
         }
     }
 
-    void load_faces(py::array_t<int> faces_np)
+    void load_faces(py::array_t<fqmr_index> faces_np)
     {
-        int n_faces = faces_np.shape(0);
+        fqmr_index n_faces = faces_np.shape(0);
 
-        triangles.resize(n_faces);
+        resize_array(triangles, n_faces);
         auto r0 = faces_np.unchecked<2>();
-    #pragma omp parallel for schedule(static) if(n_faces > 20480)
-        for (int i = 0; i < n_faces; i++)
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, n_faces))
+        for (fqmr_index i = 0; i < n_faces; i++)
         {
             triangles[i].v[0] = r0(i, 0);
             triangles[i].v[1] = r0(i, 1);
             triangles[i].v[2] = r0(i, 2);
             triangles[i].attr = 0;
             triangles[i].material = -1;
+            triangles[i].id = i;
+            triangles[i].deleted = 0;
+            triangles[i].dirty = 0;
         }
     }
 
-    void setMesh(py::array_t<double> verts_np, py::array_t<int> faces_np)
+    void setMesh(py::array_t<double> verts_np, py::array_t<fqmr_index> faces_np, bool spatial_reorder = false)
     {
+        EngineLock lock;
+        use_threads();
         load_verts(verts_np);
         load_faces(faces_np);
+        quadrics_preset = false;
+        mesh_prepared = false;
+        vertex_weights.clear();
+        if (spatial_reorder) {reorder_spatial();}
+    }
+
+    void setVertexWeights(py::array_t<double, py::array::c_style | py::array::forcecast> weights_np)
+    {
+        /*
+        Per-vertex importance of the current mesh, in input vertex order :
+        the quadric of each vertex is scaled by its weight. Set after
+        setMesh and before prepareMesh or the simplification, an empty
+        array restores uniform weights.
+        */
+        EngineLock lock;
+        fqmr_index n = weights_np.size();
+        if (n == 0)
+        {
+            vertex_weights.clear();
+            mesh_prepared = false;
+            return;
+        }
+        if (n != (fqmr_index)vertices.size()) {throw std::invalid_argument("one weight per vertex expected");}
+        const double *w = weights_np.data();
+        loopi(0, n)
+        {
+            if (!(w[i] >= 0 && w[i] <= DBL_MAX)) {throw std::invalid_argument("weights must be finite and non-negative");}
+        }
+        vertex_weights.assign(w, w + n);
+        mesh_prepared = false;
+    }
+
+    void setNumThreads(int num_threads = 0)
+    {
+        EngineLock lock;
+        Simplify::num_threads = num_threads > 0 ? num_threads : 0;
+    }
+
+    int getNumThreads()
+    {
+        EngineLock lock;
+        return num_threads > 0 ? num_threads : default_threads;
+    }
+
+    // cutoffs by phase name, None for phases that stay serial
+    py::dict policyDict(const ExecutionPolicy &p)
+    {
+        py::dict cutoffs;
+        loopi(0, NUM_PHASES)
+        {
+            if (p.cutoff[i] == LLONG_MAX) {cutoffs[phase_names[i]] = py::none();}
+            else {cutoffs[phase_names[i]] = p.cutoff[i];}
+        }
+        py::dict result;
+        result["grain"] = p.grain;
+        result["cutoffs"] = cutoffs;
+        return result;
+    }
+
+    void setExecutionPolicy(long long grain, py::dict cutoffs)
+    {
+        EngineLock lock;
+        if (grain < 1) {throw std::invalid_argument("grain must be at least 1");}
+        ExecutionPolicy p = policy;
+        p.grain = grain;
+        for (auto item : cutoffs)
+        {
+            std::string name = py::str(item.first);
+            int phase = std::find(phase_names, phase_names + NUM_PHASES, name) - phase_names;
+            if (phase == NUM_PHASES) {throw std::invalid_argument("unknown phase " + name);}
+            if (item.second.is_none()) {p.cutoff[phase] = LLONG_MAX;}
+            else
+            {
+                long long cutoff = item.second.cast<long long>();
+                if (cutoff < 0) {throw std::invalid_argument("cutoffs must be non-negative");}
+                p.cutoff[phase] = cutoff;
+            }
+        }
+        policy = p;
+    }
+
+    py::dict getExecutionPolicy()
+    {
+        EngineLock lock;
+        return policyDict(policy);
+    }
+
+    py::dict calibrateExecutionPolicy(long long max_size = 1 << 18)
+    {
+        EngineLock lock;
+        ExecutionPolicy p;
+        {
+            py::gil_scoped_release release;
+            use_threads();
+            p = calibrate_policy(max_size);
+        }
+        return policyDict(p);
+    }
+
+    void setMemoryOptions(bool huge_pages = false)
+    {
+        EngineLock lock;
+        Simplify::huge_pages = huge_pages;
+    }
+
+    void releaseMemory()
+    {
+        EngineLock lock;
+        release_memory();
+    }
+
+    void prepareMesh()
+    {
+        EngineLock lock;
+        use_threads();
+        prepare_mesh();
+    }
+
+    void saveState(const std::string &path)
+    {
+        EngineLock lock;
+        if (!save_state(path.c_str())) {throw std::runtime_error("cannot write snapshot " + path);}
+    }
+
+    void loadState(const std::string &path)
+    {
+        EngineLock lock;
+        use_threads();
+        if (!load_state(path.c_str())) {throw std::runtime_error("cannot read snapshot " + path + " (missing, corrupt or written by another build)");}
     }
 
     py::array_t<double> np_getVertices()
     {
-        int n_verts = vertices.size();
+        fqmr_index n_verts = vertices.size();
 
         std::vector<double> verts(n_verts*3);
-    #pragma omp parallel for schedule(static) if(n_verts > 20480)
-        for (int i = 0; i < n_verts; i++)
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, n_verts))
+        for (fqmr_index i = 0; i < n_verts; i++)
         {
             verts[i*3] = vertices[i].p.x;
             verts[i*3+1] = vertices[i].p.y;
             verts[i*3+2] = vertices[i].p.z;
         }
 
-        py::array_t<double> verts_np({n_verts, 3}, (double*)verts.data());
+        py::array_t<double> verts_np({n_verts, (fqmr_index)3}, (double*)verts.data());
         return verts_np;
     }
 
-    py::array_t<int> np_getFaces()
+    py::array_t<fqmr_index> np_getFaces()
     {
-        int n_faces = triangles.size();
+        fqmr_index n_faces = triangles.size();
 
-        std::vector<int> faces(n_faces*3);
-    #pragma omp parallel for schedule(static) if(n_faces > 20480)
-        for (int i = 0; i < n_faces; i++)
+        std::vector<fqmr_index> faces(n_faces*3);
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, n_faces))
+        for (fqmr_index i = 0; i < n_faces; i++)
         {
             faces[i*3] = triangles[i].v[0];
             faces[i*3+1] = triangles[i].v[1];
             faces[i*3+2] = triangles[i].v[2];
         }
 
-        py::array_t<int> faces_np({n_faces, 3}, (int*)faces.data());
+        py::array_t<fqmr_index> faces_np({n_faces, (fqmr_index)3}, (fqmr_index*)faces.data());
         return faces_np;
     }
 
     py::array_t<double> np_getNormals()
     {
-        int n_faces = triangles.size();
+        fqmr_index n_faces = triangles.size();
 
         std::vector<double> normals(n_faces*3);
-    #pragma omp parallel for schedule(static) if(n_faces > 20480)
-        for (int i = 0; i < n_faces; i++)
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, n_faces))
+        for (fqmr_index i = 0; i < n_faces; i++)
         {
             normals[i*3] = triangles[i].n.x;
             normals[i*3+1] = triangles[i].n.y;
             normals[i*3+2] = triangles[i].n.z;
         }
 
-        py::array_t<double> normals_np({n_faces, 3}, (double*)normals.data());
+        py::array_t<double> normals_np({n_faces, (fqmr_index)3}, (double*)normals.data());
         return normals_np;
     }
 
-    py::tuple getMesh()
+    py::tuple getMesh(bool original_order = false)
     {
+        EngineLock lock;
+        use_threads();
+        if (original_order) {restore_order();}
+        compute_normals(); // moved by the collapses since update_mesh(0)
+
         py::array_t<double> verts_np = np_getVertices();
-        py::array_t<int> faces_np = np_getFaces();
+        py::array_t<fqmr_index> faces_np = np_getFaces();
         py::array_t<double> normals_np = np_getNormals();
 
         return py::make_tuple(verts_np, faces_np, normals_np);
     }
 
-    void simplify_mesh_warpper(
-        int target_count, 
+    py::bytes getEncodedMesh(int bits = 16, bool original_order = false)
+    {
+        /*
+        Current mesh in the compact binary encoding of Encode.h : positions
+        quantized to bits per coordinate over the bounding box, entropy
+        coded vertex and index streams. Call optimizeMesh first for the
+        best compression. decodeMesh reads it back.
+        */
+        EngineLock lock;
+        if (bits < 1 || bits > encoded_max_bits) {throw std::invalid_argument("bits must be in 1..30");}
+        std::vector<unsigned char> data;
+        {
+            py::gil_scoped_release release;
+            use_threads();
+            if (original_order) {restore_order();}
+            encode_mesh(EngineMesh(), vertices.size(), triangles.size(), bits, data);
+        }
+        return py::bytes((const char *)data.data(), data.size());
+    }
+
+    py::bytes encodeMesh(
+        py::array_t<double, py::array::c_style | py::array::forcecast> verts_np, 
+        py::array_t<fqmr_index, py::array::c_style | py::array::forcecast> faces_np, 
+        int bits = 16
+    ) {
+        /*
+        Encode a mesh given as arrays, without touching the current mesh
+        */
+        if (bits < 1 || bits > encoded_max_bits) {throw std::invalid_argument("bits must be in 1..30");}
+        if (verts_np.ndim() != 2 || verts_np.shape(1) != 3 || faces_np.ndim() != 2 || faces_np.shape(1) != 3) {throw std::invalid_argument("(N, 3) arrays expected");}
+        fqmr_index n_verts = verts_np.shape(0), n_faces = faces_np.shape(0);
+        const fqmr_index *faces = faces_np.data();
+        loopi(0, n_faces * 3)
+        {
+            if (faces[i] < 0 || faces[i] >= n_verts) {throw std::invalid_argument("face index out of range");}
+        }
+        ArrayMesh<fqmr_index> mesh = {verts_np.data(), faces};
+        std::vector<unsigned char> data;
+        {
+            py::gil_scoped_release release;
+            encode_mesh(mesh, n_verts, n_faces, bits, data);
+        }
+        return py::bytes((const char *)data.data(), data.size());
+    }
+
+    double beginEditSession(
+        fqmr_index target_count, 
+        int update_rate = 5, 
+        double aggressiveness = 7,
+        double alpha = 1e-9, 
+        int K = 3, 
+        int max_iterations = 100,
+        bool preserve_border = false, 
+        bool verbose = false,
+        double max_error = -1
+    ) {
+        /*
+        Simplify the current mesh (the source of the session, loaded
+        without spatial_reorder) keeping the source map, see Resimplify.h.
+        The current mesh is then the output.
+        */
+        EngineLock lock;
+        py::gil_scoped_release release;
+        use_threads();
+        return begin_edit_session(target_count, update_rate, aggressiveness, alpha, K, max_iterations, preserve_border, verbose, max_error);
+    }
+
+    py::dict resimplifyMesh(
+        py::array_t<double, py::array::c_style | py::array::forcecast> verts_np, 
+        py::array_t<fqmr_index, py::array::c_style | py::array::forcecast> faces_np, 
+        py::array_t<fqmr_index, py::array::c_style | py::array::forcecast> changed_np
+    ) {
+        /*
+        Rebuild the part of the session output covered by the changed
+        faces of the edited source. The current mesh is then the output.
+        */
+        EngineLock lock;
+        if (!edit_session.active) {throw std::runtime_error("no edit session, call beginEditSession first");}
+        if (verts_np.ndim() != 2 || verts_np.shape(1) != 3 || faces_np.ndim() != 2 || faces_np.shape(1) != 3) {throw std::invalid_argument("(N, 3) arrays expected");}
+        EditStats stats;
+        bool ok;
+        {
+            py::gil_scoped_release release;
+            use_threads();
+            ok = resimplify(verts_np.data(), verts_np.shape(0), faces_np.data(), faces_np.shape(0),
+                            changed_np.data(), changed_np.size(), stats);
+        }
+        if (!ok) {throw std::invalid_argument("index out of range, or source vertices removed");}
+        py::dict result;
+        result["region_vertices"] = stats.region_vertices;
+        result["patch_faces"] = stats.patch_faces;
+        result["error"] = stats.error;
+        return result;
+    }
+
+    py::tuple decodeMesh(py::bytes data)
+    {
+        /*
+        Vertices and faces of a mesh encoded by getEncodedMesh or
+        encodeMesh
+        */
+        std::string buffer = data;
+        std::vector<double> verts;
+        std::vector<fqmr_index> faces;
+        bool ok;
+        {
+            py::gil_scoped_release release;
+            ok = decode_mesh((const unsigned char *)buffer.data(), buffer.size(), verts, faces);
+        }
+        if (!ok) {throw std::runtime_error("invalid encoded mesh (corrupt, another format version or too large for this build)");}
+        fqmr_index n_verts = verts.size() / 3, n_faces = faces.size() / 3;
+        py::array_t<double> verts_np({n_verts, (fqmr_index)3});
+        py::array_t<fqmr_index> faces_np({n_faces, (fqmr_index)3});
+        if (n_verts) {memcpy(verts_np.mutable_data(), verts.data(), verts.size() * sizeof(double));}
+        if (n_faces) {memcpy(faces_np.mutable_data(), faces.data(), faces.size() * sizeof(fqmr_index));}
+        return py::make_tuple(verts_np, faces_np);
+    }
+
+    void optimizeMesh(int cache_size = 16, bool overdraw = true)
+    {
+        EngineLock lock;
+        use_threads();
+        optimize_vertex_cache(cache_size, overdraw);
+        optimize_vertex_fetch();
+    }
+
+    py::tuple buildClusterLOD(
+        int cluster_size = 128, 
+        int group_size = 4, 
+        int max_levels = 16, 
+        double aggressiveness = 7, 
+        int max_iterations = 100, 
+        bool verbose = false
+    ) {
+        EngineLock lock;
+        {
+            py::gil_scoped_release release;
+            use_threads();
+            build_cluster_lod(cluster_size, group_size, max_levels, aggressiveness, max_iterations, verbose);
+        }
+
+        py::list levels;
+        for (size_t l = 0; l < cluster_levels.size(); l++)
+        {
+            const ClusterLevel &level = cluster_levels[l];
+            fqmr_index n_verts = level.vertices.size(), n_faces = level.faces.size() / 3;
+            py::array_t<double> verts_np({n_verts, (fqmr_index)3});
+            py::array_t<fqmr_index> faces_np({n_faces, (fqmr_index)3});
+            double *verts = verts_np.mutable_data();
+            for (fqmr_index i = 0; i < n_verts; i++)
+            {
+                verts[i*3] = level.vertices[i].x;
+                verts[i*3+1] = level.vertices[i].y;
+                verts[i*3+2] = level.vertices[i].z;
+            }
+            if (n_faces) {memcpy(faces_np.mutable_data(), &level.faces[0], n_faces * 3 * sizeof(fqmr_index));}
+            levels.append(py::make_tuple(verts_np, faces_np));
+        }
+
+        int n_clusters = clusters.size();
+        py::array_t<int> level_np(n_clusters), group_np(n_clusters), parent_group_np(n_clusters);
+        py::array_t<fqmr_index> first_np(n_clusters), count_np(n_clusters);
+        py::array_t<double> error_np(n_clusters), parent_error_np(n_clusters), center_np({n_clusters, 3}), radius_np(n_clusters);
+        for (int i = 0; i < n_clusters; i++)
+        {
+            const Cluster &c = clusters[i];
+            level_np.mutable_at(i) = c.level;
+            first_np.mutable_at(i) = c.first;
+            count_np.mutable_at(i) = c.count;
+            group_np.mutable_at(i) = c.group;
+            parent_group_np.mutable_at(i) = c.parent_group;
+            error_np.mutable_at(i) = c.error;
+            parent_error_np.mutable_at(i) = c.parent_error;
+            center_np.mutable_at(i, 0) = c.center.x;
+            center_np.mutable_at(i, 1) = c.center.y;
+            center_np.mutable_at(i, 2) = c.center.z;
+            radius_np.mutable_at(i) = c.radius;
+        }
+        py::dict info;
+        info["level"] = level_np;
+        info["first"] = first_np;
+        info["count"] = count_np;
+        info["group"] = group_np;
+        info["parent_group"] = parent_group_np;
+        info["error"] = error_np;
+        info["parent_error"] = parent_error_np;
+        info["center"] = center_np;
+        info["radius"] = radius_np;
+
+        clusters.clear();
+        cluster_levels.clear();
+        return py::make_tuple(levels, info);
+    }
+
+    py::array_t<double> getVertexNormals(bool angle_weighted = false)
+    {
+        EngineLock lock;
+        use_threads();
+        std::vector<vec3f> normals;
+        vertex_normals(normals, angle_weighted);
+        fqmr_index n_verts = normals.size();
+        py::array_t<double> normals_np({n_verts, (fqmr_index)3});
+        double *out = normals_np.mutable_data();
+        loopi(0, n_verts)
+        {
+            out[i * 3] = normals[i].x;
+            out[i * 3 + 1] = normals[i].y;
+            out[i * 3 + 2] = normals[i].z;
+        }
+        return normals_np;
+    }
+
+    py::array_t<double> getVertexErrors()
+    {
+        EngineLock lock;
+        use_threads();
+        std::vector<double> errors;
+        vertex_errors(errors);
+        py::array_t<double> errors_np(errors.size());
+        if (!errors.empty()) {memcpy(errors_np.mutable_data(), &errors[0], errors.size() * sizeof(double));}
+        return errors_np;
+    }
+
+    // (N, 3) vertex and face arrays, faces in range of the vertices
+    void check_mesh_arrays(const py::array_t<double> &verts_np, const py::array_t<fqmr_index, py::array::c_style | py::array::forcecast> &faces_np)
+    {
+        if (verts_np.ndim() != 2 || verts_np.shape(1) != 3 || faces_np.ndim() != 2 || faces_np.shape(1) != 3) {throw std::invalid_argument("(N, 3) arrays expected");}
+        fqmr_index n_verts = verts_np.shape(0), n_faces = faces_np.shape(0);
+        const fqmr_index *faces = faces_np.data();
+        loopi(0, n_faces * 3)
+        {
+            if (faces[i] < 0 || faces[i] >= n_verts) {throw std::invalid_argument("face index out of range");}
+        }
+    }
+
+    py::dict meshDeviation(
+        py::array_t<double> verts_a, 
+        py::array_t<fqmr_index, py::array::c_style | py::array::forcecast> faces_a, 
+        py::array_t<double> verts_b, 
+        py::array_t<fqmr_index, py::array::c_style | py::array::forcecast> faces_b, 
+        fqmr_index samples = 100000, 
+        bool symmetric = true
+    ) {
+        /*
+        Distance between the surfaces of meshes a and b, independent of the
+        current mesh
+
+        Parameters
+        ----------
+        verts_a, faces_a : arrays
+            First mesh, typically the original
+        verts_b, faces_b : arrays
+            Second mesh, typically the simplified one
+        samples : int
+            Number of area samples per surface, on top of its vertices
+        symmetric : bool
+            Also measure from b to a
+
+        Returns
+        -------
+        dict
+            forward / backward : one-sided Hausdorff distances a->b, b->a
+            hausdorff : largest of both
+            mean, rms : over the samples of both directions
+            Distances towards a mesh without faces are inf.
+        */
+        check_mesh_arrays(verts_a, faces_a);
+        check_mesh_arrays(verts_b, faces_b);
+        std::vector<vec3f> pos_a(verts_a.shape(0)), pos_b(verts_b.shape(0));
+        auto va = verts_a.unchecked<2>();
+        auto vb = verts_b.unchecked<2>();
+        loopi(0, pos_a.size()) {pos_a[i] = vec3f(va(i, 0), va(i, 1), va(i, 2));}
+        loopi(0, pos_b.size()) {pos_b[i] = vec3f(vb(i, 0), vb(i, 1), vb(i, 2));}
+        std::vector<fqmr_index> tris_a(faces_a.data(), faces_a.data() + faces_a.size());
+        std::vector<fqmr_index> tris_b(faces_b.data(), faces_b.data() + faces_b.size());
+
+        DeviationStats forward, backward;
+        {
+            py::gil_scoped_release release;
+            use_threads();
+            mesh_deviation(pos_a, tris_a, pos_b, tris_b, samples, symmetric, forward, backward);
+        }
+
+        fqmr_index n = forward.samples + backward.samples;
+        py::dict result;
+        result["forward"] = forward.max;
+        result["backward"] = backward.max;
+        result["hausdorff"] = fmax(forward.max, backward.max);
+        result["mean"] = n ? (forward.sum + backward.sum) / n : 0.0;
+        result["rms"] = n ? sqrt((forward.sum_squared + backward.sum_squared) / n) : 0.0;
+        return result;
+    }
+
+    py::dict estimateMemory(
+        fqmr_index num_vertices, 
+        fqmr_index num_faces, 
+        fqmr_index target_count = 0, 
+        bool lossless = false, 
+        bool spatial_reorder = false, 
+        int cluster_grid = 0,
+        double valence = 0,
+        bool pair_contraction = false
+    ) {
+        /*
+        Upper bound of the engine memory for a simplification, in bytes
+
+        Parameters
+        ----------
+        valence : float
+            Mean number of faces per vertex, 3 * num_faces / num_vertices
+            if 0
+        pair_contraction : bool
+            The pair contraction pre-pass is used (pair_distance > 0)
+
+        Returns
+        -------
+        dict
+            vertices, triangles, refs, scratch and their sum peak. The
+            input and output arrays are not included.
+        */
+        MemoryEstimate m = estimate_memory(num_vertices, num_faces, target_count, lossless, spatial_reorder, cluster_grid, valence, pair_contraction);
+        py::dict result;
+        result["vertices"] = m.vertices;
+        result["triangles"] = m.triangles;
+        result["refs"] = m.refs;
+        result["scratch"] = m.scratch;
+        result["peak"] = m.peak;
+        return result;
+    }
+
+    double simplify_mesh_warpper(
+        fqmr_index target_count, 
         int update_rate = 5, 
         double aggressiveness = 7,
         double alpha = 1e-9, 
@@ -115,7 +617,10 @@ namespace Simplify {
         double threshold_lossless = 1e-4,
         bool lossless = false, 
         bool preserve_border = false, 
-        bool verbose = false
+        bool verbose = false,
+        int cluster_grid = 0,
+        double max_error = -1,
+        double pair_distance = 0
     ) {
         /* 
         Simplify mesh
@@ -126,16 +631,18 @@ namespace Simplify {
             Target number of triangles, not used if lossless is True
         update_rate : int
             Number of iterations between each update.
-            If lossless flag is set to True, rate is 1
+            Not used if lossless is True
         aggressiveness : float
             Parameter controlling the growth rate of the threshold at each
             iteration when lossless is False.
         max_iterations : int
-            Maximal number of iterations
+            Maximal number of iterations (rounds of the worklist if
+            lossless is True)
         verbose : bool
             control verbosity
         lossless : bool
-            Use the lossless simplification method
+            Use the lossless simplification method, collapsing all edges
+            below threshold_lossless
         threshold_lossless : float
             Maximal error after which a vertex is not deleted, only for
             lossless method.
@@ -145,12 +652,48 @@ namespace Simplify {
             Parameter for controlling the thresold growth
         preserve_border : Bool
             Flag for preserving vertices on open border
+        cluster_grid : int
+            If > 0, vertices are first clustered on a grid with this many
+            cells along the longest side of the bounding box, the QEM
+            pass then refines the clustered mesh. Speeds up extreme
+            reduction ratios, 0 disables the pre-pass.
+        max_error : float
+            If >= 0, quadric error bound : the threshold is capped to it and
+            the simplification stops once no edge below it can be
+            collapsed, even if target_count is not reached. Not used if
+            lossless is True
+        pair_distance : float
+            If > 0, vertex pairs closer than this distance are contracted
+            first, edges or not, which joins nearby parts and removes the
+            parts smaller than it (multi-part assemblies). 0 disables the
+            pre-pass.
+
+        Returns
+        -------
+        float
+            Largest quadric error of the collapses
 
         Note
         ----
         threshold = alpha*pow(iteration+K, agressiveness)
         */
-        simplify_mesh(
+        EngineLock lock;
+        use_threads();
+        if (cluster_grid > 0)
+        {
+            cluster_vertices(cluster_grid);
+            if (verbose) {
+                std::cout << "clustering - triangles " << triangles.size() << " vertices " << vertices.size() << std::endl;
+            }
+        }
+        if (pair_distance > 0 && !lossless)
+        {
+            contract_pairs(pair_distance, target_count);
+            if (verbose) {
+                std::cout << "pair contraction - triangles " << triangles.size() << " vertices " << vertices.size() << std::endl;
+            }
+        }
+        return simplify_mesh(
             target_count, 
             update_rate, 
             aggressiveness, 
@@ -160,14 +703,99 @@ namespace Simplify {
             threshold_lossless, 
             lossless, 
             preserve_border, 
-            verbose
+            verbose,
+            max_error
         );
     }
 }
 
-PYBIND11_MODULE(core, m) {
-    m.def("setMesh", &Simplify::setMesh, "Set mesh vertices and faces");
-    m.def("getMesh", &Simplify::getMesh, "Get mesh vertices and faces");
+// the 64-bit index build (FQMR_INDEX64) is a separate module, see setup.py
+#ifdef FQMR_INDEX64
+#define FQMR_MODULE core64
+#else
+#define FQMR_MODULE core
+#endif
+
+PYBIND11_MODULE(FQMR_MODULE, m) {
+    m.def("setMesh", &Simplify::setMesh, "Set mesh vertices and faces, optionally reordered along a Morton curve", 
+        py::arg("verts"),
+        py::arg("faces"),
+        py::arg("spatial_reorder") = false
+    );
+    m.def("setVertexWeights", &Simplify::setVertexWeights, "Per-vertex importance weights scaling the quadrics of the current mesh", 
+        py::arg("weights")
+    );
+    m.def("setNumThreads", &Simplify::setNumThreads, "Number of threads of the engine, 0 for the OpenMP default. Results do not depend on it", 
+        py::arg("num_threads") = 0
+    );
+    m.def("getNumThreads", &Simplify::getNumThreads, "Number of threads of the engine");
+    m.def("setExecutionPolicy", &Simplify::setExecutionPolicy, "Grain (minimum iterations per thread) and serial cutoffs by phase (None keeps a phase serial), phases not given are unchanged. Results do not depend on it", 
+        py::arg("grain") = 1,
+        py::arg("cutoffs") = py::dict()
+    );
+    m.def("getExecutionPolicy", &Simplify::getExecutionPolicy, "Grain and serial cutoffs by phase of the engine loops");
+    m.def("calibrateExecutionPolicy", &Simplify::calibrateExecutionPolicy, "Measure the serial cutoffs of this machine with the current threads and apply them. The current mesh is kept", 
+        py::arg("max_size") = 1 << 18
+    );
+    m.def("setMemoryOptions", &Simplify::setMemoryOptions, "Back the mesh arrays with transparent huge pages (Linux)", 
+        py::arg("huge_pages") = false
+    );
+    m.def("releaseMemory", &Simplify::releaseMemory, "Free the mesh and the scratch memory kept between calls");
+    m.def("prepareMesh", &Simplify::prepareMesh, "Initialize borders, quadrics and edge errors of the current mesh ahead of the simplification", 
+        py::call_guard<py::gil_scoped_release>()
+    );
+    m.def("saveState", &Simplify::saveState, "Save the current mesh and its simplifier state to a binary snapshot", 
+        py::arg("path"),
+        py::call_guard<py::gil_scoped_release>()
+    );
+    m.def("loadState", &Simplify::loadState, "Replace the current mesh by a snapshot written by saveState", 
+        py::arg("path"),
+        py::call_guard<py::gil_scoped_release>()
+    );
+    m.def("getMesh", &Simplify::getMesh, "Get mesh vertices and faces, optionally in the input order", 
+        py::arg("original_order") = false
+    );
+    m.def("getEncodedMesh", &Simplify::getEncodedMesh, "Current mesh in a compact quantized and entropy coded encoding", 
+        py::arg("bits") = 16,
+        py::arg("original_order") = false
+    );
+    m.def("encodeMesh", &Simplify::encodeMesh, "Encode a mesh given as arrays", 
+        py::arg("verts"),
+        py::arg("faces"),
+        py::arg("bits") = 16
+    );
+    m.def("beginEditSession", &Simplify::beginEditSession, "Simplify the current mesh keeping the source map of an edit session", 
+        py::arg("target_count"),
+        py::arg("update_rate") = 5, 
+        py::arg("aggressiveness") = 7,
+        py::arg("alpha") = 1e-9, 
+        py::arg("K") = 3, 
+        py::arg("max_iterations") = 100,
+        py::arg("preserve_border") = false,
+        py::arg("verbose") = false,
+        py::arg("max_error") = -1
+    );
+    m.def("resimplifyMesh", &Simplify::resimplifyMesh, "Re-simplify the region of the edit session output covered by changed source faces", 
+        py::arg("verts"),
+        py::arg("faces"),
+        py::arg("changed_faces")
+    );
+    m.def("decodeMesh", &Simplify::decodeMesh, "Decode a mesh encoded by getEncodedMesh or encodeMesh", 
+        py::arg("data")
+    );
+    m.def("optimizeMesh", &Simplify::optimizeMesh, "Reorder faces for the vertex cache and overdraw, then vertices for fetch locality", 
+        py::arg("cache_size") = 16,
+        py::arg("overdraw") = true,
+        py::call_guard<py::gil_scoped_release>()
+    );
+    m.def("buildClusterLOD", &Simplify::buildClusterLOD, "Build a DAG of cluster LODs from the current mesh", 
+        py::arg("cluster_size") = 128,
+        py::arg("group_size") = 4,
+        py::arg("max_levels") = 16,
+        py::arg("aggressiveness") = 7,
+        py::arg("max_iterations") = 100,
+        py::arg("verbose") = false
+    );
     m.def("simplify_mesh_warpper", &Simplify::simplify_mesh_warpper, "Simplify mesh", 
         py::arg("target_count"),
         py::arg("update_rate") = 5, 
@@ -178,8 +806,35 @@ PYBIND11_MODULE(core, m) {
         py::arg("threshold_lossless") = 1e-4, 
         py::arg("lossless") = false,
         py::arg("preserve_border") = false, 
-        py::arg("verbose") = false
+        py::arg("verbose") = false,
+        py::arg("cluster_grid") = 0,
+        py::arg("max_error") = -1,
+        py::arg("pair_distance") = 0,
+        py::call_guard<py::gil_scoped_release>()
+    );
+    m.def("getVertexNormals", &Simplify::getVertexNormals, "Normals of the vertices of the current mesh, area or angle weighted", 
+        py::arg("angle_weighted") = false
+    );
+    m.def("getVertexErrors", &Simplify::getVertexErrors, "Quadric error of every vertex of the current mesh");
+    m.def("meshDeviation", &Simplify::meshDeviation, "Hausdorff distance and RMS deviation between two meshes", 
+        py::arg("verts_a"),
+        py::arg("faces_a"),
+        py::arg("verts_b"),
+        py::arg("faces_b"),
+        py::arg("samples") = 100000,
+        py::arg("symmetric") = true
+    );
+    m.def("estimateMemory", &Simplify::estimateMemory, "Upper bound of the engine memory for a simplification", 
+        py::arg("num_vertices"),
+        py::arg("num_faces"),
+        py::arg("target_count") = 0,
+        py::arg("lossless") = false,
+        py::arg("spatial_reorder") = false,
+        py::arg("cluster_grid") = 0,
+        py::arg("valence") = 0,
+        py::arg("pair_contraction") = false
     );
+  m.attr("engine_version") = Simplify::engine_version;
 #ifdef VERSION_INFO
   m.attr("__version__") = MACRO_STRINGIFY(VERSION_INFO);
 #else
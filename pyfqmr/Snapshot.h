@@ -0,0 +1,193 @@
+/////////////////////////////////////////////
+//
+// Snapshot of the simplifier state
+//
+// Saves vertices (with quadrics and borders), triangles (with edge
+// errors) and refs to a binary file, so that a mesh prepared once by
+// prepare_mesh() can be simplified again with other parameters without
+// repeating the initialization.
+//
+// Layout : SnapshotHeader, then the raw Vertex, Triangle and Ref arrays.
+// The arrays are copied as is, a snapshot can only be read back by a
+// build with the same index type and struct layout (checked on load,
+// with the sizes and the indices of the arrays).
+// Files are memory mapped on load, Windows falls back to fread.
+//
+// License : MIT
+// http://opensource.org/licenses/MIT
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "Simplify.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Simplify
+{
+    struct SnapshotHeader
+    {
+        char magic[8];                 // "FQMRSNAP"
+        unsigned int version;
+        unsigned int index_size;       // sizeof(fqmr_index)
+        unsigned int vertex_size, triangle_size, ref_size;
+        unsigned int prepared;         // mesh_prepared when saved
+        unsigned long long num_vertices, num_triangles, num_refs;
+    };
+
+    const unsigned int snapshot_version = 2; // 2 : collapse positions in Triangle
+
+    void snapshot_header(SnapshotHeader &h)
+    {
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, "FQMRSNAP", 8);
+        h.version = snapshot_version;
+        h.index_size = sizeof(fqmr_index);
+        h.vertex_size = sizeof(Vertex);
+        h.triangle_size = sizeof(Triangle);
+        h.ref_size = sizeof(Ref);
+        h.prepared = mesh_prepared;
+        h.num_vertices = vertices.size();
+        h.num_triangles = triangles.size();
+        h.num_refs = refs.size();
+    }
+
+    // Write the current state to path. Returns false on I/O errors.
+    bool save_state(const char *path)
+    {
+        FILE *file = fopen(path, "wb");
+        if (!file) {return false;}
+        SnapshotHeader h;
+        snapshot_header(h);
+        bool ok = fwrite(&h, sizeof(h), 1, file) == 1;
+        if (ok && h.num_vertices) {ok = fwrite(&vertices[0], sizeof(Vertex), vertices.size(), file) == vertices.size();}
+        if (ok && h.num_triangles) {ok = fwrite(&triangles[0], sizeof(Triangle), triangles.size(), file) == triangles.size();}
+        if (ok && h.num_refs) {ok = fwrite(&refs[0], sizeof(Ref), refs.size(), file) == refs.size();}
+        if (fclose(file) != 0) {ok = false;}
+        return ok;
+    }
+
+    // Check a header read from a file of size bytes against this build
+    bool snapshot_compatible(const SnapshotHeader &h, unsigned long long size)
+    {
+        SnapshotHeader expected;
+        snapshot_header(expected);
+        if (memcmp(h.magic, expected.magic, 8) != 0 || h.version != expected.version) {return false;}
+        if (h.index_size != expected.index_size || h.vertex_size != expected.vertex_size) {return false;}
+        if (h.triangle_size != expected.triangle_size || h.ref_size != expected.ref_size) {return false;}
+        // the counts come from the file : sizes checked without overflow
+        unsigned long long limit = sizeof(fqmr_index) < sizeof(long long) ? INT_MAX : LLONG_MAX;
+        if (h.num_vertices > limit || h.num_triangles > limit || h.num_refs > limit || size < sizeof(h)) {return false;}
+        unsigned long long rest = size - sizeof(h);
+        if (h.num_vertices > rest / sizeof(Vertex)) {return false;}
+        rest -= h.num_vertices * sizeof(Vertex);
+        if (h.num_triangles > rest / sizeof(Triangle)) {return false;}
+        rest -= h.num_triangles * sizeof(Triangle);
+        return h.num_refs <= rest / sizeof(Ref) && rest == h.num_refs * sizeof(Ref);
+    }
+
+    // Check the indices of the arrays that follow a compatible header :
+    // triangle corners index the vertices and, once prepared, the vertex
+    // ranges index the refs, which index the triangles
+    bool snapshot_valid(const SnapshotHeader &h, const char *data)
+    {
+        const Vertex *v = (const Vertex *)data;
+        const Triangle *t = (const Triangle *)(data + h.num_vertices * sizeof(Vertex));
+        const Ref *r = (const Ref *)(data + h.num_vertices * sizeof(Vertex) + h.num_triangles * sizeof(Triangle));
+        fqmr_index num_v = h.num_vertices, num_f = h.num_triangles, num_r = h.num_refs;
+        bool valid = true;
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, num_f)) reduction(&&:valid)
+        loopi(0, num_f)
+        {
+            loopj(0, 3)
+            {
+                if (t[i].v[j] < 0 || t[i].v[j] >= num_v) {valid = false;}
+            }
+        }
+        if (!valid || !h.prepared) {return valid;}
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, num_v)) reduction(&&:valid)
+        loopi(0, num_v)
+        {
+            if (v[i].tstart < 0 || v[i].tcount < 0 || v[i].tstart > num_r || v[i].tcount > num_r - v[i].tstart) {valid = false;}
+        }
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, num_r)) reduction(&&:valid)
+        loopi(0, num_r)
+        {
+            if (r[i].tid < 0 || r[i].tid >= num_f || r[i].tvertex < 0 || r[i].tvertex > 2) {valid = false;}
+        }
+        return valid;
+    }
+
+    // Copy the arrays that follow the header into the current state
+    void snapshot_restore(const SnapshotHeader &h, const char *data)
+    {
+        resize_array(vertices, h.num_vertices);
+        resize_array(triangles, h.num_triangles);
+        resize_array(refs, h.num_refs);
+        if (h.num_vertices) {memcpy((void *)&vertices[0], data, h.num_vertices * sizeof(Vertex));}
+        data += h.num_vertices * sizeof(Vertex);
+        if (h.num_triangles) {memcpy((void *)&triangles[0], data, h.num_triangles * sizeof(Triangle));}
+        data += h.num_triangles * sizeof(Triangle);
+        if (h.num_refs) {memcpy((void *)&refs[0], data, h.num_refs * sizeof(Ref));}
+        mesh_prepared = h.prepared != 0;
+        quadrics_preset = false;
+        vertex_locked.clear();
+        vertex_weights.clear(); // of the previous mesh, prepared snapshots store weighted quadrics
+    }
+
+    // Replace the current state by the snapshot in path. Returns false if
+    // the file cannot be read, is corrupt or was written by an incompatible
+    // build, the current state is then left untouched.
+    bool load_state(const char *path)
+    {
+#ifndef _WIN32
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {return false;}
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (unsigned long long)st.st_size < sizeof(SnapshotHeader))
+        {
+            close(fd);
+            return false;
+        }
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) {return false;}
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+        const SnapshotHeader &h = *(const SnapshotHeader *)map;
+        const char *data = (const char *)map + sizeof(SnapshotHeader);
+        bool ok = snapshot_compatible(h, st.st_size) && snapshot_valid(h, data);
+        if (ok) {snapshot_restore(h, data);}
+        munmap(map, st.st_size);
+        return ok;
+#else
+        FILE *file = fopen(path, "rb");
+        if (!file) {return false;}
+        std::vector<char> data;
+        if (fseek(file, 0, SEEK_END) == 0)
+        {
+            long size = ftell(file);
+            if (size >= (long)sizeof(SnapshotHeader))
+            {
+                data.resize(size);
+                rewind(file);
+                if (fread(&data[0], 1, size, file) != (size_t)size) {data.clear();}
+            }
+        }
+        fclose(file);
+        if (data.empty()) {return false;}
+
+        const SnapshotHeader &h = *(const SnapshotHeader *)&data[0];
+        bool ok = snapshot_compatible(h, data.size()) && snapshot_valid(h, &data[0] + sizeof(SnapshotHeader));
+        if (ok) {snapshot_restore(h, &data[0] + sizeof(SnapshotHeader));}
+        return ok;
+#endif
+    }
+};
+
+#endif // SNAPSHOT_H
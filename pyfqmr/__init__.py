@@ -1,9 +1,98 @@
 # from .Simplify import *
+import socket
+import struct
+import threading
 import time
+from concurrent.futures import ThreadPoolExecutor
 import numpy as np
 from . import core as _C
+from .cache import SimplifyCache
 
-def simplify(verts, faces, target_count=200000, aggressiveness=4, preserve_border=True, max_iterations=50, verbose=True):
+_INT32_MAX = np.iinfo(np.int32).max
+
+# serializes the sequences of calls that use the global mesh of the engine
+# (setMesh, simplification, getMesh); each call of the module on its own is
+# serialized by the engine mutex of Simplify_pyapi.cpp
+_engine_lock = threading.RLock()
+_executor = None
+_num_threads = 0
+_policy = None
+_edit_core = None
+
+
+def _core_for(verts, faces):
+    """
+    Pick the extension module for a mesh and cast the faces to its index type.
+
+    Meshes with more vertices or face corners than fit in 32 bits use the
+    core64 build (64-bit indices), the others keep the smaller core build.
+    """
+    if max(verts.shape[0], faces.shape[0] * 3) > _INT32_MAX:
+        from . import core64
+        _configure(core64)
+        return core64, faces.astype(np.int64)
+    return _C, faces.astype(np.int32)
+
+
+def _configure(core):
+    """
+    Apply the number of threads and the execution policy set through this
+    module to an extension module (core64 is loaded on demand).
+    """
+    core.setNumThreads(_num_threads)
+    if _policy is not None:
+        core.setExecutionPolicy(_policy["grain"], _policy["cutoffs"])
+
+
+def _check_mesh(verts, faces):
+    """
+    Vertices and faces as (n, 3) arrays, with the face indices in range,
+    before any cast to the index type of a module.
+    """
+    verts = np.asarray(verts)
+    faces = np.asarray(faces)
+    if verts.ndim != 2 or verts.shape[1] != 3 or faces.ndim != 2 or faces.shape[1] != 3:
+        raise ValueError("vertices and faces must be (n, 3) arrays")
+    if not np.issubdtype(faces.dtype, np.integer):
+        raise ValueError("face indices must be integers")
+    if faces.size and (faces.min() < 0 or faces.max() >= verts.shape[0]):
+        raise ValueError("face index out of range")
+    return verts, faces
+
+
+def _core_for_state(path):
+    """
+    Pick the extension module that wrote a snapshot, from the index size
+    stored in its header (see Snapshot.h).
+    """
+    with open(path, "rb") as f:
+        header = f.read(16)
+    if len(header) == 16 and header[:8] == b"FQMRSNAP" and int.from_bytes(header[12:16], "little") == 8:
+        from . import core64
+        _configure(core64)
+        return core64
+    return _C
+
+
+def prepare_state(verts, faces, path, spatial_reorder=False):
+    """
+    Initialize the simplifier on a mesh (borders, quadrics, edge errors) and
+    save the result to a snapshot file, to be passed as state to simplify.
+
+    Parameters:
+        verts (numpy.ndarray): Vertices of the mesh.
+        faces (numpy.ndarray): Faces of the mesh.
+        path (str): Snapshot file to write.
+        spatial_reorder (bool): Reorder vertices and faces along a Morton curve first.
+    """
+    C, faces_idx = _core_for(verts, faces)
+    with _engine_lock:
+        C.setMesh(verts.astype(np.float64), faces_idx, spatial_reorder)
+        C.prepareMesh()
+        C.saveState(path)
+
+
+def simplify(verts, faces, target_count=200000, aggressiveness=4, preserve_border=True, max_iterations=50, verbose=True, cluster_grid=0, spatial_reorder=False, original_order=False, optimize_order=False, max_error=None, return_error=False, state=None, cache=None, vertex_weights=None, normals=None, pair_distance=0):
     """
     Simplify a mesh using the fqmr algorithm.
 
@@ -15,43 +104,692 @@ def simplify(verts, faces, target_count=200000, aggressiveness=4, preserve_borde
         preserve_border (bool): Whether to preserve border edges.
         verbose (bool): Whether to print progress information.
         max_iterations (int): Maximum number of iterations for simplification.
+        cluster_grid (int): Grid resolution of the vertex clustering pre-pass, 0 disables it.
+        spatial_reorder (bool): Reorder vertices and faces along a Morton curve after loading, for memory locality.
+        original_order (bool): Return vertices and faces in the relative order of the input.
+        optimize_order (bool): Reorder the output for the GPU vertex cache, overdraw and vertex fetch.
+            Cannot be combined with original_order.
+        max_error (float): Quadric error bound (squared distance units). Simplification stops once
+            no edge below it can be collapsed; target_count still bounds the face count from
+            below, pass 0 to let the error alone decide. None disables it.
+        return_error (bool): Also return the achieved error and the per-vertex errors.
+        state (str): Snapshot written by prepare_state. The mesh is loaded from it instead of
+            verts and faces (which may be None), skipping the initialization. spatial_reorder
+            is then ignored, the snapshot keeps the order it was prepared with.
+        cache (SimplifyCache or str): Result cache (or its directory). Calls with the same input
+            buffers (or snapshot file) and parameters return the stored result, memory mapped and
+            read only, without running the engine.
+        vertex_weights (numpy.ndarray): Importance of each vertex (>= 0, 1 is neutral), scaling its
+            quadric: regions with weights > 1 keep more of the triangle budget, < 1 less. Errors
+            (max_error, the returned errors) are then weighted. Not available with state.
+        normals (str): Also return vertex normals of the output, computed from the final
+            positions and weighted by face "area" or corner "angle". None skips them.
+        pair_distance (float): Contract vertex pairs closer than this distance first, edges or
+            not: nearby parts of an assembly are welded and parts smaller than it vanish, so
+            meshes of many small components reach target_count. 0 disables it.
 
     Returns:
-        tuple: Simplified vertices and faces.
+        tuple: Simplified vertices and faces. With return_error, also the largest quadric
+        error of the collapses and an array with the quadric error of every output vertex.
+        With normals, the vertex normals come last.
     """
-    t0 = time.time()
-    _C.setMesh(verts.astype(np.float64), faces.astype(np.int32))
-    t1 = time.time()
-    if verbose:
-        print(f"Time taken to set mesh: {t1 - t0:.4f} seconds")
-
-    t0 = time.time()
-    _C.simplify_mesh_warpper(
-        target_count = target_count, 
-        update_rate = 5, 
-        aggressiveness = aggressiveness,
-        alpha = 1e-9, 
-        K = 3, 
-        max_iterations = max_iterations,
-        threshold_lossless = 1e-4,
-        lossless = False, 
-        preserve_border = preserve_border, 
-        verbose = verbose,
-    )
-    t1 = time.time()
+    if optimize_order and original_order:
+        raise ValueError("optimize_order and original_order are mutually exclusive")
+    if normals not in (None, "area", "angle"):
+        raise ValueError("normals must be None, 'area' or 'angle'")
 
-    if verbose:
-        print(f"Time taken for simplification: {t1 - t0:.4f} seconds")
+    if state is not None:
+        if vertex_weights is not None:
+            raise ValueError("vertex_weights cannot be applied to a prepared state")
+        C = _core_for_state(state)
+    else:
+        C, faces_idx = _core_for(verts, faces)
+        verts = verts.astype(np.float64)
+    if vertex_weights is not None:
+        vertex_weights = np.ascontiguousarray(vertex_weights, dtype=np.float64)
+
+    if cache is not None:
+        if not isinstance(cache, SimplifyCache):
+            cache = SimplifyCache(cache)
+        params = dict(
+            target_count=target_count, aggressiveness=aggressiveness, preserve_border=preserve_border,
+            max_iterations=max_iterations, cluster_grid=cluster_grid, spatial_reorder=spatial_reorder,
+            original_order=original_order, optimize_order=optimize_order, max_error=max_error,
+            normals=normals, pair_distance=pair_distance, module=C.__name__, engine_version=C.engine_version,
+        )
+        if state is not None:
+            key = cache.file_key(state, params)
+        else:
+            key = cache.key((verts, faces_idx) + ((vertex_weights,) if vertex_weights is not None else ()), params)
+        hit = cache.get(key)
+        if hit is not None:
+            if verbose:
+                print(f"Cache hit {key}: {hit['faces'].shape[0]} faces, {hit['verts'].shape[0]} vertices")
+            result = (hit["verts"], hit["faces"])
+            if return_error:
+                result += (hit["error"], hit["vertex_errors"])
+            if normals is not None:
+                result += (hit["normals"],)
+            return result
+
+    # the engine state is global : one mesh at a time, the native calls
+    # release the GIL
+    with _engine_lock:
+        t0 = time.time()
+        if state is not None:
+            C.loadState(state)
+        else:
+            C.setMesh(verts, faces_idx, spatial_reorder)
+            if vertex_weights is not None:
+                C.setVertexWeights(vertex_weights)
+        t1 = time.time()
+        if verbose:
+            print(f"Time taken to set mesh: {t1 - t0:.4f} seconds")
 
-    t0 = time.time()
-    res_verts, res_faces, _ = _C.getMesh()
+        t0 = time.time()
+        error = C.simplify_mesh_warpper(
+            target_count = target_count, 
+            update_rate = 5, 
+            aggressiveness = aggressiveness,
+            alpha = 1e-9, 
+            K = 3, 
+            max_iterations = max_iterations,
+            threshold_lossless = 1e-4,
+            lossless = False, 
+            preserve_border = preserve_border, 
+            verbose = verbose,
+            cluster_grid = cluster_grid,
+            max_error = -1 if max_error is None else max_error,
+            pair_distance = pair_distance,
+        )
+        t1 = time.time()
+
+        if verbose:
+            print(f"Time taken for simplification: {t1 - t0:.4f} seconds")
+
+        t0 = time.time()
+        if optimize_order:
+            C.optimizeMesh()
+        res_verts, res_faces, _ = C.getMesh(original_order)
+        if return_error or cache is not None:
+            vertex_errors = C.getVertexErrors()
+        if normals is not None:
+            res_normals = C.getVertexNormals(normals == "angle")
+    if cache is not None:
+        arrays = dict(verts=res_verts, faces=res_faces, vertex_errors=vertex_errors)
+        if normals is not None:
+            arrays["normals"] = res_normals
+        cache.put(key, arrays, dict(error=error))
     t1 = time.time()
 
     if verbose:
         print(f"Time taken to get mesh: {t1 - t0:.4f} seconds")
 
     if verbose:
-        print(f"Original mesh: {faces.shape[0]} faces, {verts.shape[0]} vertices")
-        print(f"Simplified mesh: {res_faces.shape[0]} faces, {res_verts.shape[0]} vertices")
+        if faces is not None:
+            print(f"Original mesh: {faces.shape[0]} faces, {verts.shape[0]} vertices")
+        print(f"Simplified mesh: {res_faces.shape[0]} faces, {res_verts.shape[0]} vertices, max error {error:g}")
+
+    result = (res_verts, res_faces)
+    if return_error:
+        result += (error, vertex_errors)
+    if normals is not None:
+        result += (res_normals,)
+    return result
+
+
+def encode(verts, faces, bits=16):
+    """
+    Compact binary encoding of a mesh, for storage and transfer: positions
+    quantized to bits per coordinate over the bounding box, then entropy
+    coded vertex and index streams (see Encode.h). Meshes ordered by
+    simplify(..., optimize_order=True) compress best.
+
+    Parameters:
+        verts (numpy.ndarray): Vertices of the mesh.
+        faces (numpy.ndarray): Faces of the mesh.
+        bits (int): Quantization bits per coordinate, 1 to 30. The position
+            error is at most half the bounding box extent / (2^bits - 1).
+
+    Returns:
+        bytes: The encoded mesh, read back by decode.
+    """
+    verts = np.asarray(verts, dtype=np.float64)
+    C, faces_idx = _core_for(verts, np.asarray(faces))
+    return C.encodeMesh(verts, faces_idx, bits)
+
+
+def decode(data):
+    """
+    Vertices and faces of a mesh encoded by encode (or getEncodedMesh).
+
+    Parameters:
+        data (bytes): The encoded mesh.
+
+    Returns:
+        tuple: Vertices (float64) and faces, int64 for meshes beyond 2^31
+        vertices and int32 otherwise.
+    """
+    C = _C
+    # number of vertices in the header, see EncodedHeader
+    if len(data) >= 24 and int.from_bytes(data[16:24], "little") > _INT32_MAX:
+        from . import core64 as C
+    return C.decodeMesh(data)
+
+# output to input face ratios of the calibration runs, and the run time
+# models fitted by calibrate, keyed by the simplify parameters
+_CALIBRATION_RATIOS = (1.0, 0.5, 0.2, 0.05, 0.01, 0.002)
+_cost_models = {}
+
+
+def _calibration_mesh(num_faces):
+    """
+    Closed torus of about num_faces triangles with a noisy surface, as a
+    stand-in for scanned meshes.
+    """
+    n = max(int(np.sqrt(num_faces / 2)), 8)
+    u, v = np.meshgrid(np.linspace(0, 2 * np.pi, n, endpoint=False), np.linspace(0, 2 * np.pi, n, endpoint=False), indexing="ij")
+    r = 0.3 * (1 + 0.05 * np.sin(7 * u) * np.cos(13 * v) + 0.002 * np.random.default_rng(0).standard_normal(u.shape))
+    verts = np.stack([(1 + r * np.cos(v)) * np.cos(u), (1 + r * np.cos(v)) * np.sin(u), r * np.sin(v)], axis=-1).reshape(-1, 3)
+    i, j = np.meshgrid(np.arange(n), np.arange(n), indexing="ij")
+    a = i * n + j
+    b = (i + 1) % n * n + j
+    c = (i + 1) % n * n + (j + 1) % n
+    d = i * n + (j + 1) % n
+    faces = np.concatenate([np.stack([a, b, c], axis=-1).reshape(-1, 3), np.stack([a, c, d], axis=-1).reshape(-1, 3)])
+    return verts, faces
+
+
+def calibrate(aggressiveness=4, preserve_border=True, max_iterations=50, cluster_grid=0, spatial_reorder=False, optimize_order=False, num_faces=100000):
+    """
+    Measure the run time model of estimate for a set of simplify parameters.
+
+    A synthetic mesh of num_faces triangles is simplified on this machine
+    (with the current number of OpenMP threads) to several face ratios;
+    estimate interpolates the time per input face between them, linearly in
+    the logarithm of the ratio. estimate calls this on the first use of a
+    parameter set, it takes about a second.
+
+    Parameters:
+        num_faces (int): Size of the calibration mesh.
+        Others: same as simplify.
+
+    Returns:
+        tuple: The ratios and the seconds per input face at each of them.
+    """
+    key = (aggressiveness, preserve_border, max_iterations, cluster_grid, spatial_reorder, optimize_order)
+    verts, faces = _calibration_mesh(num_faces)
+    costs = []
+    for ratio in _CALIBRATION_RATIOS:
+        t0 = time.perf_counter()
+        simplify(verts, faces, target_count=int(faces.shape[0] * ratio), aggressiveness=aggressiveness,
+                 preserve_border=preserve_border, max_iterations=max_iterations, verbose=False,
+                 cluster_grid=cluster_grid, spatial_reorder=spatial_reorder, optimize_order=optimize_order)
+        costs.append((time.perf_counter() - t0) / faces.shape[0])
+    _cost_models[key] = (_CALIBRATION_RATIOS, tuple(costs))
+    return _cost_models[key]
+
+
+def _sample_topology(faces, num_vertices, samples=4096):
+    """
+    Mean valence (faces per vertex) and fraction of border edges, measured
+    exactly around a random sample of vertices.
+    """
+    picked = np.zeros(num_vertices, dtype=bool)
+    picked[np.random.default_rng(0).choice(num_vertices, min(samples, num_vertices), replace=False)] = True
+    touching = faces[picked[faces].any(axis=1)]
+    if touching.shape[0] == 0:
+        return 0.0, 0.0
+    valence = np.count_nonzero(picked[touching]) / np.count_nonzero(picked[np.unique(touching)])
+    # every face of an edge with a picked end is in touching
+    edges = np.sort(touching[:, [0, 1, 1, 2, 2, 0]].reshape(-1, 2), axis=1)
+    edges = edges[picked[edges].any(axis=1)]
+    _, counts = np.unique(edges, axis=0, return_counts=True)
+    return valence, np.count_nonzero(counts == 1) / counts.shape[0]
+
+
+def estimate(verts, faces, target_count=200000, aggressiveness=4, preserve_border=True, max_iterations=50, cluster_grid=0, spatial_reorder=False, optimize_order=False, return_error=False, calibrate_model=True, pair_distance=0):
+    """
+    Predict the peak memory and the run time of simplify, before running it.
+
+    Memory is an upper bound from the struct sizes of the build and the
+    growth of the engine arrays (a fresh process, see release_memory), plus
+    the copies of the inputs and the outputs. Run time comes from the
+    calibrated cost model (see calibrate) and assumes the target is reached;
+    max_error can only make the call faster.
+
+    Parameters:
+        verts (numpy.ndarray or int): Vertices of the mesh, or their number.
+        faces (numpy.ndarray or int): Faces of the mesh, or their number. With the
+            arrays, a sample of the vertices gives the valence and the border
+            edges (which preserve_border keeps, bounding the output from below).
+        calibrate_model (bool): Calibrate the run time model for these parameters
+            if it is not yet. Otherwise the time is None without a model.
+        pair_distance (float): Counted in the memory bound only, the run time
+            model does not cover the pair contraction.
+        Others: same as simplify.
+
+    Returns:
+        dict: peak_bytes, engine (dict of estimateMemory), seconds and the
+        predicted output face count.
+    """
+    if isinstance(verts, np.ndarray):
+        faces = np.asarray(faces)
+        num_vertices, num_faces = verts.shape[0], faces.shape[0]
+        valence, border = _sample_topology(faces, num_vertices)
+    else:
+        num_vertices, num_faces = int(verts), int(faces)
+        valence, border = 0.0, 0.0
+    C = _C
+    if max(num_vertices, num_faces * 3) > _INT32_MAX:
+        from . import core64 as C
+    index_size = 8 if C is not _C else 4
+
+    output_faces = min(max(target_count, 0), num_faces)
+    if preserve_border:
+        # about 1.5 edges per face, a border edge keeps its face
+        output_faces = max(output_faces, min(int(border * 1.5 * num_faces), num_faces))
+
+    engine = C.estimateMemory(num_vertices, num_faces, output_faces, False, spatial_reorder, cluster_grid, valence, pair_distance > 0)
+    output_vertices = output_faces // 2 + 2
+    inputs = num_vertices * 24 + num_faces * 3 * index_size
+    outputs = output_vertices * (24 + (8 if return_error else 0)) + output_faces * 3 * index_size
+
+    seconds = None
+    key = (aggressiveness, preserve_border, max_iterations, cluster_grid, spatial_reorder, optimize_order)
+    if key not in _cost_models and calibrate_model:
+        calibrate(*key)
+    if key in _cost_models and num_faces > 0:
+        ratios, costs = _cost_models[key]
+        ratio = max(output_faces / num_faces, 1e-9)
+        # np.interp needs increasing abscissas
+        seconds = num_faces * float(np.interp(-np.log(ratio), -np.log(ratios), costs))
+
+    return dict(
+        peak_bytes=engine["peak"] + inputs + outputs,
+        engine=engine,
+        seconds=seconds,
+        output_faces=output_faces,
+    )
+
+
+def build_cluster_lod(verts, faces, cluster_size=128, group_size=4, max_levels=16, aggressiveness=7, max_iterations=100, verbose=False):
+    """
+    Build a DAG of cluster LODs for virtualized geometry rendering.
+
+    The mesh is partitioned into clusters of about cluster_size triangles.
+    Groups of group_size neighbouring clusters are simplified to half of
+    their triangles with their outline locked, then split into new clusters,
+    level after level.
+
+    Parameters:
+        verts (numpy.ndarray): Vertices of the mesh.
+        faces (numpy.ndarray): Faces of the mesh.
+        cluster_size (int): Target number of triangles per cluster.
+        group_size (int): Number of clusters simplified together.
+        max_levels (int): Maximum number of levels, including the input mesh.
+        aggressiveness (int): Aggressiveness of the simplification.
+        max_iterations (int): Maximum number of iterations per level.
+        verbose (bool): Whether to print progress information.
+
+    Returns:
+        tuple: (levels, clusters). levels is a list of (vertices, faces) per
+        level, faces sorted by cluster. clusters is a dict of arrays with one
+        entry per cluster: level, first and count (face range in its level),
+        group (group it is simplified in, -1 for roots), parent_group (group
+        it was built from, -1 at level 0), error and parent_error (distance
+        units, monotonic along the DAG), center and radius (bounding sphere).
+    """
+    C, faces_idx = _core_for(verts, faces)
+    with _engine_lock:
+        C.setMesh(verts.astype(np.float64), faces_idx)
+        return C.buildClusterLOD(
+            cluster_size = cluster_size,
+            group_size = group_size,
+            max_levels = max_levels,
+            aggressiveness = aggressiveness,
+            max_iterations = max_iterations,
+            verbose = verbose,
+        )
+
+
+def begin_edit_session(verts, faces, target_count=200000, aggressiveness=4, preserve_border=True, max_iterations=50, max_error=None, verbose=False):
+    """
+    Simplify a mesh that is going to be edited, keeping for every source
+    vertex the output vertex it was collapsed into, so that resimplify
+    only rebuilds the edited regions afterwards. One session at a time,
+    other calls of the module do not end it.
+
+    Parameters:
+        verts (numpy.ndarray): Vertices of the source mesh.
+        faces (numpy.ndarray): Faces of the source mesh.
+        target_count (int): Target number of triangles.
+        aggressiveness (int): Aggressiveness of the simplification.
+        preserve_border (bool): Whether to preserve border edges.
+        max_iterations (int): Maximum number of iterations for simplification.
+        max_error (float): Quadric error bound as in simplify. The edited regions are
+            simplified to it, or to the error reached by this call when None.
+        verbose (bool): Whether to print progress information.
 
+    Returns:
+        tuple: Simplified vertices and faces.
+    """
+    global _edit_core
+    C, faces_idx = _core_for(verts, faces)
+    with _engine_lock:
+        C.setMesh(verts.astype(np.float64), faces_idx)
+        C.beginEditSession(
+            target_count = target_count,
+            aggressiveness = aggressiveness,
+            max_iterations = max_iterations,
+            preserve_border = preserve_border,
+            verbose = verbose,
+            max_error = -1 if max_error is None else max_error,
+        )
+        _edit_core = C
+        res_verts, res_faces, _ = C.getMesh(False)
     return res_verts, res_faces
+
+
+def resimplify(verts, faces, changed_faces, return_stats=False):
+    """
+    Update the simplification of the edit session after an edit of the
+    source mesh. Only the part of the output that the changed faces had
+    collapsed into is simplified again, from the source, to the error level
+    of the session; the rest of the output is kept, its outline locked.
+
+    Source vertices keep their indices, new ones are appended. Faces may be
+    added, modified or removed; list the faces whose vertices moved too,
+    and for removed faces a remaining face that shared one of their
+    vertices.
+
+    Parameters:
+        verts (numpy.ndarray): Vertices of the edited source mesh.
+        faces (numpy.ndarray): Faces of the edited source mesh.
+        changed_faces (numpy.ndarray): Indices in faces of the new, modified or moved faces.
+        return_stats (bool): Also return a dict with the number of output vertices rebuilt
+            (region_vertices), of source faces simplified again (patch_faces) and the error
+            of their collapses.
+
+    Returns:
+        tuple: Vertices and faces of the updated simplification, and the stats with return_stats.
+    """
+    if _edit_core is None:
+        raise RuntimeError("no edit session, call begin_edit_session first")
+    index_type = np.int32 if _edit_core is _C else np.int64
+    if index_type is np.int32 and max(verts.shape[0], faces.shape[0] * 3) > _INT32_MAX:
+        raise ValueError("the edited mesh is too large for the index type of the session")
+    with _engine_lock:
+        stats = _edit_core.resimplifyMesh(
+            np.ascontiguousarray(verts, dtype=np.float64),
+            np.ascontiguousarray(faces, dtype=index_type),
+            np.ascontiguousarray(changed_faces, dtype=index_type),
+        )
+        res_verts, res_faces, _ = _edit_core.getMesh(False)
+    if return_stats:
+        return res_verts, res_faces, stats
+    return res_verts, res_faces
+
+
+def mesh_deviation(verts_a, faces_a, verts_b, faces_b, samples=100000, symmetric=True):
+    """
+    Measure the distance between two surfaces, typically an original mesh
+    and its simplification.
+
+    Both surfaces are sampled (vertices plus stratified area samples) and
+    every sample is projected on the other mesh through a BVH, in parallel.
+    Results do not depend on the number of threads.
+
+    Parameters:
+        verts_a, faces_a (numpy.ndarray): First mesh.
+        verts_b, faces_b (numpy.ndarray): Second mesh.
+        samples (int): Number of area samples per surface.
+        symmetric (bool): Also measure from b to a.
+
+    Returns:
+        dict: forward (a to b) and backward (b to a) one-sided Hausdorff
+        distances, hausdorff (the largest), mean and rms deviation over all
+        samples. Distances towards a mesh without faces are inf (0 when the
+        other mesh has no vertex either).
+
+    Raises:
+        ValueError: Arrays not of shape (n, 3), or face indices out of range.
+    """
+    verts_a, faces_a = _check_mesh(verts_a, faces_a)
+    verts_b, faces_b = _check_mesh(verts_b, faces_b)
+    C, faces_a = _core_for(verts_a, faces_a)
+    if C is _C:
+        C, faces_b = _core_for(verts_b, faces_b)
+        if C is not _C:
+            faces_a = faces_a.astype(np.int64)
+    else:
+        faces_b = faces_b.astype(np.int64)
+    return C.meshDeviation(
+        np.ascontiguousarray(verts_a, dtype=np.float64), np.ascontiguousarray(faces_a),
+        np.ascontiguousarray(verts_b, dtype=np.float64), np.ascontiguousarray(faces_b),
+        samples, symmetric,
+    )
+
+
+def simplify_async(verts, faces, **kwargs):
+    """
+    Non-blocking simplify: queue the call on a background worker and return
+    a concurrent.futures.Future of its result.
+
+    Takes the same arguments as simplify. The inputs are copied at
+    submission, so the caller may reuse its buffers right away. The engine
+    releases the GIL while it runs; calls are processed one at a time, in
+    submission order, since the engine state is global.
+
+    In asyncio code, await it with asyncio.wrap_future:
+
+        verts, faces = await asyncio.wrap_future(pyfqmr.simplify_async(verts, faces, target_count=1000, verbose=False))
+    """
+    global _executor
+    if verts is not None:
+        verts = np.array(verts, copy=True)
+    if faces is not None:
+        faces = np.array(faces, copy=True)
+    with _engine_lock:
+        if _executor is None:
+            _executor = ThreadPoolExecutor(max_workers=1, thread_name_prefix="pyfqmr")
+    return _executor.submit(simplify, verts, faces, **kwargs)
+
+
+# fqmr_job and fqmr_job_result of fqmr_server.h
+_JOB = struct.Struct("<4sI64s5q2d2qd4qd4qd")
+_JOB_RESULT = struct.Struct("<4si64s3q2d")
+_SERVER_VERSION = 1
+
+
+def simplify_remote(socket_path, verts, faces, target_count=200000, aggressiveness=4, preserve_border=True, max_iterations=50, cluster_grid=0, spatial_reorder=False, original_order=False, optimize_order=False, max_error=None, return_error=False, vertex_weights=None, normals=None, pair_distance=0):
+    """
+    Simplify a mesh on a running fqmrd server (Unix only, see README).
+
+    The mesh goes through POSIX shared memory rather than the socket, and
+    the server keeps its engine and threads warm between jobs, so short-lived
+    processes skip the engine start-up. The result is the same as simplify's.
+
+    Parameters:
+        socket_path (str): Unix domain socket the server listens on.
+        verts, faces, target_count, aggressiveness, preserve_border, max_iterations,
+        cluster_grid, spatial_reorder, original_order, optimize_order, max_error,
+        vertex_weights, normals, pair_distance: As in simplify.
+        return_error (bool): Also return the largest quadric error of the collapses
+            (the per-vertex errors are not sent back).
+
+    Returns:
+        tuple: Simplified vertices and faces, then the error with return_error and
+        the vertex normals with normals.
+    """
+    from multiprocessing import shared_memory
+
+    if optimize_order and original_order:
+        raise ValueError("optimize_order and original_order are mutually exclusive")
+    if normals not in (None, "area", "angle"):
+        raise ValueError("normals must be None, 'area' or 'angle'")
+    verts = np.ascontiguousarray(verts, dtype=np.float64).reshape(-1, 3)
+    faces = np.ascontiguousarray(faces, dtype=np.int64).reshape(-1, 3)
+    parts = [verts, faces]
+    if vertex_weights is not None:
+        vertex_weights = np.ascontiguousarray(vertex_weights, dtype=np.float64)
+        if vertex_weights.shape != (verts.shape[0],):
+            raise ValueError("vertex_weights needs one weight per vertex")
+        parts.append(vertex_weights)
+
+    size = sum(p.nbytes for p in parts)
+    shm = shared_memory.SharedMemory(create=True, size=max(size, 1))
+    try:
+        offset = 0
+        for p in parts:
+            shm.buf[offset:offset + p.nbytes] = p.tobytes()
+            offset += p.nbytes
+        job = _JOB.pack(
+            b"FQMJ", _SERVER_VERSION, ("/" + shm.name.lstrip("/")).encode(),
+            verts.shape[0], faces.shape[0], vertex_weights is not None, target_count, 5,
+            aggressiveness, 1e-9, 3, max_iterations, 1e-4, 0, preserve_border, 0, cluster_grid,
+            -1 if max_error is None else max_error, spatial_reorder, original_order, optimize_order,
+            {None: 0, "area": 1, "angle": 2}[normals], pair_distance,
+        )
+        with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+            sock.connect(socket_path)
+            sock.sendall(job)
+            reply = b""
+            while len(reply) < _JOB_RESULT.size:
+                chunk = sock.recv(_JOB_RESULT.size - len(reply))
+                if not chunk:
+                    raise ConnectionError("fqmrd closed the connection")
+                reply += chunk
+            magic, code, name, num_verts, num_faces, has_normals, error, _ = _JOB_RESULT.unpack(reply)
+            if magic != b"FQMR":
+                raise ConnectionError("not a fqmrd server")
+            if code != 0:
+                raise RuntimeError(f"fqmrd job failed with code {code}")
+            # map the result before closing, the server reclaims it on close
+            result = shared_memory.SharedMemory(name=name.rstrip(b"\0").decode().lstrip("/"))
+    finally:
+        shm.close()
+        shm.unlink()
+
+    try:
+        offset = num_verts * 24
+        res_verts = np.frombuffer(result.buf, np.float64, num_verts * 3).reshape(-1, 3).copy()
+        res_faces = np.frombuffer(result.buf, np.int64, num_faces * 3, offset).reshape(-1, 3)
+        res_faces = res_faces.astype(np.int32 if num_verts <= _INT32_MAX else np.int64)
+        offset += num_faces * 24
+        if has_normals:
+            res_normals = np.frombuffer(result.buf, np.float64, num_verts * 3, offset).reshape(-1, 3).copy()
+    finally:
+        result.close()
+        result.unlink()
+
+    out = (res_verts, res_faces)
+    if return_error:
+        out += (error,)
+    if normals is not None:
+        out += (res_normals,)
+    return out
+
+
+def release_memory():
+    """
+    Free the mesh and the scratch buffers the engine keeps between calls.
+
+    Calls reuse the memory of the previous ones (no allocation or page
+    faults when the meshes have similar sizes); call this after a large mesh
+    to give the memory back.
+    """
+    import sys
+    with _engine_lock:
+        _C.releaseMemory()
+        core64 = sys.modules.get(__name__ + ".core64")
+        if core64 is not None:
+            core64.releaseMemory()
+
+
+def set_num_threads(num_threads=0):
+    """
+    Set the number of threads of the engine, 0 for the OpenMP default
+    (OMP_NUM_THREADS or the number of cores). Results do not depend on it.
+    """
+    global _num_threads
+    import sys
+    with _engine_lock:
+        _num_threads = max(int(num_threads), 0)
+        _C.setNumThreads(_num_threads)
+        core64 = sys.modules.get(__name__ + ".core64")
+        if core64 is not None:
+            core64.setNumThreads(_num_threads)
+
+
+def set_execution_policy(grain=None, cutoffs=None, num_threads=None):
+    """
+    Set how the loops of the engine are parallelized. Results do not depend
+    on it.
+
+    Every loop belongs to a phase ("io", "update", "init", "prepass",
+    "sort", "query", see Simplify.h) and only runs on several threads when
+    it has more iterations than the serial cutoff of its phase (20480 by
+    default). calibrate_execution_policy measures the cutoffs instead.
+
+    Parameters:
+        grain (int): Minimum number of iterations per thread, None keeps it.
+        cutoffs (dict): Serial cutoff by phase name, None as a value keeps the
+            phase serial. Phases not given are unchanged.
+        num_threads (int): Number of threads as in set_num_threads, None
+            keeps it.
+
+    Returns:
+        dict: The policy, as returned by get_execution_policy.
+    """
+    global _policy
+    import sys
+    with _engine_lock:
+        if num_threads is not None:
+            set_num_threads(num_threads)
+        current = _C.getExecutionPolicy()
+        _C.setExecutionPolicy(current["grain"] if grain is None else int(grain), cutoffs or {})
+        _policy = _C.getExecutionPolicy()
+        core64 = sys.modules.get(__name__ + ".core64")
+        if core64 is not None:
+            _configure(core64)
+        return get_execution_policy()
+
+
+def get_execution_policy():
+    """
+    Current execution policy : a dict with the number of threads
+    ("num_threads", 0 for the OpenMP default), the "grain" and the serial
+    "cutoffs" by phase (None for serial phases).
+    """
+    with _engine_lock:
+        policy = _C.getExecutionPolicy()
+        policy["num_threads"] = _num_threads
+        return policy
+
+
+def calibrate_execution_policy(max_size=1 << 18):
+    """
+    Measure the serial cutoffs of this machine and apply them.
+
+    Each phase is timed serially and in parallel on synthetic meshes of
+    growing size, with the current number of threads and grain, which takes
+    up to a few seconds; run it once and store the result, to be restored
+    with set_execution_policy(**policy). The current mesh of the engine is
+    kept.
+
+    Parameters:
+        max_size (int): Largest synthetic mesh, in vertices.
+
+    Returns:
+        dict: The policy, as returned by get_execution_policy.
+    """
+    global _policy
+    import sys
+    with _engine_lock:
+        _C.calibrateExecutionPolicy(int(max_size))
+        _policy = _C.getExecutionPolicy()
+        core64 = sys.modules.get(__name__ + ".core64")
+        if core64 is not None:
+            _configure(core64)
+        return get_execution_policy()
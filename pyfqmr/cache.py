@@ -0,0 +1,129 @@
+"""
+Content-addressed on-disk cache of simplification results.
+
+An entry is keyed by a hash of the input buffers and of every parameter
+that changes the output. Entries are directories of .npy files, read back
+memory mapped, and the directory is kept under a size bound by evicting
+the least recently used entries.
+"""
+import hashlib
+import json
+import os
+import shutil
+import tempfile
+
+import numpy as np
+
+_FORMAT = 1
+
+
+class SimplifyCache:
+    """
+    Directory cache of simplified meshes.
+
+    Parameters:
+        directory (str): Cache directory, created if needed. Can be shared by
+            several processes: entries are published with an atomic rename.
+        max_bytes (int): Size bound of the directory, least recently used
+            entries are evicted past it.
+    """
+
+    def __init__(self, directory, max_bytes=1 << 30):
+        self.directory = directory
+        self.max_bytes = max_bytes
+        os.makedirs(directory, exist_ok=True)
+
+    def key(self, arrays, params):
+        """
+        Hash input arrays (dtype, shape and content) and a dict of parameters.
+        """
+        h = hashlib.blake2b(digest_size=20)
+        h.update(f"pyfqmr-cache-{_FORMAT}".encode())
+        for a in arrays:
+            a = np.ascontiguousarray(a)
+            h.update(f"{a.dtype.str}{a.shape}".encode())
+            h.update(memoryview(a).cast("B"))
+        h.update(json.dumps(params, sort_keys=True, default=str).encode())
+        return h.hexdigest()
+
+    def file_key(self, path, params):
+        """
+        Hash a file (e.g. a snapshot) and a dict of parameters.
+        """
+        h = hashlib.blake2b(digest_size=20)
+        h.update(f"pyfqmr-cache-{_FORMAT}-file".encode())
+        with open(path, "rb") as f:
+            for block in iter(lambda: f.read(1 << 20), b""):
+                h.update(block)
+        h.update(json.dumps(params, sort_keys=True, default=str).encode())
+        return h.hexdigest()
+
+    def get(self, key):
+        """
+        Return the entry stored under key as a dict (arrays memory mapped,
+        read only), or None on a miss.
+        """
+        entry = os.path.join(self.directory, key)
+        try:
+            with open(os.path.join(entry, "meta.json")) as f:
+                meta = json.load(f)
+            result = dict(meta["scalars"])
+            for name in meta["arrays"]:
+                result[name] = np.load(os.path.join(entry, name + ".npy"), mmap_mode="r")
+            os.utime(entry) # recently used
+        except (OSError, ValueError, KeyError):
+            return None
+        return result
+
+    def put(self, key, arrays, scalars=None):
+        """
+        Store a dict of arrays and a dict of JSON scalars under key, then
+        evict old entries if the directory is over its size bound.
+        """
+        entry = os.path.join(self.directory, key)
+        if os.path.isdir(entry):
+            os.utime(entry)
+            return
+        tmp = tempfile.mkdtemp(prefix=".tmp-", dir=self.directory)
+        try:
+            for name, a in arrays.items():
+                np.save(os.path.join(tmp, name + ".npy"), np.ascontiguousarray(a))
+            with open(os.path.join(tmp, "meta.json"), "w") as f:
+                json.dump({"arrays": sorted(arrays), "scalars": scalars or {}}, f)
+            os.rename(tmp, entry)
+        except OSError:
+            # lost a race against another writer of the same key, or no space
+            shutil.rmtree(tmp, ignore_errors=True)
+            return
+        self.evict()
+
+    def evict(self):
+        """
+        Remove least recently used entries until the directory fits in
+        max_bytes.
+        """
+        entries = []
+        total = 0
+        for name in os.listdir(self.directory):
+            if name.startswith(".tmp-"):
+                continue
+            path = os.path.join(self.directory, name)
+            try:
+                size = sum(e.stat().st_size for e in os.scandir(path))
+                entries.append((os.stat(path).st_mtime, size, path))
+            except OSError:
+                continue
+            total += size
+        entries.sort()
+        for _, size, path in entries:
+            if total <= self.max_bytes:
+                break
+            shutil.rmtree(path, ignore_errors=True)
+            total -= size
+
+    def clear(self):
+        """
+        Remove every entry.
+        """
+        for name in os.listdir(self.directory):
+            shutil.rmtree(os.path.join(self.directory, name), ignore_errors=True)
@@ -0,0 +1,401 @@
+/////////////////////////////////////////////
+//
+// fqmr : C ABI of the mesh simplifier, see fqmr.h
+//
+// The only translation unit of the library that includes the engine
+// headers, which define their globals and functions.
+//
+// License : MIT
+// http://opensource.org/licenses/MIT
+
+#include "fqmr.h"
+#include "Simplify.h"
+#include "Optimize.h"
+#include "Encode.h"
+#include "Resimplify.h"
+
+#include <mutex>
+#include <new>
+
+namespace
+{
+    std::mutex engine_mutex; // the engine state is global
+    int edit_normals = FQMR_NORMALS_NONE; // of the edit session outputs
+
+    int load_mesh(const double *verts, int64_t num_verts, const int64_t *faces, int64_t num_faces, const double *weights)
+    {
+        using namespace Simplify;
+        if (num_verts < 0 || num_faces < 0) {return FQMR_ERROR_ARGUMENT;}
+        if ((num_verts && !verts) || (num_faces && !faces)) {return FQMR_ERROR_ARGUMENT;}
+        if (sizeof(fqmr_index) < sizeof(int64_t) && (num_verts > INT32_MAX || num_faces > INT32_MAX / 3)) {return FQMR_ERROR_INDEX;}
+        if (weights)
+        {
+            loopi(0, num_verts)
+            {
+                if (!(weights[i] >= 0 && weights[i] <= DBL_MAX)) {return FQMR_ERROR_ARGUMENT;}
+            }
+        }
+
+        resize_array(vertices, num_verts);
+        resize_array(triangles, num_faces);
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, num_verts))
+        loopi(0, num_verts)
+        {
+            vertices[i].p = vec3f(verts[i * 3], verts[i * 3 + 1], verts[i * 3 + 2]);
+            vertices[i].id = i;
+        }
+        bool valid = true;
+    #pragma omp parallel for schedule(static) num_threads(loop_threads(PHASE_IO, num_faces)) reduction(&&:valid)
+        loopi(0, num_faces)
+        {
+            loopj(0, 3)
+            {
+                int64_t v = faces[i * 3 + j];
+                if (v < 0 || v >= num_verts) {valid = false; v = 0;}
+                triangles[i].v[j] = v;
+            }
+            triangles[i].attr = 0;
+            triangles[i].material = -1;
+            triangles[i].id = i;
+            triangles[i].deleted = 0;
+            triangles[i].dirty = 0;
+        }
+        if (!valid)
+        {
+            vertices.clear();
+            triangles.clear();
+            return FQMR_ERROR_ARGUMENT;
+        }
+        quadrics_preset = false;
+        mesh_prepared = false;
+        vertex_locked.clear();
+        vertex_weights.clear();
+        if (weights) {vertex_weights.assign(weights, weights + num_verts);}
+        return FQMR_OK;
+    }
+
+    // Copy the engine mesh to out
+    void write_mesh(int normals_mode, fqmr_mesh *out)
+    {
+        using namespace Simplify;
+        out->num_vertices = vertices.size();
+        out->num_faces = triangles.size();
+        out->vertices = new double[vertices.size() * 3 + 1];
+        out->faces = new int64_t[triangles.size() * 3 + 1];
+        loopi(0, vertices.size())
+        {
+            out->vertices[i * 3] = vertices[i].p.x;
+            out->vertices[i * 3 + 1] = vertices[i].p.y;
+            out->vertices[i * 3 + 2] = vertices[i].p.z;
+        }
+        loopi(0, triangles.size()) loopj(0, 3) {out->faces[i * 3 + j] = triangles[i].v[j];}
+        if (normals_mode != FQMR_NORMALS_NONE)
+        {
+            std::vector<vec3f> normals;
+            vertex_normals(normals, normals_mode == FQMR_NORMALS_ANGLE);
+            out->normals = new double[normals.size() * 3 + 1];
+            loopi(0, normals.size())
+            {
+                out->normals[i * 3] = normals[i].x;
+                out->normals[i * 3 + 1] = normals[i].y;
+                out->normals[i * 3 + 2] = normals[i].z;
+            }
+        }
+    }
+
+    int run(const double *verts, int64_t num_verts, const int64_t *faces, int64_t num_faces,
+            const fqmr_options *opt, fqmr_mesh *out)
+    {
+        using namespace Simplify;
+        if (opt->target_count < 0) {return FQMR_ERROR_ARGUMENT;}
+        use_threads();
+        int code = load_mesh(verts, num_verts, faces, num_faces, opt->vertex_weights);
+        if (code != FQMR_OK) {return code;}
+
+        // fits fqmr_index once clamped to the input faces
+        fqmr_index target_count = std::min(opt->target_count, num_faces);
+        if (opt->spatial_reorder) {reorder_spatial();}
+        if (opt->cluster_grid > 0) {cluster_vertices(opt->cluster_grid);}
+        if (opt->pair_distance > 0 && !opt->lossless) {contract_pairs(opt->pair_distance, target_count);}
+        out->error = simplify_mesh(target_count, opt->update_rate, opt->aggressiveness, opt->alpha, opt->K,
+                                   opt->max_iterations, opt->threshold_lossless, opt->lossless != 0,
+                                   opt->preserve_border != 0, opt->verbose != 0, opt->max_error);
+        if (opt->optimize_order)
+        {
+            optimize_vertex_cache();
+            optimize_vertex_fetch();
+        }
+        else if (opt->original_order) {restore_order();}
+
+        write_mesh(opt->normals, out);
+        return FQMR_OK;
+    }
+
+    int edit_begin(const double *verts, int64_t num_verts, const int64_t *faces, int64_t num_faces,
+                   const fqmr_options *opt, fqmr_mesh *out)
+    {
+        using namespace Simplify;
+        if (opt->target_count < 0) {return FQMR_ERROR_ARGUMENT;}
+        use_threads();
+        int code = load_mesh(verts, num_verts, faces, num_faces, NULL);
+        if (code != FQMR_OK) {return code;}
+        out->error = begin_edit_session(std::min(opt->target_count, num_faces), opt->update_rate, opt->aggressiveness,
+                                        opt->alpha, opt->K, opt->max_iterations, opt->preserve_border != 0,
+                                        opt->verbose != 0, opt->max_error);
+        edit_normals = opt->normals;
+        write_mesh(edit_normals, out);
+        return FQMR_OK;
+    }
+
+    int edit_update(const double *verts, int64_t num_verts, const int64_t *faces, int64_t num_faces,
+                    const int64_t *changed, int64_t num_changed, fqmr_mesh *out)
+    {
+        using namespace Simplify;
+        if (num_verts < 0 || num_faces < 0 || num_changed < 0) {return FQMR_ERROR_ARGUMENT;}
+        if ((num_verts && !verts) || (num_faces && !faces) || (num_changed && !changed)) {return FQMR_ERROR_ARGUMENT;}
+        if (sizeof(fqmr_index) < sizeof(int64_t) && (num_verts > INT32_MAX || num_faces > INT32_MAX / 3)) {return FQMR_ERROR_INDEX;}
+        use_threads();
+        EditStats stats;
+        if (!resimplify(verts, num_verts, faces, num_faces, changed, num_changed, stats)) {return FQMR_ERROR_ARGUMENT;}
+        out->error = stats.error;
+        write_mesh(edit_normals, out);
+        return FQMR_OK;
+    }
+
+    // Shared by the entry points : clears out, locks the engine and releases
+    // out on failure
+    template <class F>
+    int guarded(fqmr_mesh *out, F call)
+    {
+        out->vertices = NULL;
+        out->faces = NULL;
+        out->normals = NULL;
+        out->num_vertices = out->num_faces = 0;
+        out->error = 0;
+        std::lock_guard<std::mutex> lock(engine_mutex);
+        int code;
+        try {code = call();}
+        catch (const std::exception &) {code = FQMR_ERROR_MEMORY;} // bad_alloc, length_error
+        if (code != FQMR_OK) {fqmr_free_mesh(out);}
+        return code;
+    }
+}
+
+extern "C" {
+
+void fqmr_default_options(fqmr_options *options)
+{
+    options->target_count = 0;
+    options->update_rate = 5;
+    options->aggressiveness = 7;
+    options->alpha = 1e-9;
+    options->K = 3;
+    options->max_iterations = 100;
+    options->threshold_lossless = 1e-4;
+    options->lossless = 0;
+    options->preserve_border = 0;
+    options->verbose = 0;
+    options->cluster_grid = 0;
+    options->max_error = -1;
+    options->spatial_reorder = 0;
+    options->original_order = 0;
+    options->optimize_order = 0;
+    options->vertex_weights = NULL;
+    options->normals = FQMR_NORMALS_NONE;
+    options->pair_distance = 0;
+}
+
+int fqmr_simplify(const double *vertices, int64_t num_vertices,
+                  const int64_t *faces, int64_t num_faces,
+                  const fqmr_options *options, fqmr_mesh *out)
+{
+    if (!out) {return FQMR_ERROR_ARGUMENT;}
+    fqmr_options defaults;
+    if (!options)
+    {
+        fqmr_default_options(&defaults);
+        options = &defaults;
+    }
+    return guarded(out, [&] {return run(vertices, num_vertices, faces, num_faces, options, out);});
+}
+
+int fqmr_edit_begin(const double *vertices, int64_t num_vertices,
+                    const int64_t *faces, int64_t num_faces,
+                    const fqmr_options *options, fqmr_mesh *out)
+{
+    if (!out) {return FQMR_ERROR_ARGUMENT;}
+    fqmr_options defaults;
+    if (!options)
+    {
+        fqmr_default_options(&defaults);
+        options = &defaults;
+    }
+    return guarded(out, [&] {return edit_begin(vertices, num_vertices, faces, num_faces, options, out);});
+}
+
+int fqmr_edit_update(const double *vertices, int64_t num_vertices,
+                     const int64_t *faces, int64_t num_faces,
+                     const int64_t *changed_faces, int64_t num_changed, fqmr_mesh *out)
+{
+    if (!out) {return FQMR_ERROR_ARGUMENT;}
+    return guarded(out, [&] {return edit_update(vertices, num_vertices, faces, num_faces, changed_faces, num_changed, out);});
+}
+
+void fqmr_release_memory(void)
+{
+    std::lock_guard<std::mutex> lock(engine_mutex);
+    Simplify::release_memory();
+}
+
+void fqmr_set_num_threads(int num_threads)
+{
+    std::lock_guard<std::mutex> lock(engine_mutex);
+    Simplify::num_threads = num_threads > 0 ? num_threads : 0;
+}
+
+static_assert(FQMR_NUM_PHASES == Simplify::NUM_PHASES, "phases of fqmr.h and Simplify.h differ");
+
+void fqmr_get_policy(fqmr_policy *policy)
+{
+    if (!policy) {return;}
+    std::lock_guard<std::mutex> lock(engine_mutex);
+    policy->grain = Simplify::policy.grain;
+    loopi(0, FQMR_NUM_PHASES) {policy->cutoff[i] = Simplify::policy.cutoff[i];}
+}
+
+int fqmr_set_policy(const fqmr_policy *policy)
+{
+    if (!policy || policy->grain < 1) {return FQMR_ERROR_ARGUMENT;}
+    loopi(0, FQMR_NUM_PHASES)
+    {
+        if (policy->cutoff[i] < 0) {return FQMR_ERROR_ARGUMENT;}
+    }
+    std::lock_guard<std::mutex> lock(engine_mutex);
+    Simplify::policy.grain = policy->grain;
+    loopi(0, FQMR_NUM_PHASES) {Simplify::policy.cutoff[i] = policy->cutoff[i];}
+    return FQMR_OK;
+}
+
+void fqmr_calibrate_policy(int64_t max_size, fqmr_policy *policy)
+{
+    {
+        std::lock_guard<std::mutex> lock(engine_mutex);
+        Simplify::use_threads();
+        Simplify::calibrate_policy(max_size > 0 ? max_size : 1 << 18);
+    }
+    fqmr_get_policy(policy);
+}
+
+void fqmr_set_huge_pages(int enable)
+{
+    std::lock_guard<std::mutex> lock(engine_mutex);
+    Simplify::huge_pages = enable != 0;
+}
+
+int64_t fqmr_estimate_memory(int64_t num_vertices, int64_t num_faces, const fqmr_options *options)
+{
+    if (num_vertices < 0 || num_faces < 0) {return FQMR_ERROR_ARGUMENT;}
+    fqmr_options defaults;
+    if (!options)
+    {
+        fqmr_default_options(&defaults);
+        options = &defaults;
+    }
+    Simplify::MemoryEstimate m = Simplify::estimate_memory(num_vertices, num_faces, std::max<int64_t>(options->target_count, 0),
+                                                           options->lossless != 0, options->spatial_reorder != 0, options->cluster_grid,
+                                                           0, options->pair_distance > 0 && !options->lossless);
+    return m.peak;
+}
+
+int fqmr_encode(const double *vertices, int64_t num_vertices,
+                const int64_t *faces, int64_t num_faces, int bits,
+                unsigned char **data, int64_t *size)
+{
+    if (!data || !size) {return FQMR_ERROR_ARGUMENT;}
+    *data = NULL;
+    *size = 0;
+    if (num_vertices < 0 || num_faces < 0 || bits < 1 || bits > Simplify::encoded_max_bits) {return FQMR_ERROR_ARGUMENT;}
+    if ((num_vertices && !vertices) || (num_faces && !faces)) {return FQMR_ERROR_ARGUMENT;}
+    for (int64_t i = 0; i < num_faces * 3; i++)
+    {
+        if (faces[i] < 0 || faces[i] >= num_vertices) {return FQMR_ERROR_ARGUMENT;}
+    }
+    try
+    {
+        std::vector<unsigned char> out;
+        Simplify::ArrayMesh<int64_t> mesh = {vertices, faces};
+        Simplify::encode_mesh(mesh, num_vertices, num_faces, bits, out);
+        *data = new unsigned char[out.size()];
+        memcpy(*data, &out[0], out.size());
+        *size = out.size();
+    }
+    catch (const std::exception &) {return FQMR_ERROR_MEMORY;}
+    return FQMR_OK;
+}
+
+int fqmr_decode(const unsigned char *data, int64_t size, fqmr_mesh *out)
+{
+    if (!out) {return FQMR_ERROR_ARGUMENT;}
+    out->vertices = NULL;
+    out->faces = NULL;
+    out->normals = NULL;
+    out->num_vertices = out->num_faces = 0;
+    out->error = 0;
+    if (!data || size < 0) {return FQMR_ERROR_ARGUMENT;}
+    try
+    {
+        std::vector<double> verts;
+        std::vector<int64_t> faces;
+        if (!Simplify::decode_mesh(data, size, verts, faces)) {return FQMR_ERROR_ARGUMENT;}
+        out->num_vertices = verts.size() / 3;
+        out->num_faces = faces.size() / 3;
+        out->vertices = new double[verts.size() + 1];
+        out->faces = new int64_t[faces.size() + 1];
+        if (!verts.empty()) {memcpy(out->vertices, &verts[0], verts.size() * sizeof(double));}
+        if (!faces.empty()) {memcpy(out->faces, &faces[0], faces.size() * sizeof(int64_t));}
+    }
+    catch (const std::exception &)
+    {
+        // bad_alloc, or length_error for counts beyond the address space
+        fqmr_free_mesh(out);
+        return FQMR_ERROR_MEMORY;
+    }
+    return FQMR_OK;
+}
+
+void fqmr_free_data(unsigned char *data)
+{
+    delete[] data;
+}
+
+void fqmr_free_mesh(fqmr_mesh *mesh)
+{
+    if (!mesh) {return;}
+    delete[] mesh->vertices;
+    delete[] mesh->faces;
+    delete[] mesh->normals;
+    mesh->vertices = NULL;
+    mesh->faces = NULL;
+    mesh->normals = NULL;
+    mesh->num_vertices = mesh->num_faces = 0;
+}
+
+int fqmr_index_size(void)
+{
+    return sizeof(fqmr_index);
+}
+
+const char *fqmr_error_string(int code)
+{
+    switch (code)
+    {
+    case FQMR_OK: return "success";
+    case FQMR_ERROR_ARGUMENT: return "invalid argument";
+    case FQMR_ERROR_INDEX: return "mesh too large for the index type, use a FQMR_INDEX64 build";
+    case FQMR_ERROR_MEMORY: return "out of memory";
+    case FQMR_ERROR_SERVER: return "server unreachable or transport failure";
+    default: return "unknown error";
+    }
+}
+
+} // extern "C"
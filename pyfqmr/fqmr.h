@@ -0,0 +1,269 @@
+/////////////////////////////////////////////
+//
+// fqmr : C ABI of the mesh simplifier, for use without Python
+//
+// The engine of Simplify.h works on a single global mesh : calls are
+// serialized by the library, a process simplifies one mesh at a time.
+// Indices are 64-bit in the ABI whatever the index type of the build
+// (FQMR_INDEX64), meshes beyond 2^31 corners need a 64-bit build.
+//
+// A header-only C++ wrapper (namespace fqmr) follows the C declarations.
+//
+// License : MIT
+// http://opensource.org/licenses/MIT
+
+#ifndef FQMR_H
+#define FQMR_H
+
+#include <stdint.h>
+
+#if defined(_WIN32) && defined(FQMR_SHARED)
+#ifdef FQMR_BUILDING
+#define FQMR_API __declspec(dllexport)
+#else
+#define FQMR_API __declspec(dllimport)
+#endif
+#elif defined(FQMR_SHARED)
+#define FQMR_API __attribute__((visibility("default")))
+#else
+#define FQMR_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Return codes
+#define FQMR_OK 0
+#define FQMR_ERROR_ARGUMENT -1 // null pointer, negative count, index out of range
+#define FQMR_ERROR_INDEX -2    // mesh too large for the index type of the build
+#define FQMR_ERROR_MEMORY -3   // allocation failure
+#define FQMR_ERROR_SERVER -4   // server unreachable or transport failure, see fqmr_server.h
+
+// Parameters of simplify_mesh plus the pre- and post-passes, see README
+typedef struct fqmr_options
+{
+    int64_t target_count;      // target nr. of triangles, >= 0
+    int update_rate;           // iterations between mesh updates
+    double aggressiveness;     // threshold growth, 5..8
+    double alpha;              // threshold = alpha * (iteration + K)^aggressiveness
+    int K;
+    int max_iterations;
+    double threshold_lossless; // only with lossless
+    int lossless;              // collapse every edge below threshold_lossless
+    int preserve_border;       // keep the vertices of open borders
+    int verbose;
+    int cluster_grid;          // vertex clustering pre-pass, 0 disables it
+    double max_error;          // quadric error bound, < 0 disables it
+    int spatial_reorder;       // Morton order the input first
+    int original_order;        // output in the relative order of the input
+    int optimize_order;        // output ordered for rendering
+    const double *vertex_weights; // importance per input vertex scaling its
+                               // quadric, NULL for uniform weights
+    int normals;               // output vertex normals : FQMR_NORMALS_*
+    double pair_distance;      // contract vertex pairs closer than this,
+                               // edges or not, first, 0 disables it
+} fqmr_options;
+
+// Weighting of the face normals in the output vertex normals
+#define FQMR_NORMALS_NONE 0
+#define FQMR_NORMALS_AREA 1
+#define FQMR_NORMALS_ANGLE 2
+
+// Output mesh, allocated by fqmr_simplify, released by fqmr_free_mesh
+typedef struct fqmr_mesh
+{
+    double *vertices;          // 3 per vertex
+    int64_t num_vertices;
+    int64_t *faces;            // 3 per triangle
+    int64_t num_faces;
+    double error;              // largest quadric error of the collapses
+    double *normals;           // 3 per vertex, NULL unless options.normals
+} fqmr_mesh;
+
+// Defaults of simplify_mesh, target_count is set to 0 (use max_error or
+// set it)
+FQMR_API void fqmr_default_options(fqmr_options *options);
+
+// Simplify the mesh (vertices : 3 doubles per vertex, faces : 3 indices
+// per triangle) into out. Returns FQMR_OK or a negative error code, out is
+// left empty on errors.
+FQMR_API int fqmr_simplify(const double *vertices, int64_t num_vertices,
+                           const int64_t *faces, int64_t num_faces,
+                           const fqmr_options *options, fqmr_mesh *out);
+
+FQMR_API void fqmr_free_mesh(fqmr_mesh *mesh);
+
+// Edit session (see Resimplify.h) : fqmr_edit_begin simplifies a mesh like
+// fqmr_simplify (without the pre-passes, ordering options and vertex
+// weights) and keeps the output vertex of every input vertex. After an
+// edit of the input (vertices keep their indices, new ones are appended),
+// fqmr_edit_update takes the whole edited mesh and the indices of its new,
+// modified or moved faces, and only simplifies again the part of the
+// output they had collapsed into, to the error level of the session
+// (options.max_error, or the error reached by fqmr_edit_begin). Both write
+// the whole output to out; fqmr_edit_update returns FQMR_ERROR_ARGUMENT
+// without a session or if vertices were removed.
+FQMR_API int fqmr_edit_begin(const double *vertices, int64_t num_vertices,
+                             const int64_t *faces, int64_t num_faces,
+                             const fqmr_options *options, fqmr_mesh *out);
+
+FQMR_API int fqmr_edit_update(const double *vertices, int64_t num_vertices,
+                              const int64_t *faces, int64_t num_faces,
+                              const int64_t *changed_faces, int64_t num_changed, fqmr_mesh *out);
+
+// The engine keeps its arrays and scratch memory between calls to reuse
+// them, fqmr_release_memory frees them
+FQMR_API void fqmr_release_memory(void);
+
+// Number of threads of the engine, 0 (default) for the OpenMP default.
+// The output is bitwise identical whatever the number of threads.
+FQMR_API void fqmr_set_num_threads(int num_threads);
+
+// Phases of the engine loops
+#define FQMR_PHASE_IO 0      // input and output copies, reorders
+#define FQMR_PHASE_UPDATE 1  // flags and reference lists of the passes
+#define FQMR_PHASE_INIT 2    // borders, normals, quadrics and edge errors
+#define FQMR_PHASE_PREPASS 3 // clustering, pair contraction, Morton keys
+#define FQMR_PHASE_SORT 4    // radix sort
+#define FQMR_PHASE_QUERY 5   // vertex errors and normals
+#define FQMR_NUM_PHASES 6
+
+// Execution policy : a loop runs on several threads when it has more
+// iterations than the cutoff of its phase (20480 by default, INT64_MAX
+// keeps the phase serial), with at least grain (1) iterations per thread.
+// The output does not depend on it.
+typedef struct fqmr_policy
+{
+    int64_t grain;
+    int64_t cutoff[FQMR_NUM_PHASES];
+} fqmr_policy;
+
+FQMR_API void fqmr_get_policy(fqmr_policy *policy);
+
+// Returns FQMR_ERROR_ARGUMENT, leaving the policy unchanged, on a grain
+// below 1 or a negative cutoff
+FQMR_API int fqmr_set_policy(const fqmr_policy *policy);
+
+// Measure the cutoffs of this machine, for the current number of threads,
+// on meshes of up to max_size vertices (0 for the default 2^18), apply
+// them and write the policy to policy if not NULL. Takes up to a few
+// seconds.
+FQMR_API void fqmr_calibrate_policy(int64_t max_size, fqmr_policy *policy);
+
+// Back the large engine arrays with transparent huge pages (Linux), off
+// by default
+FQMR_API void fqmr_set_huge_pages(int enable);
+
+// Upper bound of the engine memory in bytes to simplify a mesh of this
+// size with these options, before loading it (input and output buffers
+// not included). Memory kept from previous calls is reused, so this is a
+// bound for fresh calls.
+FQMR_API int64_t fqmr_estimate_memory(int64_t num_vertices, int64_t num_faces, const fqmr_options *options);
+
+// Compact binary encoding of a mesh (see Encode.h) : positions quantized
+// to bits (1..30) per coordinate over the bounding box, entropy coded
+// vertex and index streams. *data is allocated by fqmr_encode and released
+// by fqmr_free_data. Optimized meshes (options.optimize_order) compress
+// best.
+FQMR_API int fqmr_encode(const double *vertices, int64_t num_vertices,
+                         const int64_t *faces, int64_t num_faces, int bits,
+                         unsigned char **data, int64_t *size);
+
+// Decode fqmr_encode data into out (error 0, no normals), released by
+// fqmr_free_mesh. Returns FQMR_ERROR_ARGUMENT on malformed data.
+FQMR_API int fqmr_decode(const unsigned char *data, int64_t size, fqmr_mesh *out);
+
+FQMR_API void fqmr_free_data(unsigned char *data);
+
+// Size of the engine index type in bytes, 4 or 8
+FQMR_API int fqmr_index_size(void);
+
+FQMR_API const char *fqmr_error_string(int code);
+
+#ifdef __cplusplus
+} // extern "C"
+
+#include <stdexcept>
+#include <vector>
+
+namespace fqmr
+{
+    struct Options : fqmr_options
+    {
+        Options() {fqmr_default_options(this);}
+    };
+
+    struct Mesh
+    {
+        std::vector<double> vertices;
+        std::vector<int64_t> faces;
+        std::vector<double> normals; // empty unless options.normals
+        double error;
+    };
+
+    // Copy and release the output of a call, throws std::runtime_error on
+    // failure codes
+    inline Mesh take_mesh(int code, fqmr_mesh &out)
+    {
+        if (code != FQMR_OK) {throw std::runtime_error(fqmr_error_string(code));}
+        Mesh mesh;
+        mesh.vertices.assign(out.vertices, out.vertices + out.num_vertices * 3);
+        mesh.faces.assign(out.faces, out.faces + out.num_faces * 3);
+        if (out.normals) {mesh.normals.assign(out.normals, out.normals + out.num_vertices * 3);}
+        mesh.error = out.error;
+        fqmr_free_mesh(&out);
+        return mesh;
+    }
+
+    // Throws std::runtime_error on failure
+    inline Mesh simplify(const std::vector<double> &vertices, const std::vector<int64_t> &faces,
+                         const Options &options = Options())
+    {
+        fqmr_mesh out;
+        int code = fqmr_simplify(vertices.empty() ? NULL : &vertices[0], vertices.size() / 3,
+                                 faces.empty() ? NULL : &faces[0], faces.size() / 3, &options, &out);
+        return take_mesh(code, out);
+    }
+
+    inline Mesh edit_begin(const std::vector<double> &vertices, const std::vector<int64_t> &faces,
+                           const Options &options = Options())
+    {
+        fqmr_mesh out;
+        int code = fqmr_edit_begin(vertices.empty() ? NULL : &vertices[0], vertices.size() / 3,
+                                   faces.empty() ? NULL : &faces[0], faces.size() / 3, &options, &out);
+        return take_mesh(code, out);
+    }
+
+    inline Mesh edit_update(const std::vector<double> &vertices, const std::vector<int64_t> &faces,
+                            const std::vector<int64_t> &changed_faces)
+    {
+        fqmr_mesh out;
+        int code = fqmr_edit_update(vertices.empty() ? NULL : &vertices[0], vertices.size() / 3,
+                                    faces.empty() ? NULL : &faces[0], faces.size() / 3,
+                                    changed_faces.empty() ? NULL : &changed_faces[0], changed_faces.size(), &out);
+        return take_mesh(code, out);
+    }
+
+    inline std::vector<unsigned char> encode(const std::vector<double> &vertices, const std::vector<int64_t> &faces, int bits = 16)
+    {
+        unsigned char *data;
+        int64_t size;
+        int code = fqmr_encode(vertices.empty() ? NULL : &vertices[0], vertices.size() / 3,
+                               faces.empty() ? NULL : &faces[0], faces.size() / 3, bits, &data, &size);
+        if (code != FQMR_OK) {throw std::runtime_error(fqmr_error_string(code));}
+        std::vector<unsigned char> result(data, data + size);
+        fqmr_free_data(data);
+        return result;
+    }
+
+    inline Mesh decode(const std::vector<unsigned char> &data)
+    {
+        fqmr_mesh out;
+        int code = fqmr_decode(data.empty() ? NULL : &data[0], data.size(), &out);
+        return take_mesh(code, out);
+    }
+};
+#endif // __cplusplus
+
+#endif // FQMR_H
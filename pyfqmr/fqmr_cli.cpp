@@ -0,0 +1,331 @@
+/////////////////////////////////////////////
+//
+// fqmr : command line mesh simplification, OBJ to OBJ
+//
+// Only positions and faces are kept; polygons are triangulated as fans.
+//
+// License : MIT
+// http://opensource.org/licenses/MIT
+
+#include "fqmr.h"
+#ifndef _WIN32
+#include "fqmr_server.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+
+static void usage(const char *name)
+{
+    printf("Usage: %s input.obj output.obj [options]\n"
+           "  .fqme files (instead of .obj) hold the compact encoding of fqmr_encode\n"
+           "  -t, --target N            target number of triangles\n"
+           "  -r, --ratio R             target as a fraction of the input triangles\n"
+           "  -a, --aggressiveness A    threshold growth, 5..8 (7)\n"
+           "  --update-rate N           iterations between mesh updates (5)\n"
+           "  --alpha A                 threshold = alpha * (iteration + K)^aggressiveness (1e-9)\n"
+           "  --K K                     (3)\n"
+           "  --max-iterations N        (100)\n"
+           "  --lossless                collapse every edge below the lossless threshold\n"
+           "  --threshold-lossless E    (1e-4)\n"
+           "  --preserve-border         keep the vertices of open borders\n"
+           "  --cluster-grid N          vertex clustering pre-pass with N cells (0)\n"
+           "  --max-error E             quadric error bound\n"
+           "  --pair-distance D         first contract vertex pairs closer than D (0)\n"
+           "  --spatial-reorder         Morton order the input first\n"
+           "  --original-order          output in the relative order of the input\n"
+           "  --optimize-order          output ordered for rendering\n"
+           "  --weights FILE            importance of each vertex, one number per vertex (1)\n"
+           "  --normals area|angle      write vertex normals, weighted by face area or angle\n"
+           "  --bits N                  quantization bits of .fqme output (16)\n"
+           "  --threads N               number of threads, the output does not depend on it\n"
+           "  --grain N                 minimum loop iterations per thread (1)\n"
+           "  --serial-cutoff N         loops up to N iterations run serially (20480)\n"
+           "  --calibrate               measure the serial cutoffs of this machine first\n"
+           "  --estimate                print the memory bound of the call and exit\n"
+#ifndef _WIN32
+           "  --server SOCKET           run the job on the fqmrd server listening on SOCKET\n"
+#endif
+           "  -v, --verbose\n", name);
+}
+
+// Parse v and f records, other records are ignored
+static bool read_obj(const char *path, std::vector<double> &vertices, std::vector<int64_t> &faces)
+{
+    FILE *file = fopen(path, "r");
+    if (!file) {return false;}
+    char line[4096];
+    std::vector<int64_t> polygon;
+    while (fgets(line, sizeof(line), file))
+    {
+        if (line[0] == 'v' && line[1] == ' ')
+        {
+            double x, y, z;
+            if (sscanf(line + 2, "%lf %lf %lf", &x, &y, &z) == 3)
+            {
+                vertices.push_back(x);
+                vertices.push_back(y);
+                vertices.push_back(z);
+            }
+        }
+        else if (line[0] == 'f' && line[1] == ' ')
+        {
+            polygon.clear();
+            char *p = line + 2;
+            while (*p)
+            {
+                char *end;
+                long long index = strtoll(p, &end, 10);
+                if (end == p) {break;}
+                // 1-based, negative indices are relative to the last vertex
+                polygon.push_back(index < 0 ? (int64_t)(vertices.size() / 3) + index : index - 1);
+                p = end;
+                while (*p && *p != ' ' && *p != '\t') {p++;} // skip /vt/vn
+                while (*p == ' ' || *p == '\t') {p++;}
+            }
+            for (size_t i = 2; i < polygon.size(); i++)
+            {
+                faces.push_back(polygon[0]);
+                faces.push_back(polygon[i - 1]);
+                faces.push_back(polygon[i]);
+            }
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+// Whitespace separated numbers, one per vertex
+static bool read_weights(const char *path, std::vector<double> &weights)
+{
+    FILE *file = fopen(path, "r");
+    if (!file) {return false;}
+    double w;
+    while (fscanf(file, "%lf", &w) == 1) {weights.push_back(w);}
+    bool ok = feof(file) != 0;
+    fclose(file);
+    return ok;
+}
+
+static bool is_encoded(const char *path)
+{
+    size_t n = strlen(path);
+    return n >= 5 && strcmp(path + n - 5, ".fqme") == 0;
+}
+
+static bool read_encoded(const char *path, std::vector<double> &vertices, std::vector<int64_t> &faces)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) {return false;}
+    std::vector<unsigned char> data;
+    unsigned char buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {data.insert(data.end(), buffer, buffer + n);}
+    fclose(file);
+    try
+    {
+        fqmr::Mesh mesh = fqmr::decode(data);
+        vertices.swap(mesh.vertices);
+        faces.swap(mesh.faces);
+    }
+    catch (const std::exception &) {return false;}
+    return true;
+}
+
+static bool write_encoded(const char *path, const fqmr::Mesh &mesh, int bits)
+{
+    std::vector<unsigned char> data;
+    try {data = fqmr::encode(mesh.vertices, mesh.faces, bits);}
+    catch (const std::exception &) {return false;}
+    FILE *file = fopen(path, "wb");
+    if (!file) {return false;}
+    bool ok = fwrite(&data[0], 1, data.size(), file) == data.size();
+    return fclose(file) == 0 && ok;
+}
+
+static bool write_obj(const char *path, const fqmr::Mesh &mesh)
+{
+    FILE *file = fopen(path, "w");
+    if (!file) {return false;}
+    for (size_t i = 0; i < mesh.vertices.size(); i += 3)
+    {
+        fprintf(file, "v %.9g %.9g %.9g\n", mesh.vertices[i], mesh.vertices[i + 1], mesh.vertices[i + 2]);
+    }
+    for (size_t i = 0; i < mesh.normals.size(); i += 3)
+    {
+        fprintf(file, "vn %.6f %.6f %.6f\n", mesh.normals[i], mesh.normals[i + 1], mesh.normals[i + 2]);
+    }
+    for (size_t i = 0; i < mesh.faces.size(); i += 3)
+    {
+        long long a = mesh.faces[i] + 1, b = mesh.faces[i + 1] + 1, c = mesh.faces[i + 2] + 1;
+        if (mesh.normals.empty()) {fprintf(file, "f %lld %lld %lld\n", a, b, c);}
+        else {fprintf(file, "f %lld//%lld %lld//%lld %lld//%lld\n", a, a, b, b, c, c);}
+    }
+    return fclose(file) == 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    fqmr::Options options;
+    double ratio = -1;
+    bool estimate = false, calibrate = false;
+    int64_t grain = 1, cutoff = -1;
+    int bits = 16;
+    const char *weights_path = NULL, *server = NULL;
+    for (int i = 3; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if ((arg == "-t" || arg == "--target") && has_value) {options.target_count = atoll(argv[++i]);}
+        else if ((arg == "-r" || arg == "--ratio") && has_value) {ratio = atof(argv[++i]);}
+        else if ((arg == "-a" || arg == "--aggressiveness") && has_value) {options.aggressiveness = atof(argv[++i]);}
+        else if (arg == "--update-rate" && has_value) {options.update_rate = atoi(argv[++i]);}
+        else if (arg == "--alpha" && has_value) {options.alpha = atof(argv[++i]);}
+        else if (arg == "--K" && has_value) {options.K = atoi(argv[++i]);}
+        else if (arg == "--max-iterations" && has_value) {options.max_iterations = atoi(argv[++i]);}
+        else if (arg == "--lossless") {options.lossless = 1;}
+        else if (arg == "--threshold-lossless" && has_value) {options.threshold_lossless = atof(argv[++i]);}
+        else if (arg == "--preserve-border") {options.preserve_border = 1;}
+        else if (arg == "--cluster-grid" && has_value) {options.cluster_grid = atoi(argv[++i]);}
+        else if (arg == "--max-error" && has_value) {options.max_error = atof(argv[++i]);}
+        else if (arg == "--pair-distance" && has_value) {options.pair_distance = atof(argv[++i]);}
+        else if (arg == "--spatial-reorder") {options.spatial_reorder = 1;}
+        else if (arg == "--original-order") {options.original_order = 1;}
+        else if (arg == "--optimize-order") {options.optimize_order = 1;}
+        else if (arg == "--weights" && has_value) {weights_path = argv[++i];}
+        else if (arg == "--normals" && has_value)
+        {
+            std::string mode = argv[++i];
+            if (mode == "area") {options.normals = FQMR_NORMALS_AREA;}
+            else if (mode == "angle") {options.normals = FQMR_NORMALS_ANGLE;}
+            else
+            {
+                fprintf(stderr, "--normals takes area or angle\n");
+                return 1;
+            }
+        }
+        else if (arg == "--bits" && has_value) {bits = atoi(argv[++i]);}
+        else if (arg == "--threads" && has_value) {fqmr_set_num_threads(atoi(argv[++i]));}
+        else if (arg == "--grain" && has_value) {grain = atoll(argv[++i]);}
+        else if (arg == "--serial-cutoff" && has_value) {cutoff = atoll(argv[++i]);}
+        else if (arg == "--calibrate") {calibrate = true;}
+        else if (arg == "--estimate") {estimate = true;}
+#ifndef _WIN32
+        else if (arg == "--server" && has_value) {server = argv[++i];}
+#endif
+        else if (arg == "-v" || arg == "--verbose") {options.verbose = 1;}
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", arg.c_str());
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.optimize_order && options.original_order)
+    {
+        fprintf(stderr, "--optimize-order and --original-order are mutually exclusive\n");
+        return 1;
+    }
+
+
+    fqmr_policy policy;
+    fqmr_get_policy(&policy);
+    policy.grain = grain;
+    if (cutoff >= 0) {for (int i = 0; i < FQMR_NUM_PHASES; i++) {policy.cutoff[i] = cutoff;}}
+    if (fqmr_set_policy(&policy) != FQMR_OK)
+    {
+        fprintf(stderr, "--grain must be at least 1\n");
+        return 1;
+    }
+    if (calibrate)
+    {
+        fqmr_calibrate_policy(0, &policy);
+        if (options.verbose)
+        {
+            static const char *names[FQMR_NUM_PHASES] = {"io", "update", "init", "prepass", "sort", "query"};
+            for (int i = 0; i < FQMR_NUM_PHASES; i++)
+            {
+                if (policy.cutoff[i] == INT64_MAX) {printf("serial cutoff %s : serial\n", names[i]);}
+                else {printf("serial cutoff %s : %lld\n", names[i], (long long)policy.cutoff[i]);}
+            }
+        }
+    }
+
+    std::vector<double> vertices;
+    std::vector<int64_t> faces;
+    if (!(is_encoded(argv[1]) ? read_encoded(argv[1], vertices, faces) : read_obj(argv[1], vertices, faces)))
+    {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return 1;
+    }
+    int64_t num_faces = faces.size() / 3;
+    std::vector<double> weights;
+    if (weights_path)
+    {
+        if (!read_weights(weights_path, weights) || weights.size() != vertices.size() / 3)
+        {
+            fprintf(stderr, "cannot read %s, or not one weight per vertex\n", weights_path);
+            return 1;
+        }
+        options.vertex_weights = weights.empty() ? NULL : &weights[0];
+    }
+    if (ratio >= 0) {options.target_count = (int64_t)(num_faces * ratio);}
+    else if (options.target_count == 0 && options.max_error < 0 && !options.lossless) {options.target_count = num_faces / 2;}
+
+    if (estimate)
+    {
+        int64_t bytes = fqmr_estimate_memory(vertices.size() / 3, num_faces, &options);
+        printf("%lld triangles, %lld vertices : at most %lld bytes (%.1f MB) of engine memory\n", (long long)num_faces,
+               (long long)vertices.size() / 3, (long long)bytes, bytes / 1e6);
+        return 0;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    fqmr::Mesh mesh;
+#ifndef _WIN32
+    if (server)
+    {
+        fqmr_remote_mesh remote;
+        int code = fqmr_remote_simplify(server, vertices.empty() ? NULL : &vertices[0], vertices.size() / 3,
+                                        faces.empty() ? NULL : &faces[0], num_faces, &options, &remote);
+        if (code != FQMR_OK)
+        {
+            fprintf(stderr, "simplification failed : %s\n", fqmr_error_string(code));
+            return 1;
+        }
+        mesh.vertices.assign(remote.vertices, remote.vertices + remote.num_vertices * 3);
+        mesh.faces.assign(remote.faces, remote.faces + remote.num_faces * 3);
+        if (remote.normals) {mesh.normals.assign(remote.normals, remote.normals + remote.num_vertices * 3);}
+        mesh.error = remote.error;
+        fqmr_remote_free(&remote);
+    }
+    else
+#endif
+    {
+        try {mesh = fqmr::simplify(vertices, faces, options);}
+        catch (const std::exception &e)
+        {
+            fprintf(stderr, "simplification failed : %s\n", e.what());
+            return 1;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (!(is_encoded(argv[2]) ? write_encoded(argv[2], mesh, bits) : write_obj(argv[2], mesh)))
+    {
+        fprintf(stderr, "cannot write %s\n", argv[2]);
+        return 1;
+    }
+    printf("%lld -> %lld triangles, %lld vertices, max error %g, %.3f s\n", (long long)num_faces,
+           (long long)mesh.faces.size() / 3, (long long)mesh.vertices.size() / 3, mesh.error, seconds);
+    return 0;
+}
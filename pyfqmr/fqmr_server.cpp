@@ -0,0 +1,411 @@
+/////////////////////////////////////////////
+//
+// fqmrd : simplification server, see fqmr_server.h for the protocol
+//
+// Jobs run one at a time through the C ABI, so the engine arrays and the
+// OpenMP threads stay warm from one job to the next. Connections are
+// non-blocking and multiplexed with poll : each one buffers the request
+// it is receiving and the reply it is sending, so a client that stalls
+// mid-request only delays itself, and times out.
+//
+// License : MIT
+// http://opensource.org/licenses/MIT
+
+#include "fqmr_server.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+
+static volatile sig_atomic_t stopping = 0;
+
+static void on_signal(int) {stopping = 1;}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s socket [options]\n"
+           "  --threads N               number of threads, the output does not depend on it\n"
+           "  --calibrate               measure the serial cutoffs of this machine first\n"
+           "  --huge-pages              back the engine arrays with huge pages\n"
+           "  --timeout S               drop clients stalled for S seconds mid-request (10, 0 never)\n"
+           "  --no-warmup               do not run a first job at start\n"
+           "  -v, --verbose             log the jobs\n", name);
+}
+
+typedef std::chrono::steady_clock Clock;
+
+struct Connection
+{
+    int fd;
+    std::string result;      // last result handed out, the client has mapped it by its next job
+    fqmr_job job;            // request being received
+    size_t received;         // bytes of job received
+    fqmr_job_result reply;   // reply being sent
+    size_t sent;             // bytes of reply sent, sizeof(reply) when none is pending
+    Clock::time_point since; // last progress of a partial request or pending reply
+};
+
+static bool busy(const Connection &connection)
+{
+    return connection.received > 0 || connection.sent < sizeof(connection.reply);
+}
+
+// Receive what the socket holds of the current request. false once the
+// connection is closed or failed
+static bool receive_job(Connection &connection)
+{
+    ssize_t n = recv(connection.fd, (char *)&connection.job + connection.received, sizeof(connection.job) - connection.received, 0);
+    if (n < 0) {return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;}
+    if (n == 0) {return false;}
+    connection.received += n;
+    connection.since = Clock::now();
+    return true;
+}
+
+// Send what the socket accepts of the pending reply, same return
+static bool send_reply(Connection &connection)
+{
+    ssize_t n = send(connection.fd, (char *)&connection.reply + connection.sent, sizeof(connection.reply) - connection.sent, MSG_NOSIGNAL);
+    if (n < 0) {return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;}
+    connection.sent += n;
+    connection.since = Clock::now();
+    return true;
+}
+
+static void release_result(Connection &connection)
+{
+    if (!connection.result.empty()) {shm_unlink(connection.result.c_str());}
+    connection.result.clear();
+}
+
+static void close_connection(Connection &connection)
+{
+    release_result(connection);
+    close(connection.fd);
+}
+
+// "/name" with no other slash
+static bool valid_name(const char *name)
+{
+    size_t n = strnlen(name, 64);
+    return n >= 2 && n < 64 && name[0] == '/' && strchr(name + 1, '/') == NULL;
+}
+
+static void job_options(const fqmr_job &job, fqmr_options &options)
+{
+    fqmr_default_options(&options);
+    options.target_count = job.target_count;
+    options.update_rate = (int)job.update_rate;
+    options.aggressiveness = job.aggressiveness;
+    options.alpha = job.alpha;
+    options.K = (int)job.K;
+    options.max_iterations = (int)job.max_iterations;
+    options.threshold_lossless = job.threshold_lossless;
+    options.lossless = (int)job.lossless;
+    options.preserve_border = (int)job.preserve_border;
+    options.verbose = (int)job.verbose;
+    options.cluster_grid = (int)job.cluster_grid;
+    options.max_error = job.max_error;
+    options.spatial_reorder = (int)job.spatial_reorder;
+    options.original_order = (int)job.original_order;
+    options.optimize_order = (int)job.optimize_order;
+    options.normals = (int)job.normals;
+    options.pair_distance = job.pair_distance;
+}
+
+// Copy size bytes of the object fd to or from buffer. The objects are
+// never mapped : a client truncating one mid-job makes the copy fail
+// where a mapping would fault (SIGBUS) and kill the server
+static bool copy_object(int fd, void *buffer, size_t size, off_t offset, bool write_mode)
+{
+    char *p = (char *)buffer;
+    while (size > 0)
+    {
+        ssize_t n = write_mode ? pwrite(fd, p, size, offset) : pread(fd, p, size, offset);
+        if (n < 0 && errno == EINTR) {continue;}
+        if (n <= 0) {return false;}
+        p += n;
+        offset += n;
+        size -= n;
+    }
+    return true;
+}
+
+// Simplify the input object of job into a new object named after
+// sequence. input holds the copy of the object, kept across jobs
+static void run_job(fqmr_job &job, unsigned long long sequence, std::vector<double> &input, fqmr_job_result &result)
+{
+    memset(&result, 0, sizeof(result));
+    memcpy(result.magic, "FQMR", 4);
+    result.code = FQMR_ERROR_ARGUMENT;
+    job.shm_name[sizeof(job.shm_name) - 1] = 0;
+    if (memcmp(job.magic, "FQMJ", 4) != 0 || job.version != FQMR_SERVER_VERSION || !valid_name(job.shm_name)) {return;}
+    if (job.num_vertices < 0 || job.num_faces < 0 || job.num_vertices > INT64_MAX / 64 || job.num_faces > INT64_MAX / 64) {return;}
+
+    size_t size = fqmr_shm_size(job.num_vertices, job.num_faces, job.has_weights ? 1 : 0);
+    int fd = shm_open(job.shm_name, O_RDONLY, 0);
+    if (fd < 0) {return;}
+    // the size is checked before the buffer is allocated for it, the copy
+    // still fails if the object shrinks in between
+    struct stat st;
+    bool copied = false;
+    try
+    {
+        if (fstat(fd, &st) == 0 && (size_t)st.st_size >= size)
+        {
+            input.resize(size / sizeof(double) + 1);
+            copied = copy_object(fd, &input[0], size, 0, false);
+        }
+    }
+    catch (const std::bad_alloc &)
+    {
+        result.code = FQMR_ERROR_MEMORY;
+    }
+    close(fd);
+    if (!copied) {return;}
+
+    size_t vbytes = (size_t)job.num_vertices * 3 * sizeof(double), fbytes = (size_t)job.num_faces * 3 * sizeof(int64_t);
+    const char *data = (const char *)&input[0];
+    fqmr_options options;
+    job_options(job, options);
+    options.vertex_weights = job.has_weights ? (const double *)(data + vbytes + fbytes) : NULL;
+    fqmr_mesh mesh;
+    Clock::time_point start = Clock::now();
+    result.code = fqmr_simplify((const double *)data, job.num_vertices, (const int64_t *)(data + vbytes), job.num_faces,
+                                &options, &mesh);
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    if (result.code != FQMR_OK) {return;}
+
+    snprintf(result.shm_name, sizeof(result.shm_name), "/fqmrd-%d-%llu", (int)getpid(), sequence);
+    size = fqmr_shm_size(mesh.num_vertices, mesh.num_faces, mesh.normals ? 3 : 0);
+    vbytes = (size_t)mesh.num_vertices * 3 * sizeof(double);
+    fbytes = (size_t)mesh.num_faces * 3 * sizeof(int64_t);
+    shm_unlink(result.shm_name); // left over by an earlier server with the same pid
+    fd = shm_open(result.shm_name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    bool written = false;
+    if (fd >= 0)
+    {
+        written = ftruncate(fd, size ? size : 1) == 0 && copy_object(fd, mesh.vertices, vbytes, 0, true) &&
+                  copy_object(fd, mesh.faces, fbytes, vbytes, true) &&
+                  (!mesh.normals || copy_object(fd, mesh.normals, vbytes, vbytes + fbytes, true));
+        close(fd);
+    }
+    if (!written)
+    {
+        if (fd >= 0) {shm_unlink(result.shm_name);}
+        fqmr_free_mesh(&mesh);
+        memset(result.shm_name, 0, sizeof(result.shm_name));
+        result.code = FQMR_ERROR_MEMORY;
+        return;
+    }
+    result.num_vertices = mesh.num_vertices;
+    result.num_faces = mesh.num_faces;
+    result.has_normals = mesh.normals != NULL;
+    result.error = mesh.error;
+    fqmr_free_mesh(&mesh);
+}
+
+// A first job on a grid large enough for the parallel loops, so that the
+// thread pool and the engine arrays exist before the first client
+static void warm_up()
+{
+    const int side = 128;
+    std::vector<double> vertices;
+    std::vector<int64_t> faces;
+    for (int y = 0; y <= side; y++)
+    {
+        for (int x = 0; x <= side; x++)
+        {
+            vertices.push_back(x);
+            vertices.push_back(y);
+            vertices.push_back(0.01 * ((x * 7 + y * 13) % 5));
+        }
+    }
+    for (int y = 0; y < side; y++)
+    {
+        for (int x = 0; x < side; x++)
+        {
+            int64_t v = y * (side + 1) + x;
+            int64_t quad[6] = {v, v + 1, v + side + 1, v + 1, v + side + 2, v + side + 1};
+            faces.insert(faces.end(), quad, quad + 6);
+        }
+    }
+    fqmr_options options;
+    fqmr_default_options(&options);
+    options.target_count = side * side / 2;
+    fqmr_mesh mesh;
+    if (fqmr_simplify(&vertices[0], vertices.size() / 3, &faces[0], faces.size() / 3, &options, &mesh) == FQMR_OK)
+    {
+        fqmr_free_mesh(&mesh);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || argv[1][0] == '-')
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *path = argv[1];
+    bool verbose = false, warmup = true, calibrate = false;
+    int timeout = 10;
+    for (int i = 2; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--threads" && has_value) {fqmr_set_num_threads(atoi(argv[++i]));}
+        else if (arg == "--calibrate") {calibrate = true;}
+        else if (arg == "--huge-pages") {fqmr_set_huge_pages(1);}
+        else if (arg == "--timeout" && has_value) {timeout = atoi(argv[++i]);}
+        else if (arg == "--no-warmup") {warmup = false;}
+        else if (arg == "-v" || arg == "--verbose") {verbose = true;}
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", arg.c_str());
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "socket path too long : %s\n", path);
+        return 1;
+    }
+    // a socket nobody answers on is left over by a server that died
+    int probe = fqmr_connect(path);
+    if (probe >= 0)
+    {
+        close(probe);
+        fprintf(stderr, "a server already listens on %s\n", path);
+        return 1;
+    }
+    unlink(path);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    // jobs name shared memory objects of this user : no other user may connect
+    if (listener < 0 || bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 || chmod(path, 0600) != 0 ||
+        listen(listener, 64) != 0 || fcntl(listener, F_SETFL, O_NONBLOCK) != 0)
+    {
+        fprintf(stderr, "cannot listen on %s : %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_signal; // no SA_RESTART, poll returns on signals
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (calibrate)
+    {
+        fqmr_policy policy;
+        fqmr_calibrate_policy(0, &policy);
+    }
+    if (warmup) {warm_up();}
+    if (verbose) {fprintf(stderr, "listening on %s\n", path);}
+
+    std::vector<Connection> connections;
+    std::vector<struct pollfd> fds;
+    std::vector<double> input;
+    unsigned long long sequence = 0;
+    while (!stopping)
+    {
+        // wait for the sockets, or for the first busy connection to time out
+        Clock::time_point now = Clock::now(), deadline = Clock::time_point::max();
+        fds.resize(connections.size() + 1);
+        fds[0].fd = listener;
+        fds[0].events = POLLIN;
+        for (size_t i = 0; i < connections.size(); i++)
+        {
+            fds[i + 1].fd = connections[i].fd;
+            fds[i + 1].events = connections[i].sent < sizeof(connections[i].reply) ? POLLOUT : POLLIN;
+            if (timeout > 0 && busy(connections[i])) {deadline = std::min(deadline, connections[i].since + std::chrono::seconds(timeout));}
+        }
+        int wait = -1;
+        if (deadline != Clock::time_point::max())
+        {
+            wait = deadline > now ? (int)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() + 1 : 0;
+        }
+        if (poll(&fds[0], fds.size(), wait) < 0)
+        {
+            if (errno == EINTR) {continue;}
+            fprintf(stderr, "poll : %s\n", strerror(errno));
+            break;
+        }
+
+        // clients, in reverse so that closed ones can be erased
+        now = Clock::now();
+        for (size_t i = connections.size(); i-- > 0;)
+        {
+            Connection &connection = connections[i];
+            short revents = fds[i + 1].revents;
+            bool replying = connection.sent < sizeof(connection.reply);
+            bool open = !(revents & (POLLERR | POLLNVAL));
+            if (open && replying && (revents & (POLLOUT | POLLHUP))) {open = send_reply(connection);}
+            else if (open && !replying && (revents & (POLLIN | POLLHUP))) {open = receive_job(connection);}
+            if (open && connection.received == sizeof(connection.job))
+            {
+                release_result(connection);
+                run_job(connection.job, sequence++, input, connection.reply);
+                const fqmr_job &job = connection.job;
+                const fqmr_job_result &result = connection.reply;
+                if (result.code == FQMR_OK) {connection.result = result.shm_name;}
+                if (verbose)
+                {
+                    if (result.code == FQMR_OK)
+                    {
+                        fprintf(stderr, "job %llu : %lld -> %lld triangles, %.3f s\n", sequence - 1,
+                                (long long)job.num_faces, (long long)result.num_faces, result.seconds);
+                    }
+                    else {fprintf(stderr, "job %llu : %s\n", sequence - 1, fqmr_error_string(result.code));}
+                }
+                connection.received = 0;
+                connection.sent = 0;
+                open = send_reply(connection);
+                now = Clock::now();
+            }
+            if (open && timeout > 0 && busy(connection) && now - connection.since >= std::chrono::seconds(timeout))
+            {
+                if (verbose) {fprintf(stderr, "client stalled for %d s, dropped\n", timeout);}
+                open = false;
+            }
+            if (!open)
+            {
+                close_connection(connection);
+                connections.erase(connections.begin() + i);
+            }
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            int fd = accept(listener, NULL, NULL);
+            if (fd >= 0)
+            {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                Connection connection;
+                connection.fd = fd;
+                connection.received = 0;
+                connection.sent = sizeof(connection.reply);
+                connection.since = Clock::now();
+                connections.push_back(connection);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < connections.size(); i++) {close_connection(connections[i]);}
+    close(listener);
+    unlink(path);
+    return 0;
+}
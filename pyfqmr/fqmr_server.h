@@ -0,0 +1,254 @@
+/////////////////////////////////////////////
+//
+// fqmrd : protocol of the simplification server, and its client
+//
+// The server (fqmr_server.cpp) keeps the engine, its memory and the OpenMP
+// threads warm and runs the jobs it receives on a Unix domain socket, one
+// at a time. Meshes are not sent over the socket but through POSIX shared
+// memory :
+//  - the client writes the input mesh to a shared memory object (vertices,
+//    3 doubles each, faces, 3 int64 each, then the vertex weights if any)
+//    and sends a fqmr_job naming it,
+//  - the server reads it, simplifies, writes the output to a new object
+//    (vertices, faces, then the normals if any, same layout) and answers
+//    with a fqmr_job_result naming it,
+//  - the client unlinks both objects, the result once it is mapped. The
+//    server unlinks a result anyway when its connection sends the next
+//    job or closes.
+// All the fields are little-endian on the supported platforms, the
+// structs have no padding. A connection may send several jobs.
+//
+// The client below is header-only (POSIX, link -lrt with glibc < 2.34),
+// so that short-lived tools do not need the engine.
+//
+// License : MIT
+// http://opensource.org/licenses/MIT
+
+#ifndef FQMR_SERVER_H
+#define FQMR_SERVER_H
+
+#include "fqmr.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define FQMR_SERVER_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct fqmr_job
+{
+    char magic[4];             // "FQMJ"
+    uint32_t version;          // FQMR_SERVER_VERSION
+    char shm_name[64];         // input object, "/name"
+    int64_t num_vertices;
+    int64_t num_faces;
+    int64_t has_weights;       // weights follow the faces
+    // fqmr_options, see fqmr.h
+    int64_t target_count;
+    int64_t update_rate;
+    double aggressiveness;
+    double alpha;
+    int64_t K;
+    int64_t max_iterations;
+    double threshold_lossless;
+    int64_t lossless;
+    int64_t preserve_border;
+    int64_t verbose;
+    int64_t cluster_grid;
+    double max_error;
+    int64_t spatial_reorder;
+    int64_t original_order;
+    int64_t optimize_order;
+    int64_t normals;
+    double pair_distance;
+} fqmr_job;
+
+typedef struct fqmr_job_result
+{
+    char magic[4];             // "FQMR"
+    int32_t code;              // FQMR_OK or an error code of fqmr.h
+    char shm_name[64];         // output object, empty on errors
+    int64_t num_vertices;
+    int64_t num_faces;
+    int64_t has_normals;       // normals follow the faces
+    double error;              // as fqmr_mesh.error
+    double seconds;            // run time of the job in the server
+} fqmr_job_result;
+
+// Output mesh of fqmr_remote_simplify, mapped from the result object
+typedef struct fqmr_remote_mesh
+{
+    const double *vertices;
+    int64_t num_vertices;
+    const int64_t *faces;
+    int64_t num_faces;
+    const double *normals;     // NULL unless options.normals
+    double error;
+    void *mapping;
+    size_t size;
+} fqmr_remote_mesh;
+
+static inline size_t fqmr_shm_size(int64_t num_vertices, int64_t num_faces, int extra)
+{
+    return (size_t)num_vertices * 3 * sizeof(double) + (size_t)num_faces * 3 * sizeof(int64_t) +
+           (extra ? (size_t)num_vertices * extra * sizeof(double) : 0);
+}
+
+// Read or write all of buffer, 0 on failure or end of stream
+static inline int fqmr_transfer(int fd, void *buffer, size_t size, int write_mode)
+{
+    char *p = (char *)buffer;
+    while (size > 0)
+    {
+        ssize_t n = write_mode ? send(fd, p, size, MSG_NOSIGNAL) : recv(fd, p, size, 0);
+        if (n < 0 && errno == EINTR) {continue;}
+        if (n <= 0) {return 0;}
+        p += n;
+        size -= n;
+    }
+    return 1;
+}
+
+static inline int fqmr_connect(const char *socket_path)
+{
+    struct sockaddr_un addr;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {return -1;}
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {return -1;}
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static inline void fqmr_remote_free(fqmr_remote_mesh *mesh)
+{
+    if (mesh->mapping) {munmap(mesh->mapping, mesh->size);}
+    memset(mesh, 0, sizeof(*mesh));
+}
+
+// Simplify through the server listening on socket_path, like
+// fqmr_simplify. out points into the mapped result, released by
+// fqmr_remote_free. Returns FQMR_ERROR_SERVER when the server cannot be
+// reached or the transport fails, else the code of the job.
+static inline int fqmr_remote_simplify(const char *socket_path,
+                                const double *vertices, int64_t num_vertices,
+                                const int64_t *faces, int64_t num_faces,
+                                const fqmr_options *options, fqmr_remote_mesh *out)
+{
+    static unsigned counter = 0;
+    fqmr_options defaults;
+    fqmr_job job;
+    fqmr_job_result result;
+    struct timespec now;
+    struct stat st;
+    memset(out, 0, sizeof(*out));
+    if (num_vertices < 0 || num_faces < 0) {return FQMR_ERROR_ARGUMENT;}
+    if ((num_vertices && !vertices) || (num_faces && !faces)) {return FQMR_ERROR_ARGUMENT;}
+    if (!options)
+    {
+        fqmr_default_options(&defaults);
+        options = &defaults;
+    }
+
+    memset(&job, 0, sizeof(job));
+    memcpy(job.magic, "FQMJ", 4);
+    job.version = FQMR_SERVER_VERSION;
+    clock_gettime(CLOCK_REALTIME, &now);
+    snprintf(job.shm_name, sizeof(job.shm_name), "/fqmr-%d-%u-%ld", (int)getpid(), counter++, (long)now.tv_nsec);
+    job.num_vertices = num_vertices;
+    job.num_faces = num_faces;
+    job.has_weights = options->vertex_weights != NULL;
+    job.target_count = options->target_count;
+    job.update_rate = options->update_rate;
+    job.aggressiveness = options->aggressiveness;
+    job.alpha = options->alpha;
+    job.K = options->K;
+    job.max_iterations = options->max_iterations;
+    job.threshold_lossless = options->threshold_lossless;
+    job.lossless = options->lossless;
+    job.preserve_border = options->preserve_border;
+    job.verbose = options->verbose;
+    job.cluster_grid = options->cluster_grid;
+    job.max_error = options->max_error;
+    job.spatial_reorder = options->spatial_reorder;
+    job.original_order = options->original_order;
+    job.optimize_order = options->optimize_order;
+    job.normals = options->normals;
+    job.pair_distance = options->pair_distance;
+
+    // input object
+    size_t size = fqmr_shm_size(num_vertices, num_faces, job.has_weights ? 1 : 0);
+    size_t length = size ? size : 1;
+    int fd = shm_open(job.shm_name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {return FQMR_ERROR_SERVER;}
+    char *p = (char *)MAP_FAILED;
+    if (ftruncate(fd, length) == 0) {p = (char *)mmap(NULL, length, PROT_WRITE, MAP_SHARED, fd, 0);}
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+        shm_unlink(job.shm_name);
+        return FQMR_ERROR_MEMORY;
+    }
+    size_t vbytes = (size_t)num_vertices * 3 * sizeof(double), fbytes = (size_t)num_faces * 3 * sizeof(int64_t);
+    if (vbytes) {memcpy(p, vertices, vbytes);}
+    if (fbytes) {memcpy(p + vbytes, faces, fbytes);}
+    if (job.has_weights && num_vertices) {memcpy(p + vbytes + fbytes, options->vertex_weights, num_vertices * sizeof(double));}
+    munmap(p, length);
+
+    // the server reclaims the result if the connection closes before it is mapped
+    int sock = fqmr_connect(socket_path);
+    int sent = sock >= 0 && fqmr_transfer(sock, &job, sizeof(job), 1) && fqmr_transfer(sock, &result, sizeof(result), 0);
+    shm_unlink(job.shm_name);
+    p = (char *)MAP_FAILED;
+    if (sent && memcmp(result.magic, "FQMR", 4) == 0 && result.code == FQMR_OK)
+    {
+        result.shm_name[sizeof(result.shm_name) - 1] = 0;
+        size = fqmr_shm_size(result.num_vertices, result.num_faces, result.has_normals ? 3 : 0);
+        length = size ? size : 1;
+        fd = shm_open(result.shm_name, O_RDONLY, 0);
+        if (fd >= 0)
+        {
+            if (fstat(fd, &st) == 0 && (size_t)st.st_size >= size) {p = (char *)mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);}
+            shm_unlink(result.shm_name);
+            close(fd);
+        }
+    }
+    if (sock >= 0) {close(sock);}
+    if (!sent || memcmp(result.magic, "FQMR", 4) != 0) {return FQMR_ERROR_SERVER;}
+    if (result.code != FQMR_OK) {return result.code;}
+    if (p == MAP_FAILED) {return FQMR_ERROR_SERVER;}
+    vbytes = (size_t)result.num_vertices * 3 * sizeof(double);
+    fbytes = (size_t)result.num_faces * 3 * sizeof(int64_t);
+    out->mapping = p;
+    out->size = length;
+    out->vertices = (const double *)p;
+    out->num_vertices = result.num_vertices;
+    out->faces = (const int64_t *)(p + vbytes);
+    out->num_faces = result.num_faces;
+    out->normals = result.has_normals ? (const double *)(p + vbytes + fbytes) : NULL;
+    out->error = result.error;
+    return FQMR_OK;
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // FQMR_SERVER_H
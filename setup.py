@@ -12,6 +12,16 @@ ext_modules = [
         extra_compile_args = ['-fopenmp', '-O3', '-w'],
         extra_link_args = ['-fopenmp'],
     ),                  
+    # same sources with 64-bit vertex and face indices, for meshes beyond 2^31
+    Pybind11Extension(
+        "pyfqmr.core64",
+        ["pyfqmr/Simplify_pyapi.cpp"],
+        include_dirs = ['pyfqmr'],
+        language='c++',
+        define_macros = [('FQMR_INDEX64', None)],
+        extra_compile_args = ['-fopenmp', '-O3', '-w'],
+        extra_link_args = ['-fopenmp'],
+    ),
 ]
 
 setup(
@@ -0,0 +1,19 @@
+"""
+Meshes shared by the tests.
+"""
+import numpy as np
+
+
+def torus(n=40, m=20):
+    """
+    Closed torus of n x m quads split in two triangles.
+    """
+    u, v = np.meshgrid(2 * np.pi * np.arange(n) / n, 2 * np.pi * np.arange(m) / m, indexing="ij")
+    verts = np.stack([(3 + np.cos(v)) * np.cos(u), (3 + np.cos(v)) * np.sin(u), np.sin(v)], axis=-1).reshape(-1, 3)
+    i, j = np.meshgrid(np.arange(n), np.arange(m), indexing="ij")
+    a = i * m + j
+    b = (i + 1) % n * m + j
+    c = (i + 1) % n * m + (j + 1) % m
+    d = i * m + (j + 1) % m
+    faces = np.concatenate([np.stack([a, b, c], -1).reshape(-1, 3), np.stack([a, c, d], -1).reshape(-1, 3)])
+    return verts, faces.astype(np.int32)
@@ -0,0 +1,70 @@
+// calibrate_policy keeps the mesh of the engine : a prepared mesh
+// simplifies after a calibration as it does without one
+
+#include "Simplify.h"
+#include "test_mesh.h"
+
+static void load(const std::vector<double> &v, const std::vector<int64_t> &f)
+{
+    Simplify::vertices.resize(v.size() / 3);
+    Simplify::triangles.resize(f.size() / 3);
+    loopi(0, Simplify::vertices.size())
+    {
+        Simplify::vertices[i].p = vec3f(v[i * 3], v[i * 3 + 1], v[i * 3 + 2]);
+        Simplify::vertices[i].id = i;
+    }
+    loopi(0, Simplify::triangles.size())
+    {
+        Simplify::Triangle &t = Simplify::triangles[i];
+        loopj(0, 3) {t.v[j] = f[i * 3 + j];}
+        t.attr = 0;
+        t.material = -1;
+        t.id = i;
+        t.deleted = 0;
+        t.dirty = 0;
+    }
+}
+
+static void simplified(std::vector<double> &v, std::vector<fqmr_index> &f)
+{
+    Simplify::simplify_mesh(2000);
+    v.clear();
+    f.clear();
+    loopi(0, Simplify::vertices.size())
+    {
+        const vec3f &p = Simplify::vertices[i].p;
+        v.push_back(p.x);
+        v.push_back(p.y);
+        v.push_back(p.z);
+    }
+    loopi(0, Simplify::triangles.size()) loopj(0, 3) {f.push_back(Simplify::triangles[i].v[j]);}
+}
+
+int main()
+{
+    std::vector<double> v;
+    std::vector<int64_t> f;
+    torus_mesh(100, 50, v, f);
+
+    std::vector<double> v0, v1;
+    std::vector<fqmr_index> f0, f1;
+    load(v, f);
+    Simplify::prepare_mesh();
+    simplified(v0, f0);
+
+    // several threads, or the calibration has nothing to measure
+    Simplify::ExecutionPolicy policy = Simplify::policy;
+    Simplify::num_threads = 4;
+    Simplify::use_threads();
+    load(v, f);
+    Simplify::prepare_mesh();
+    Simplify::calibrate_policy(1 << 12);
+    Simplify::policy = policy;
+    CHECK(Simplify::vertices.size() == v.size() / 3 && Simplify::triangles.size() == f.size() / 3);
+    CHECK(Simplify::mesh_prepared);
+    simplified(v1, f1);
+
+    CHECK(!f0.empty() && f0 == f1 && v0 == v1);
+    printf("mesh kept across the calibration\n");
+    return 0;
+}
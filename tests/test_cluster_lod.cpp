@@ -0,0 +1,79 @@
+// Every group of a cluster LOD level is simplified to about half of its
+// triangles, the groups in parallel with the same result on any number of
+// threads
+
+#include "ClusterLOD.h"
+#include "test_mesh.h"
+
+#include <string.h>
+
+static void load(const std::vector<double> &v, const std::vector<int64_t> &f)
+{
+    Simplify::vertices.resize(v.size() / 3);
+    Simplify::triangles.resize(f.size() / 3);
+    loopi(0, Simplify::vertices.size())
+    {
+        Simplify::vertices[i].p = vec3f(v[i * 3], v[i * 3 + 1], v[i * 3 + 2]);
+        Simplify::vertices[i].id = i;
+    }
+    loopi(0, Simplify::triangles.size())
+    {
+        Simplify::Triangle &t = Simplify::triangles[i];
+        loopj(0, 3) {t.v[j] = f[i * 3 + j];}
+        t.attr = 0;
+        t.material = -1;
+        t.id = i;
+        t.deleted = 0;
+        t.dirty = 0;
+    }
+}
+
+int main()
+{
+    std::vector<double> v;
+    std::vector<int64_t> f;
+    torus_mesh(200, 100, v, f);
+    load(v, f);
+    Simplify::build_cluster_lod(128, 4, 4);
+
+    // triangles of each group, before and after its simplification
+    std::map<int, std::pair<int64_t, int64_t> > groups;
+    int levels = 0;
+    loopi(0, Simplify::clusters.size())
+    {
+        const Simplify::Cluster &c = Simplify::clusters[i];
+        if (c.group >= 0) {groups[c.group].first += c.count;}
+        if (c.parent_group >= 0) {groups[c.parent_group].second += c.count;}
+        levels = std::max(levels, c.level + 1);
+    }
+    CHECK(levels >= 4);
+    int simplified = 0, halved = 0;
+    for (std::map<int, std::pair<int64_t, int64_t> >::iterator it = groups.begin(); it != groups.end(); ++it)
+    {
+        if (it->second.second == 0) {continue;} // roots, not simplified
+        double ratio = double(it->second.second) / it->second.first;
+        CHECK(ratio >= 0.45);
+        simplified++;
+        if (ratio <= 0.55) {halved++;}
+    }
+    // groups whose locked outline pins most of their vertices may stay above half
+    printf("%d of %d groups halved\n", halved, simplified);
+    CHECK(halved >= 0.9 * simplified);
+
+    // groups simplified in parallel : the same DAG on 4 threads
+    std::vector<Simplify::ClusterLevel> levels_1 = Simplify::cluster_levels;
+    Simplify::policy.grain = 1;
+    loopi(0, Simplify::NUM_PHASES) {Simplify::policy.cutoff[i] = 0;}
+    Simplify::num_threads = 4;
+    Simplify::use_threads();
+    load(v, f);
+    Simplify::build_cluster_lod(128, 4, 4);
+    CHECK(Simplify::cluster_levels.size() == levels_1.size());
+    loopi(0, levels_1.size())
+    {
+        const Simplify::ClusterLevel &a = levels_1[i], &b = Simplify::cluster_levels[i];
+        CHECK(a.faces == b.faces && a.vertices.size() == b.vertices.size());
+        CHECK(a.vertices.empty() || memcmp(&a.vertices[0], &b.vertices[0], a.vertices.size() * sizeof(vec3f)) == 0);
+    }
+    return 0;
+}
@@ -0,0 +1,33 @@
+import threading
+
+from pyfqmr import core
+from meshes import torus
+
+
+def test_direct_calls_from_threads():
+    """
+    Calls of the core module from several threads, without the lock of the
+    package, each see a whole mesh : faces always index its vertices.
+    """
+    meshes = [torus(120, 60), torus(60, 30)]
+    errors = []
+
+    def work(k):
+        try:
+            for i in range(20):
+                verts, faces = meshes[(k + i) % 2]
+                if i % 3 == 0:
+                    core.setMesh(verts, faces)
+                elif i % 3 == 1:
+                    core.simplify_mesh_warpper(target_count=faces.shape[0] // 2)
+                v, f, _ = core.getMesh()
+                assert f.size == 0 or (f.min() >= 0 and f.max() < v.shape[0])
+        except Exception as e:
+            errors.append(e)
+
+    threads = [threading.Thread(target=work, args=(k,)) for k in range(4)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    assert not errors
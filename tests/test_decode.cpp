@@ -0,0 +1,82 @@
+/////////////////////////////////////////////
+//
+// fqmr_decode on malformed data : header counts that overflow, stream
+// lengths beyond the counts, truncated and corrupted buffers
+//
+// License : MIT
+// http://opensource.org/licenses/MIT
+
+#include "fqmr.h"
+#include "test_mesh.h"
+
+#include <string.h>
+
+// offsets in the header of Encode.h
+static const size_t num_vertices_offset = 16, num_triangles_offset = 24, header_size = 80;
+
+static void put_u64(std::vector<unsigned char> &data, size_t offset, unsigned long long v)
+{
+    for (int i = 0; i < 8; i++) {data[offset + i] = (unsigned char)(v >> (8 * i));}
+}
+
+static int decode(const std::vector<unsigned char> &data, fqmr_mesh &mesh)
+{
+    int code = fqmr_decode(data.empty() ? (const unsigned char *)"" : &data[0], data.size(), &mesh);
+    if (code == FQMR_OK)
+    {
+        for (int64_t i = 0; i < mesh.num_faces * 3; i++) {CHECK(mesh.faces[i] >= 0 && mesh.faces[i] < mesh.num_vertices);}
+        fqmr_free_mesh(&mesh);
+    }
+    return code;
+}
+
+int main()
+{
+    std::vector<double> v;
+    std::vector<int64_t> f;
+    torus_mesh(40, 20, v, f);
+    unsigned char *encoded;
+    int64_t size;
+    CHECK(fqmr_encode(&v[0], v.size() / 3, &f[0], f.size() / 3, 16, &encoded, &size) == FQMR_OK);
+    const std::vector<unsigned char> data(encoded, encoded + size);
+    fqmr_free_data(encoded);
+
+    fqmr_mesh mesh;
+    CHECK(fqmr_decode(&data[0], data.size(), &mesh) == FQMR_OK);
+    CHECK(mesh.num_vertices == (int64_t)v.size() / 3 && mesh.num_faces == (int64_t)f.size() / 3);
+    CHECK(memcmp(mesh.faces, &f[0], f.size() * sizeof(int64_t)) == 0);
+    fqmr_free_mesh(&mesh);
+
+    // counts whose number of corners or coordinates wraps around
+    std::vector<unsigned char> bad = data;
+    put_u64(bad, num_triangles_offset, 0x5555555555555556ull);
+    CHECK(decode(bad, mesh) == FQMR_ERROR_ARGUMENT);
+    bad = data;
+    put_u64(bad, num_vertices_offset, 0x5555555555555556ull);
+    CHECK(decode(bad, mesh) == FQMR_ERROR_ARGUMENT);
+
+    // index stream longer than the counts allow, or than memory
+    unsigned long long lengths[] = {~0ull, 1ull << 62, f.size() * 10 + 1};
+    for (int i = 0; i < 3; i++)
+    {
+        bad = data;
+        put_u64(bad, header_size + 1, lengths[i]);
+        CHECK(decode(bad, mesh) == FQMR_ERROR_ARGUMENT);
+    }
+
+    // every truncation, and every byte flipped : no crash, no index out of range
+    for (size_t n = 0; n < data.size(); n++)
+    {
+        bad.assign(data.begin(), data.begin() + n);
+        CHECK(decode(bad, mesh) == FQMR_ERROR_ARGUMENT);
+    }
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        bad = data;
+        bad[i] ^= 0xFF;
+        int code = decode(bad, mesh);
+        CHECK(code == FQMR_OK || code == FQMR_ERROR_ARGUMENT || code == FQMR_ERROR_MEMORY);
+    }
+    printf("malformed data rejected\n");
+    return 0;
+}
@@ -0,0 +1,63 @@
+/////////////////////////////////////////////
+//
+// fqmr_simplify gives bitwise identical outputs whatever the number of
+// threads, with every loop forced parallel
+//
+// License : MIT
+// http://opensource.org/licenses/MIT
+
+#include "fqmr.h"
+#include "test_mesh.h"
+
+#include <string.h>
+
+static bool same(const fqmr_mesh &a, const fqmr_mesh &b)
+{
+    if (a.num_vertices != b.num_vertices || a.num_faces != b.num_faces) {return false;}
+    if (memcmp(&a.error, &b.error, sizeof(double)) != 0) {return false;}
+    if (memcmp(a.vertices, b.vertices, a.num_vertices * 3 * sizeof(double)) != 0) {return false;}
+    if (memcmp(a.faces, b.faces, a.num_faces * 3 * sizeof(int64_t)) != 0) {return false;}
+    if ((a.normals == NULL) != (b.normals == NULL)) {return false;}
+    return !a.normals || memcmp(a.normals, b.normals, a.num_vertices * 3 * sizeof(double)) == 0;
+}
+
+int main()
+{
+    std::vector<double> v;
+    std::vector<int64_t> f;
+    torus_mesh(200, 100, v, f);
+
+    fqmr_policy policy, parallel;
+    fqmr_get_policy(&policy);
+    parallel.grain = 1;
+    for (int i = 0; i < FQMR_NUM_PHASES; i++) {parallel.cutoff[i] = 0;}
+    CHECK(fqmr_set_policy(&parallel) == FQMR_OK);
+
+    const int thread_counts[] = {1, 2, 3, 4, 8};
+    for (int variant = 0; variant < 5; variant++)
+    {
+        fqmr_options options;
+        fqmr_default_options(&options);
+        options.target_count = 4000;
+        if (variant == 1) {options.max_error = 1e-3;}
+        if (variant == 2) {options.cluster_grid = 64; options.spatial_reorder = 1;}
+        if (variant == 3) {options.optimize_order = 1; options.normals = FQMR_NORMALS_AREA;}
+        if (variant == 4) {options.pair_distance = 0.05;}
+
+        fqmr_mesh first, out;
+        for (int t = 0; t < 5; t++)
+        {
+            fqmr_set_num_threads(thread_counts[t]);
+            CHECK(fqmr_simplify(&v[0], v.size() / 3, &f[0], f.size() / 3, &options, t ? &out : &first) == FQMR_OK);
+            if (t == 0) {continue;}
+            if (!same(first, out)) {printf("options %d : %d threads differ from 1\n", variant, thread_counts[t]);}
+            CHECK(same(first, out));
+            fqmr_free_mesh(&out);
+        }
+        fqmr_free_mesh(&first);
+    }
+    fqmr_set_num_threads(0);
+    fqmr_set_policy(&policy);
+    printf("outputs identical on 1 to 8 threads\n");
+    return 0;
+}
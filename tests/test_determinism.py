@@ -0,0 +1,48 @@
+import numpy as np
+import pytest
+
+import pyfqmr
+from meshes import torus
+
+THREAD_COUNTS = (1, 2, 3, 4, 8)
+
+
+@pytest.fixture
+def parallel_loops():
+    """
+    Run every loop of the engine on all its threads, even on small meshes,
+    and restore the execution policy afterwards.
+    """
+    policy = pyfqmr.get_execution_policy()
+    phases = ("io", "update", "init", "prepass", "sort", "query")
+    pyfqmr.set_execution_policy(grain=1, cutoffs=dict.fromkeys(phases, 0))
+    yield
+    pyfqmr.set_execution_policy(**policy)
+
+
+@pytest.mark.parametrize("options", [
+    {},
+    {"preserve_border": False, "max_error": 1e-3},
+    {"cluster_grid": 64, "spatial_reorder": True},
+    {"optimize_order": True, "normals": "area"},
+    {"pair_distance": 0.05},
+])
+def test_simplify(parallel_loops, options):
+    verts, faces = torus(200, 100)
+    outputs = []
+    for n in THREAD_COUNTS:
+        pyfqmr.set_num_threads(n)
+        result = pyfqmr.simplify(verts, faces, target_count=4000, verbose=False, return_error=True, **options)
+        outputs.append([np.asarray(a).tobytes() for a in result])
+    for n, output in zip(THREAD_COUNTS[1:], outputs[1:]):
+        assert output == outputs[0], f"{n} threads differ from 1"
+
+
+def test_mesh_deviation(parallel_loops):
+    verts, faces = torus(200, 100)
+    verts_s, faces_s = pyfqmr.simplify(verts, faces, target_count=4000, verbose=False)
+    results = []
+    for n in THREAD_COUNTS:
+        pyfqmr.set_num_threads(n)
+        results.append(pyfqmr.mesh_deviation(verts, faces, verts_s, faces_s, samples=100000))
+    assert all(result == results[0] for result in results[1:])
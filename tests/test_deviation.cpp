@@ -0,0 +1,38 @@
+// Deviation between meshes, with one of them empty
+
+#include "Hausdorff.h"
+#include "test_mesh.h"
+
+static void positions(const std::vector<double> &v, std::vector<vec3f> &out)
+{
+    out.resize(v.size() / 3);
+    loopi(0, out.size()) {out[i] = vec3f(v[i * 3], v[i * 3 + 1], v[i * 3 + 2]);}
+}
+
+int main()
+{
+    std::vector<double> v;
+    std::vector<int64_t> f;
+    torus_mesh(40, 20, v, f);
+    std::vector<vec3f> pos, none;
+    positions(v, pos);
+    std::vector<fqmr_index> tris(f.begin(), f.end()), no_tris;
+    Simplify::DeviationStats forward, backward;
+
+    // identical meshes
+    Simplify::mesh_deviation(pos, tris, pos, tris, 1000, true, forward, backward);
+    CHECK(forward.max < 1e-9 && backward.max < 1e-9);
+
+    // towards an empty mesh : infinite, from it : nothing to measure
+    Simplify::mesh_deviation(pos, tris, none, no_tris, 1000, true, forward, backward);
+    CHECK(isinf(forward.max) && isinf(forward.sum) && forward.samples == (fqmr_index)pos.size() + 1000);
+    CHECK(backward.max == 0 && backward.samples == 0);
+    Simplify::mesh_deviation(none, no_tris, pos, tris, 1000, true, forward, backward);
+    CHECK(forward.max == 0 && forward.samples == 0);
+    CHECK(isinf(backward.max));
+
+    // both empty
+    Simplify::mesh_deviation(none, no_tris, none, no_tris, 1000, true, forward, backward);
+    CHECK(forward.max == 0 && backward.max == 0 && forward.samples + backward.samples == 0);
+    return 0;
+}
@@ -0,0 +1,45 @@
+import numpy as np
+import pytest
+
+import pyfqmr
+from meshes import torus
+
+
+def test_identical_meshes():
+    verts, faces = torus()
+    result = pyfqmr.mesh_deviation(verts, faces, verts, faces, samples=1000)
+    assert result["hausdorff"] < 1e-9
+    assert result["rms"] < 1e-9
+
+
+def test_simplified_mesh():
+    verts, faces = torus(80, 40)
+    verts_s, faces_s = pyfqmr.simplify(verts, faces, target_count=1000, verbose=False)
+    result = pyfqmr.mesh_deviation(verts, faces, verts_s, faces_s, samples=10000)
+    assert 0 < result["rms"] <= result["hausdorff"] < 0.5
+
+
+@pytest.mark.parametrize("verts, faces", [
+    (np.zeros(12), np.array([[0, 1, 2]])),
+    (np.zeros((4, 2)), np.array([[0, 1, 2]])),
+    (np.zeros((4, 3)), np.array([0, 1, 2])),
+    (np.zeros((4, 3)), np.array([[0, 1, 4]])),
+    (np.zeros((4, 3)), np.array([[0, -1, 2]])),
+    (np.zeros((4, 3)), np.array([[0, 1, 2 ** 32]])),
+])
+def test_invalid_meshes(verts, faces):
+    good_verts, good_faces = torus()
+    with pytest.raises(ValueError):
+        pyfqmr.mesh_deviation(verts, faces, good_verts, good_faces)
+    with pytest.raises(ValueError):
+        pyfqmr.mesh_deviation(good_verts, good_faces, verts, faces)
+
+
+def test_empty_mesh():
+    verts, faces = torus()
+    empty_verts, empty_faces = np.zeros((0, 3)), np.zeros((0, 3), dtype=np.int32)
+    result = pyfqmr.mesh_deviation(verts, faces, empty_verts, empty_faces, samples=100)
+    assert np.isinf(result["forward"]) and np.isinf(result["hausdorff"])
+    assert result["backward"] == 0
+    result = pyfqmr.mesh_deviation(empty_verts, empty_faces, empty_verts, empty_faces)
+    assert result["hausdorff"] == 0 and result["rms"] == 0
@@ -0,0 +1,70 @@
+/////////////////////////////////////////////
+//
+// Edit session : the stitched output of fqmr_edit_update stays a manifold
+// without duplicate faces, edit after edit
+//
+// License : MIT
+// http://opensource.org/licenses/MIT
+
+#include "fqmr.h"
+#include "test_mesh.h"
+
+int main()
+{
+    const int n = 300, m = 300;
+    std::vector<double> v;
+    std::vector<int64_t> f;
+    torus_mesh(n, m, v, f);
+    int64_t num_v = v.size() / 3, num_f = f.size() / 3;
+
+    fqmr_options options;
+    fqmr_default_options(&options);
+    options.target_count = num_f / 20;
+    fqmr_mesh out;
+    CHECK(fqmr_edit_begin(&v[0], num_v, &f[0], num_f, &options, &out) == FQMR_OK);
+    int64_t duplicates, nonmanifold;
+    count_defects(out.faces, out.num_faces, duplicates, nonmanifold);
+    CHECK(duplicates == 0 && nonmanifold == 0);
+    fqmr_free_mesh(&out);
+
+    // scale blocks of 20 x 20 vertices about their center, at pseudo-random
+    // places overlapping the blocks edited before
+    unsigned int seed = 1;
+    for (int e = 0; e < 32; e++)
+    {
+        int corner[2];
+        for (int a = 0; a < 2; a++)
+        {
+            seed = seed * 1103515245u + 12345u;
+            corner[a] = (seed >> 8) % n;
+        }
+        std::vector<char> moved(num_v, 0);
+        double center[3] = {0, 0, 0};
+        for (int i = 0; i < 20; i++) for (int j = 0; j < 20; j++)
+        {
+            int64_t k = ((corner[0] + i) % n) * m + (corner[1] + j) % m;
+            moved[k] = 1;
+            for (int a = 0; a < 3; a++) {center[a] += v[k * 3 + a] / 400;}
+        }
+        for (int64_t k = 0; k < num_v; k++)
+        {
+            if (moved[k]) {for (int a = 0; a < 3; a++) {v[k * 3 + a] = center[a] + (v[k * 3 + a] - center[a]) * 1.5;}}
+        }
+        std::vector<int64_t> changed;
+        for (int64_t i = 0; i < num_f; i++)
+        {
+            if (moved[f[i * 3]] || moved[f[i * 3 + 1]] || moved[f[i * 3 + 2]]) {changed.push_back(i);}
+        }
+        CHECK(fqmr_edit_update(&v[0], num_v, &f[0], num_f, &changed[0], changed.size(), &out) == FQMR_OK);
+        count_defects(out.faces, out.num_faces, duplicates, nonmanifold);
+        if (duplicates || nonmanifold)
+        {
+            printf("edit %d : %lld duplicate faces, %lld non-manifold edges\n", e, (long long)duplicates, (long long)nonmanifold);
+        }
+        CHECK(duplicates == 0 && nonmanifold == 0);
+        CHECK(out.num_faces < num_f / 10);
+        fqmr_free_mesh(&out);
+    }
+    printf("32 edits stitched without defects\n");
+    return 0;
+}
@@ -0,0 +1,115 @@
+/////////////////////////////////////////////
+//
+// Meshes and checks shared by the C++ tests
+//
+// License : MIT
+// http://opensource.org/licenses/MIT
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <vector>
+
+#define CHECK(cond) do {if (!(cond)) {fprintf(stderr, "%s:%d: check failed : %s\n", __FILE__, __LINE__, #cond); exit(1);}} while (0)
+
+// Closed torus of n x m quads split in two triangles
+static inline void torus_mesh(int n, int m, std::vector<double> &vertices, std::vector<int64_t> &faces)
+{
+    vertices.clear();
+    faces.clear();
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = 0; j < m; j++)
+        {
+            double u = 2 * M_PI * i / n, v = 2 * M_PI * j / m;
+            vertices.push_back((3 + cos(v)) * cos(u));
+            vertices.push_back((3 + cos(v)) * sin(u));
+            vertices.push_back(sin(v));
+        }
+    }
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = 0; j < m; j++)
+        {
+            int64_t a = i * m + j, b = ((i + 1) % n) * m + j, c = ((i + 1) % n) * m + (j + 1) % m, d = i * m + (j + 1) % m;
+            int64_t quad[6] = {a, b, c, a, c, d};
+            faces.insert(faces.end(), quad, quad + 6);
+        }
+    }
+}
+
+// Closed axis-aligned cubes of unit size on a count^3 lattice, gap apart,
+// each face split in n x n quads
+static inline void cubes_mesh(int count, double gap, int n, std::vector<double> &vertices, std::vector<int64_t> &faces)
+{
+    vertices.clear();
+    faces.clear();
+    for (int c = 0; c < count * count * count; c++)
+    {
+        double origin[3] = {(c % count) * (1 + gap), (c / count % count) * (1 + gap), (c / count / count) * (1 + gap)};
+        // vertices of the cube surface, indexed by lattice position
+        std::map<int, int64_t> index;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            for (int side = 0; side < 2; side++)
+            {
+                int64_t corner[4];
+                for (int a = 0; a < n; a++)
+                {
+                    for (int b = 0; b < n; b++)
+                    {
+                        for (int k = 0; k < 4; k++)
+                        {
+                            int p[3];
+                            p[axis] = side * n;
+                            p[(axis + 1) % 3] = a + (k == 1 || k == 2);
+                            p[(axis + 2) % 3] = b + (k >= 2);
+                            int key = (p[0] * (n + 1) + p[1]) * (n + 1) + p[2];
+                            std::map<int, int64_t>::iterator it = index.find(key);
+                            if (it == index.end())
+                            {
+                                it = index.insert(std::make_pair(key, (int64_t)vertices.size() / 3)).first;
+                                for (int d = 0; d < 3; d++) {vertices.push_back(origin[d] + double(p[d]) / n);}
+                            }
+                            corner[k] = it->second;
+                        }
+                        // outward orientation
+                        int64_t quad[6] = {corner[0], corner[1], corner[2], corner[0], corner[2], corner[3]};
+                        if (side == 0) {std::swap(quad[1], quad[2]); std::swap(quad[4], quad[5]);}
+                        faces.insert(faces.end(), quad, quad + 6);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Number of faces repeating another one (same vertices, any order) and of
+// edges shared by more than two faces
+static inline void count_defects(const int64_t *faces, int64_t num_faces, int64_t &duplicate_faces, int64_t &nonmanifold_edges)
+{
+    std::vector<std::vector<int64_t> > sorted(num_faces, std::vector<int64_t>(3));
+    std::map<std::pair<int64_t, int64_t>, int> edges;
+    for (int64_t i = 0; i < num_faces; i++)
+    {
+        for (int k = 0; k < 3; k++) {sorted[i][k] = faces[i * 3 + k];}
+        std::sort(sorted[i].begin(), sorted[i].end());
+        for (int k = 0; k < 3; k++)
+        {
+            int64_t a = faces[i * 3 + k], b = faces[i * 3 + (k + 1) % 3];
+            edges[std::make_pair(std::min(a, b), std::max(a, b))]++;
+        }
+    }
+    std::sort(sorted.begin(), sorted.end());
+    duplicate_faces = 0;
+    for (int64_t i = 1; i < num_faces; i++) {if (sorted[i] == sorted[i - 1]) {duplicate_faces++;}}
+    nonmanifold_edges = 0;
+    for (std::map<std::pair<int64_t, int64_t>, int>::iterator it = edges.begin(); it != edges.end(); ++it)
+    {
+        if (it->second > 2) {nonmanifold_edges++;}
+    }
+}
@@ -0,0 +1,43 @@
+/////////////////////////////////////////////
+//
+// fqmr_simplify options out of the range of the engine index type
+//
+// License : MIT
+// http://opensource.org/licenses/MIT
+
+#include "fqmr.h"
+#include "test_mesh.h"
+
+int main()
+{
+    std::vector<double> v;
+    std::vector<int64_t> f;
+    torus_mesh(64, 32, v, f);
+    int64_t num_f = f.size() / 3;
+    fqmr_options options;
+    fqmr_default_options(&options);
+    fqmr_mesh out;
+
+    // targets above the face count (truncated by a 32-bit index type
+    // before) leave the mesh as it is
+    int64_t targets[] = {num_f, (1ll << 32) + 16, INT64_MAX};
+    for (int i = 0; i < 3; i++)
+    {
+        options.target_count = targets[i];
+        CHECK(fqmr_simplify(&v[0], v.size() / 3, &f[0], num_f, &options, &out) == FQMR_OK);
+        CHECK(out.num_faces == num_f);
+        fqmr_free_mesh(&out);
+    }
+
+    options.target_count = -5;
+    CHECK(fqmr_simplify(&v[0], v.size() / 3, &f[0], num_f, &options, &out) == FQMR_ERROR_ARGUMENT);
+    CHECK(out.num_faces == 0 && out.faces == NULL);
+    CHECK(fqmr_edit_begin(&v[0], v.size() / 3, &f[0], num_f, &options, &out) == FQMR_ERROR_ARGUMENT);
+
+    options.target_count = 1000;
+    CHECK(fqmr_simplify(&v[0], v.size() / 3, &f[0], num_f, &options, &out) == FQMR_OK);
+    CHECK(out.num_faces <= 1000 && out.num_faces > 900);
+    fqmr_free_mesh(&out);
+    printf("targets checked\n");
+    return 0;
+}
@@ -0,0 +1,91 @@
+/////////////////////////////////////////////
+//
+// Pair contraction : assemblies reach the target and stay manifold
+//
+// License : MIT
+// http://opensource.org/licenses/MIT
+
+#include "fqmr.h"
+#include "test_mesh.h"
+
+// Open boxes (no bottom) of the given size on a 30 x 90 lattice, 0.05
+// above a plate split in 100 x 100 quads
+static void boxes_mesh(double size, double spacing, std::vector<double> &vertices, std::vector<int64_t> &faces)
+{
+    const int n = 100;
+    vertices.clear();
+    faces.clear();
+    for (int i = 0; i <= n; i++)
+    {
+        for (int j = 0; j <= n; j++)
+        {
+            double p[3] = {i * 30 * spacing / n, j * 90 * spacing / n, 0};
+            vertices.insert(vertices.end(), p, p + 3);
+        }
+    }
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = 0; j < n; j++)
+        {
+            int64_t a = i * (n + 1) + j, b = a + n + 1;
+            int64_t quad[6] = {a, b, b + 1, a, b + 1, a + 1};
+            faces.insert(faces.end(), quad, quad + 6);
+        }
+    }
+    const int sides[5][4] = {{4, 5, 7, 6}, {0, 1, 5, 4}, {1, 3, 7, 5}, {3, 2, 6, 7}, {2, 0, 4, 6}};
+    for (int x = 0; x < 30; x++)
+    {
+        for (int y = 0; y < 90; y++)
+        {
+            int64_t base = vertices.size() / 3;
+            for (int k = 0; k < 8; k++)
+            {
+                double p[3] = {x * spacing + 0.05 + size * (k & 1), y * spacing + 0.05 + size * (k >> 1 & 1), 0.05 + size * (k >> 2)};
+                vertices.insert(vertices.end(), p, p + 3);
+            }
+            for (int s = 0; s < 5; s++)
+            {
+                const int *c = sides[s];
+                int64_t quad[6] = {base + c[0], base + c[1], base + c[2], base + c[0], base + c[2], base + c[3]};
+                faces.insert(faces.end(), quad, quad + 6);
+            }
+        }
+    }
+}
+
+static int64_t simplify(const std::vector<double> &v, const std::vector<int64_t> &f, int64_t target,
+                        double pair_distance, int preserve_border)
+{
+    fqmr_options options;
+    fqmr_default_options(&options);
+    options.target_count = target;
+    options.pair_distance = pair_distance;
+    options.preserve_border = preserve_border;
+    fqmr_mesh out;
+    CHECK(fqmr_simplify(&v[0], v.size() / 3, &f[0], f.size() / 3, &options, &out) == FQMR_OK);
+    int64_t duplicates, nonmanifold, num_faces = out.num_faces;
+    count_defects(out.faces, out.num_faces, duplicates, nonmanifold);
+    CHECK(nonmanifold == 0);
+    fqmr_free_mesh(&out);
+    return num_faces;
+}
+
+int main()
+{
+    std::vector<double> v;
+    std::vector<int64_t> f;
+
+    // closed cubes closer than the pair distance : contracting them must
+    // not stall the QEM pass above the target it reaches alone
+    cubes_mesh(10, 0.05, 1, v, f);
+    CHECK(simplify(v, f, 1080, 0, 0) <= 1080);
+    CHECK(simplify(v, f, 1080, 0.5, 0) <= 1080);
+
+    // open boxes keeping their borders : only pair contraction reaches the
+    // target
+    boxes_mesh(0.1, 0.3, v, f);
+    CHECK(simplify(v, f, 2000, 0, 1) > 4000);
+    CHECK(simplify(v, f, 2000, 0.2, 1) <= 2000);
+    printf("assemblies reach their targets\n");
+    return 0;
+}
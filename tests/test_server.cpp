@@ -0,0 +1,103 @@
+/////////////////////////////////////////////
+//
+// fqmrd : a job sent with fqmr_remote_simplify gives the output of a local
+// fqmr_simplify, while a client stalled mid-request and a job naming a
+// truncated object neither block nor stop the server
+//
+// License : MIT
+// http://opensource.org/licenses/MIT
+
+#include "fqmr_server.h"
+#include "test_mesh.h"
+
+#include <signal.h>
+#include <sys/wait.h>
+
+static pid_t server = 0;
+
+// a failed check exits : stop the server with the test
+static void stop_server()
+{
+    if (server > 0) {kill(server, SIGKILL);}
+}
+
+int main()
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/fqmr-test-%d.sock", (int)getpid());
+    server = fork();
+    if (server == 0)
+    {
+        execl(FQMRD_PATH, FQMRD_PATH, path, "--no-warmup", "--timeout", "3", (char *)NULL);
+        _exit(127);
+    }
+    CHECK(server > 0);
+    atexit(stop_server);
+    int stalled = -1;
+    for (int i = 0; i < 1000 && stalled < 0; i++)
+    {
+        stalled = fqmr_connect(path);
+        if (stalled < 0) {usleep(10000);}
+    }
+    CHECK(stalled >= 0);
+
+    // half a request : the server serves the other clients meanwhile, the
+    // job below completes while this one is still connected
+    fqmr_job job;
+    memset(&job, 0, sizeof(job));
+    CHECK(fqmr_transfer(stalled, &job, sizeof(job) / 2, 1));
+
+    std::vector<double> v;
+    std::vector<int64_t> f;
+    torus_mesh(200, 100, v, f);
+    fqmr_options options;
+    fqmr_default_options(&options);
+    options.target_count = 4000;
+    options.normals = FQMR_NORMALS_AREA;
+    fqmr_mesh local;
+    fqmr_remote_mesh remote;
+    CHECK(fqmr_simplify(&v[0], v.size() / 3, &f[0], f.size() / 3, &options, &local) == FQMR_OK);
+    CHECK(fqmr_remote_simplify(path, &v[0], v.size() / 3, &f[0], f.size() / 3, &options, &remote) == FQMR_OK);
+    CHECK(remote.num_vertices == local.num_vertices && remote.num_faces == local.num_faces);
+    CHECK(memcmp(&remote.error, &local.error, sizeof(double)) == 0);
+    CHECK(memcmp(remote.vertices, local.vertices, local.num_vertices * 3 * sizeof(double)) == 0);
+    CHECK(memcmp(remote.faces, local.faces, local.num_faces * 3 * sizeof(int64_t)) == 0);
+    CHECK(remote.normals && memcmp(remote.normals, local.normals, local.num_vertices * 3 * sizeof(double)) == 0);
+    fqmr_remote_free(&remote);
+    fqmr_free_mesh(&local);
+    char byte;
+    CHECK(recv(stalled, &byte, 1, MSG_DONTWAIT) < 0 && errno == EAGAIN);
+
+    // an object smaller than the job says is rejected
+    memcpy(job.magic, "FQMJ", 4);
+    job.version = FQMR_SERVER_VERSION;
+    snprintf(job.shm_name, sizeof(job.shm_name), "/fqmr-test-%d", (int)getpid());
+    job.num_vertices = 1000;
+    job.num_faces = 1000;
+    job.target_count = 100;
+    int fd = shm_open(job.shm_name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    CHECK(fd >= 0 && ftruncate(fd, 64) == 0);
+    close(fd);
+    int sock = fqmr_connect(path);
+    fqmr_job_result result;
+    CHECK(sock >= 0 && fqmr_transfer(sock, &job, sizeof(job), 1) && fqmr_transfer(sock, &result, sizeof(result), 0));
+    CHECK(memcmp(result.magic, "FQMR", 4) == 0 && result.code == FQMR_ERROR_ARGUMENT);
+    close(sock);
+    shm_unlink(job.shm_name);
+
+    // the stalled client is dropped after the timeout
+    struct timeval tv;
+    tv.tv_sec = 20;
+    tv.tv_usec = 0;
+    setsockopt(stalled, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    CHECK(recv(stalled, &byte, 1, 0) == 0);
+    close(stalled);
+
+    int status = 0;
+    kill(server, SIGTERM);
+    CHECK(waitpid(server, &status, 0) == server);
+    server = 0;
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    printf("remote output identical to the local one\n");
+    return 0;
+}
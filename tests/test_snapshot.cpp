@@ -0,0 +1,130 @@
+// A prepared mesh saved to a snapshot and loaded back simplifies as it
+// does without the snapshot, while snapshots with overflowing counts or
+// indices out of range are rejected and leave the state untouched
+
+#include "Snapshot.h"
+#include "test_mesh.h"
+
+#include <string>
+
+static void load(const std::vector<double> &v, const std::vector<int64_t> &f)
+{
+    Simplify::vertices.resize(v.size() / 3);
+    Simplify::triangles.resize(f.size() / 3);
+    loopi(0, Simplify::vertices.size())
+    {
+        Simplify::vertices[i].p = vec3f(v[i * 3], v[i * 3 + 1], v[i * 3 + 2]);
+        Simplify::vertices[i].id = i;
+    }
+    loopi(0, Simplify::triangles.size())
+    {
+        Simplify::Triangle &t = Simplify::triangles[i];
+        loopj(0, 3) {t.v[j] = f[i * 3 + j];}
+        t.attr = 0;
+        t.material = -1;
+        t.id = i;
+        t.deleted = 0;
+        t.dirty = 0;
+    }
+}
+
+static void simplified(std::vector<double> &v, std::vector<fqmr_index> &f)
+{
+    Simplify::simplify_mesh(2000);
+    v.clear();
+    f.clear();
+    loopi(0, Simplify::vertices.size())
+    {
+        const vec3f &p = Simplify::vertices[i].p;
+        v.push_back(p.x);
+        v.push_back(p.y);
+        v.push_back(p.z);
+    }
+    loopi(0, Simplify::triangles.size()) loopj(0, 3) {f.push_back(Simplify::triangles[i].v[j]);}
+}
+
+static std::string read_file(const char *path)
+{
+    std::string data;
+    FILE *file = fopen(path, "rb");
+    CHECK(file);
+    char buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {data.append(buffer, n);}
+    fclose(file);
+    return data;
+}
+
+static void write_file(const char *path, const std::string &data)
+{
+    FILE *file = fopen(path, "wb");
+    CHECK(file && fwrite(data.data(), 1, data.size(), file) == data.size());
+    fclose(file);
+}
+
+// load_state of a corrupt copy of the snapshot fails, the state kept
+static void check_rejected(const std::string &data, const char *path)
+{
+    write_file(path, data);
+    size_t num_v = Simplify::vertices.size(), num_f = Simplify::triangles.size();
+    CHECK(!Simplify::load_state(path));
+    CHECK(Simplify::vertices.size() == num_v && Simplify::triangles.size() == num_f);
+}
+
+int main()
+{
+    const char *path = "test_snapshot.bin", *corrupt = "test_snapshot_corrupt.bin";
+    std::vector<double> v;
+    std::vector<int64_t> f;
+    torus_mesh(100, 50, v, f);
+
+    std::vector<double> v0, v1;
+    std::vector<fqmr_index> f0, f1;
+    load(v, f);
+    Simplify::prepare_mesh();
+    CHECK(Simplify::save_state(path));
+    simplified(v0, f0);
+
+    load(v, f); // another state, replaced by the snapshot
+    CHECK(Simplify::load_state(path));
+    CHECK(Simplify::mesh_prepared);
+    simplified(v1, f1);
+    CHECK(!f0.empty() && f0 == f1 && v0 == v1);
+
+    // corrupt copies
+    std::string data = read_file(path);
+    Simplify::SnapshotHeader h;
+    memcpy(&h, data.data(), sizeof(h));
+    size_t triangles = sizeof(h) + h.num_vertices * sizeof(Simplify::Vertex);
+    size_t refs = triangles + h.num_triangles * sizeof(Simplify::Triangle);
+
+    // a count whose size wraps around to the same file size
+    std::string bad = data;
+    Simplify::SnapshotHeader wrapped = h;
+    wrapped.num_vertices += 1ULL << 61;
+    memcpy(&bad[0], &wrapped, sizeof(wrapped));
+    check_rejected(bad, corrupt);
+
+    // a triangle corner past the vertices
+    bad = data;
+    fqmr_index index = h.num_vertices;
+    memcpy(&bad[triangles + offsetof(Simplify::Triangle, v)], &index, sizeof(index));
+    check_rejected(bad, corrupt);
+
+    // a vertex range past the refs
+    bad = data;
+    index = h.num_refs + 1;
+    memcpy(&bad[sizeof(h) + offsetof(Simplify::Vertex, tcount)], &index, sizeof(index));
+    check_rejected(bad, corrupt);
+
+    // a ref past the triangles
+    bad = data;
+    index = -1;
+    memcpy(&bad[refs + offsetof(Simplify::Ref, tid)], &index, sizeof(index));
+    check_rejected(bad, corrupt);
+
+    remove(path);
+    remove(corrupt);
+    printf("snapshot round trip identical, corrupt snapshots rejected\n");
+    return 0;
+}